@@ -1,30 +1,413 @@
+import os
 import re
+import time
+import hashlib
+import struct
 import numpy as np
 import matplotlib.pyplot as plt
 from collections import Counter
 import argparse  # 添加argparse模块用于处理命令行参数
 
-def parse_log_file(file_path):
-    # Store latency values, sequence numbers, and send timestamps
-    latencies = []
+# Bump when parse_log_file() changes what it extracts, so that old caches are rebuilt
+CACHE_VERSION = 2
+CACHE_SAMPLE_BYTES = 1 << 20  # Bytes hashed from the start and the end of the log
+
+# Parquet export
+PARQUET_ROW_GROUP_SIZE = 1 << 20  # Packet rows per row group
+INTERVAL_SLACK = 2                # Intervals this many seconds behind the newest one are final
+
+# pcapng export
+PCAPNG_CHUNK = 1 << 16            # Packets converted per vectorized step
+PCAPNG_WRITE_BUFFER = 16 << 20    # Bytes buffered per write() call
+PCAPNG_SRC_IP = '192.0.2.1'       # The log has no addresses, use documentation addresses (RFC 5737)
+PCAPNG_DST_IP = '192.0.2.2'
+DATA_PORT = 5000                  # Same as udp_toolkit_proto.h
+HEADER_SIZE = 28                  # Toolkit packet header, the part of the payload that is reconstructed
+
+# Latency-vs-size fit
+SIZE_CLASS_BYTES = 128            # Same size classes as the server
+
+# Throughput bins
+DEFAULT_BIN_WIDTH_MS = 1000.0
+MIN_BIN_WIDTH_MS = 0.1            # 100 us floor chosen for the report; the log's ns timestamps allow finer
+                                  # bins, but below this most bins hold 0 or 1 packet and the array grows
+
+# Clock skew removal
+MIN_SKEW_SPAN_S = 1.0             # Send times must span this long for a skew estimate
+SKEW_BINS = 10000                 # Send time bins whose minimum latencies go into the hull
+
+# Follow mode
+DEFAULT_REFRESH_S = 5.0           # Summary and plot refresh period
+FOLLOW_POLL_S = 0.2               # Sleep when the log has no new complete lines
+FOLLOW_READ_BYTES = 16 << 20      # Largest chunk read from the log at once
+SKETCH_RELATIVE_ACCURACY = 0.01   # Latency percentiles are within 1% of the true value
+
+# Packet line written by the server (Recv_ts and Size are optional, older servers omit them)
+LOG_RECORD_PATTERN = re.compile(r'Seq=(\d+), Send_ts=([\d.]+)(?:, Recv_ts=([\d.]+))?'
+                                r'(?:, Size=(\d+) bytes)?, Latency=(-?[\d.]+) ms')
+
+def record_from_match(match, packet_size):
+    """(seq, send_ts, recv_ts, size, latency_ms) of a LOG_RECORD_PATTERN match."""
+    send_ts = float(match.group(2))
+    latency = float(match.group(5))
+    recv_ts = float(match.group(3)) if match.group(3) else send_ts + latency / 1000
+    size = int(match.group(4)) if match.group(4) else packet_size
+    return int(match.group(1)), send_ts, recv_ts, size, latency
+
+def iter_log_records(file_path, packet_size=1000):
+    """
+    Yield (seq, send_ts, recv_ts, size, latency_ms) for every packet line of a log file.
+
+    Older logs without Recv_ts and Size fields fall back to send_ts + latency as the
+    receive time and packet_size as the size.
+    """
+    with open(file_path, 'r') as file:
+        for line in file:
+            match = LOG_RECORD_PATTERN.search(line)
+            if match:
+                yield record_from_match(match, packet_size)
+
+def parse_log_file(file_path, packet_size=1000):
+    # Store sequence numbers, send/receive timestamps, sizes and latency values
     sequences = []
     send_timestamps = []
+    recv_timestamps = []
+    sizes = []
+    latencies = []
     
-    # Compile regex to extract data with the new Send_ts field
-    seq_pattern = re.compile(r'Seq=(\d+), Send_ts=([\d.]+), Latency=([\d.]+) ms')
+    for seq, send_ts, recv_ts, size, latency in iter_log_records(file_path, packet_size):
+        sequences.append(seq)
+        send_timestamps.append(send_ts)
+        recv_timestamps.append(recv_ts)
+        sizes.append(size)
+        latencies.append(latency)
     
-    with open(file_path, 'r') as file:
-        for line in file:
-            match = seq_pattern.search(line)
-            if match:
-                seq = int(match.group(1))
-                send_ts = float(match.group(2))
-                latency = float(match.group(3))
-                sequences.append(seq)
-                send_timestamps.append(send_ts)
-                latencies.append(latency)
+    return sequences, send_timestamps, recv_timestamps, sizes, latencies
+
+def log_fingerprint(file_path):
+    """
+    Identify a log file by size, mtime and a hash of its first and last megabyte.
+
+    Hashing the whole file would cost about as much as parsing it; size and mtime catch
+    appends and rewrites, the sampled hash catches copies with a changed mtime.
+    """
+    st = os.stat(file_path)
+    digest = hashlib.blake2b(digest_size=16)
+    with open(file_path, 'rb') as file:
+        digest.update(file.read(CACHE_SAMPLE_BYTES))
+        if st.st_size > 2 * CACHE_SAMPLE_BYTES:
+            file.seek(-CACHE_SAMPLE_BYTES, os.SEEK_END)
+            digest.update(file.read(CACHE_SAMPLE_BYTES))
+    return f"v{CACHE_VERSION}:{st.st_size}:{st.st_mtime_ns}:{digest.hexdigest()}"
+
+def load_packet_data(file_path, cache_file=None, use_cache=True, packet_size=1000):
+    """
+    Parse a log file, or load its packet columns from the side file written by an earlier run.
+
+    The cache is an uncompressed npz with one array per column, next to the log as
+    <log>.npz unless cache_file is given. It is only used when the stored fingerprint
+    matches the log file.
+
+    Returns:
+        sequences, send_timestamps, recv_timestamps, sizes, latencies (lists, as parse_log_file)
+    """
+    if not use_cache:
+        return parse_log_file(file_path, packet_size)
+
+    cache_file = cache_file or file_path + '.npz'
+    # The fallback size of old logs ends up in the data, so it is part of the key
+    key = f"{log_fingerprint(file_path)}:{packet_size}"
+    if os.path.exists(cache_file):
+        try:
+            with np.load(cache_file) as cache:
+                if str(cache['key']) == key:
+                    print(f"Loaded parsed packet data from cache: {cache_file}")
+                    return (cache['seq'].tolist(), cache['send_ts'].tolist(), cache['recv_ts'].tolist(),
+                            cache['size'].tolist(), cache['latency'].tolist())
+        except (OSError, KeyError, ValueError) as e:
+            print(f"Ignoring unreadable cache {cache_file}: {e}")
+
+    sequences, send_timestamps, recv_timestamps, sizes, latencies = parse_log_file(file_path, packet_size)
+
+    # Write to a temporary file first so an interrupted run never leaves a truncated cache
+    tmp_file = cache_file + '.tmp'
+    try:
+        with open(tmp_file, 'wb') as file:
+            np.savez(file, key=np.array(key),
+                     seq=np.array(sequences, dtype=np.int64),
+                     send_ts=np.array(send_timestamps, dtype=np.float64),
+                     recv_ts=np.array(recv_timestamps, dtype=np.float64),
+                     size=np.array(sizes, dtype=np.int32),
+                     latency=np.array(latencies, dtype=np.float64))
+        os.replace(tmp_file, cache_file)
+        print(f"Parsed packet data cached in {cache_file}")
+    except OSError as e:
+        print(f"Could not write cache {cache_file}: {e}")
+    return sequences, send_timestamps, recv_timestamps, sizes, latencies
+
+def summarize_interval(second, seqs, nbytes, latencies):
+    """One row of the interval table from the packets received during one second."""
+    lat = np.array(latencies)
+    p50, p99 = np.percentile(lat, [50, 99])
+    first, last = min(seqs), max(seqs)
+    return {
+        'interval_start': second,
+        'packets': len(seqs),
+        'bytes': nbytes,
+        'throughput_mbps': nbytes * 8 / 1_000_000,
+        'seq_first': first,
+        'seq_last': last,
+        'missing': max(0, last - first + 1 - len(set(seqs))),
+        'latency_min_ms': float(lat.min()),
+        'latency_mean_ms': float(lat.mean()),
+        'latency_p50_ms': float(p50),
+        'latency_p99_ms': float(p99),
+        'latency_max_ms': float(lat.max()),
+    }
+
+def export_parquet(file_path, out_dir, packet_size=1000, row_group_size=PARQUET_ROW_GROUP_SIZE):
+    """
+    Stream a log file into packets.parquet (one row per packet) and intervals.parquet
+    (one row per second of receive time) in out_dir.
+
+    Packet rows are buffered per row group and interval rows are written once the log has
+    moved INTERVAL_SLACK seconds past them, so memory stays bounded by one row group plus a
+    few seconds of traffic. A packet received even later (its second is already written)
+    is folded into the oldest interval still open, so every second appears exactly once.
+    """
+    try:
+        import pyarrow as pa
+        import pyarrow.parquet as pq
+    except ImportError:
+        raise SystemExit("Parquet export requires pyarrow (pip install pyarrow)")
+
+    packet_schema = pa.schema([
+        ('seq', pa.int32()),
+        ('send_ts', pa.float64()),
+        ('recv_ts', pa.float64()),
+        ('size', pa.int32()),
+        ('latency_ms', pa.float64()),
+    ])
+    interval_schema = pa.schema([
+        ('interval_start', pa.int64()),
+        ('packets', pa.int64()),
+        ('bytes', pa.int64()),
+        ('throughput_mbps', pa.float64()),
+        ('seq_first', pa.int32()),
+        ('seq_last', pa.int32()),
+        ('missing', pa.int64()),
+        ('latency_min_ms', pa.float64()),
+        ('latency_mean_ms', pa.float64()),
+        ('latency_p50_ms', pa.float64()),
+        ('latency_p99_ms', pa.float64()),
+        ('latency_max_ms', pa.float64()),
+    ])
+
+    os.makedirs(out_dir, exist_ok=True)
+    packets_path = os.path.join(out_dir, 'packets.parquet')
+    intervals_path = os.path.join(out_dir, 'intervals.parquet')
+
+    columns = ([], [], [], [], [])
+    open_intervals = {}     # second -> [[seq], bytes, [latency]]
+    interval_rows = []
+    total = 0
+    closed_before = None    # Seconds below this are written
+    late = 0
+
+    def flush_packets(writer):
+        if columns[0]:
+            writer.write_table(pa.Table.from_arrays(
+                [pa.array(col, type=field.type) for col, field in zip(columns, packet_schema)],
+                schema=packet_schema))
+            for col in columns:
+                col.clear()
+
+    def close_intervals(writer, before):
+        nonlocal closed_before
+        closed_before = before
+        for second in sorted(k for k in open_intervals if k < before):
+            seqs, nbytes, lats = open_intervals.pop(second)
+            interval_rows.append(summarize_interval(second, seqs, nbytes, lats))
+        if len(interval_rows) >= 1024 or before == float('inf'):
+            if interval_rows:
+                writer.write_table(pa.Table.from_pylist(interval_rows, schema=interval_schema))
+            interval_rows.clear()
+
+    with pq.ParquetWriter(packets_path, packet_schema, compression='zstd') as packet_writer, \
+         pq.ParquetWriter(intervals_path, interval_schema, compression='zstd') as interval_writer:
+        newest = None
+        for record in iter_log_records(file_path, packet_size):
+            for col, value in zip(columns, record):
+                col.append(value)
+            total += 1
+            if len(columns[0]) >= row_group_size:
+                flush_packets(packet_writer)
+
+            seq, _, recv_ts, size, latency = record
+            second = int(recv_ts)
+            if closed_before is not None and second < closed_before:
+                second = closed_before
+                late += 1
+            interval = open_intervals.setdefault(second, [[], 0, []])
+            interval[0].append(seq)
+            interval[1] += size
+            interval[2].append(latency)
+            if newest is None or second > newest:
+                newest = second
+                close_intervals(interval_writer, newest - INTERVAL_SLACK)
+        flush_packets(packet_writer)
+        close_intervals(interval_writer, float('inf'))
+
+    print(f"Exported {total} packets to {packets_path}")
+    print(f"Exported per-second summary to {intervals_path}")
+    if late:
+        print(f"{late} packets arrived more than {INTERVAL_SLACK} s late and were counted in a later interval")
+
+def pcapng_block(block_type, body):
+    """One pcapng block: type, total length, body padded to 32 bits, total length."""
+    body += b'\0' * (-len(body) % 4)
+    length = len(body) + 12
+    return struct.pack('<II', block_type, length) + body + struct.pack('<I', length)
+
+def pcapng_options(options):
+    """Options list of (code, bytes value), terminated by opt_endofopt."""
+    out = b''
+    for code, value in options:
+        out += struct.pack('<HH', code, len(value)) + value + b'\0' * (-len(value) % 4)
+    return out + struct.pack('<HH', 0, 0)
+
+def packet_annotations(sequences):
+    """
+    Loss flags of every packet in receive order.
     
-    return sequences, send_timestamps, latencies
+    Returns:
+        gap: Sequence numbers skipped right before the packet (seq above the highest so far)
+        late: Packet below the highest sequence number so far, arriving for the first time
+        duplicate: Sequence number seen before
+    """
+    seq = np.asarray(sequences, dtype=np.int64)
+    highest_before = np.empty_like(seq)
+    highest_before[0] = -1
+    np.maximum.accumulate(seq[:-1], out=highest_before[1:])
+    gap = np.maximum(seq - highest_before - 1, 0)
+    first = np.zeros(len(seq), dtype=bool)
+    first[np.unique(seq, return_index=True)[1]] = True
+    return gap, first & (seq < highest_before), ~first
+
+def export_pcapng(sequences, send_timestamps, recv_timestamps, sizes, latencies, out_file):
+    """
+    Write the packet records as a pcapng file for Wireshark.
+    
+    Each record becomes a raw IPv4/UDP packet (LINKTYPE_IPV4) with the toolkit header as
+    payload, reconstructed from the record, and truncated there; the original length is the
+    received size. Timestamps are the server's receive times in nanoseconds (if_tsresol 9,
+    monotonic clock, so Wireshark shows dates near 1970). The packet comment carries the
+    latency and the loss flags. Fixed-size parts are built with numpy per chunk and the file
+    is written in PCAPNG_WRITE_BUFFER-sized writes.
+    """
+    n = len(sequences)
+    ip_words = np.frombuffer(bytes(map(int, PCAPNG_SRC_IP.split('.'))) +
+                             bytes(map(int, PCAPNG_DST_IP.split('.'))), dtype='>u2')
+    # Fixed part of each Enhanced Packet Block: block header and the captured bytes
+    epb_dtype = np.dtype([
+        ('type', '<u4'), ('length', '<u4'), ('interface', '<u4'),
+        ('ts_high', '<u4'), ('ts_low', '<u4'), ('caplen', '<u4'), ('origlen', '<u4'),
+        # IPv4
+        ('ver_ihl', 'u1'), ('tos', 'u1'), ('ip_len', '>u2'), ('ip_id', '>u2'), ('frag', '>u2'),
+        ('ttl', 'u1'), ('proto', 'u1'), ('ip_csum', '>u2'), ('addrs', '>u2', (4,)),
+        # UDP
+        ('sport', '>u2'), ('dport', '>u2'), ('udp_len', '>u2'), ('udp_csum', '>u2'),
+        # Toolkit header (little-endian, as sent)
+        ('seq', '<i4'), ('send_ts', '<f8'), ('offset', '<f8'), ('packet_size', '<i4'), ('flags', '<u4'),
+    ])
+    caplen = 20 + 8 + HEADER_SIZE
+    
+    gap, late, duplicate = packet_annotations(sequences)
+    seq_all = np.asarray(sequences, dtype=np.int64)
+    send_all = np.asarray(send_timestamps, dtype=np.float64)
+    recv_all = np.asarray(recv_timestamps, dtype=np.float64)
+    size_all = np.asarray(sizes, dtype=np.int64)
+    lat_all = np.asarray(latencies, dtype=np.float64)
+    
+    shb = pcapng_block(0x0A0D0D0A, struct.pack('<IHHq', 0x1A2B3C4D, 1, 0, -1) + pcapng_options([
+        (1, b'udp_toolkit server log records; addresses are placeholders, timestamps are the '
+            b'server receive times on its monotonic clock'),
+        (4, b'parse_logs.py'),
+    ]))
+    idb = pcapng_block(1, struct.pack('<HHI', 228, 0, caplen) + pcapng_options([
+        (2, b'udp_toolkit'),
+        (9, bytes([9])),  # if_tsresol: nanoseconds
+    ]))
+    
+    with open(out_file, 'wb', buffering=PCAPNG_WRITE_BUFFER) as file:
+        file.write(shb + idb)
+        for start in range(0, n, PCAPNG_CHUNK):
+            end = min(start + PCAPNG_CHUNK, n)
+            m = end - start
+            seq = seq_all[start:end]
+            recv = recv_all[start:end]
+            size = size_all[start:end]
+            lat = lat_all[start:end]
+            
+            # 每个包的注释长度不同，先格式化注释，再由注释长度得到块长度
+            comments = []
+            for seq_i, lat_i, gap_i, late_i, dup_i in zip(seq.tolist(), lat.tolist(), gap[start:end].tolist(),
+                                                         late[start:end].tolist(), duplicate[start:end].tolist()):
+                text = f'latency={lat_i:.6f} ms'
+                if gap_i == 1:
+                    text += f'; lost 1 before (seq {seq_i - 1})'
+                elif gap_i:
+                    text += f'; lost {gap_i} before (seq {seq_i - gap_i}-{seq_i - 1})'
+                if late_i:
+                    text += '; late (reordered)'
+                if dup_i:
+                    text += '; duplicate'
+                comments.append(text.encode())
+            
+            rec = np.zeros(m, dtype=epb_dtype)
+            comment_len = np.fromiter((len(c) for c in comments), dtype=np.int64, count=m)
+            # Header, captured bytes, comment option padded, end of options, trailing length
+            rec['length'] = 28 + caplen + 4 + (comment_len + 3) // 4 * 4 + 4 + 4
+            rec['type'] = 6
+            # Whole seconds and nanoseconds separately, recv * 1e9 as a double would round
+            secs = np.floor(recv)
+            ts = (secs.astype(np.uint64) * np.uint64(1_000_000_000)
+                  + np.round((recv - secs) * 1e9).astype(np.uint64))
+            rec['ts_high'] = ts >> np.uint64(32)
+            rec['ts_low'] = ts & np.uint64(0xFFFFFFFF)
+            rec['caplen'] = caplen
+            rec['origlen'] = 20 + 8 + size
+            rec['ver_ihl'] = 0x45
+            rec['ip_len'] = 20 + 8 + size
+            rec['ip_id'] = seq & 0xFFFF
+            rec['frag'] = 0x4000  # Don't fragment
+            rec['ttl'] = 64
+            rec['proto'] = 17
+            rec['addrs'] = ip_words
+            # Header checksum: one's complement sum of the 16-bit words, the checksum word being 0
+            total = (0x4500 + 0x4000 + (64 << 8 | 17) + int(ip_words.astype(np.int64).sum())
+                     + rec['ip_len'].astype(np.int64) + rec['ip_id'].astype(np.int64))
+            total = (total & 0xFFFF) + (total >> 16)
+            total = (total & 0xFFFF) + (total >> 16)
+            rec['ip_csum'] = ~total & 0xFFFF
+            rec['sport'] = DATA_PORT
+            rec['dport'] = DATA_PORT
+            rec['udp_len'] = 8 + size
+            rec['seq'] = seq
+            rec['send_ts'] = send_all[start:end]
+            # latency = recv_ts - (send_ts + offset)
+            rec['offset'] = recv - send_all[start:end] - lat / 1000
+            rec['packet_size'] = size
+            
+            fixed = rec.tobytes()
+            width = epb_dtype.itemsize
+            parts = []
+            for i, (c, length) in enumerate(zip(comments, rec['length'].tolist())):
+                parts.append(fixed[i * width:(i + 1) * width])
+                parts.append(struct.pack('<HH', 1, len(c)) + c + b'\0' * (-len(c) % 4)
+                             + struct.pack('<HHI', 0, 0, length))
+            file.write(b''.join(parts))
+    print(f"Exported {n} packets to {out_file}")
 
 def analyze_packet_loss(sequences):
     # Cannot analyze without sequence numbers
@@ -71,6 +454,318 @@ def analyze_latency(latencies):
     
     return mean, variance, min_latency, max_latency
 
+def lower_hull(t, d):
+    """Indices of the lower convex hull of the points (t[i], d[i]), t sorted ascending (monotone chain)."""
+    hull = []
+    for i in range(len(t)):
+        # Drop the last vertex while it lies on or above the chord from its predecessor to point i
+        while len(hull) >= 2:
+            a, b = hull[-2], hull[-1]
+            if (d[b] - d[a]) * (t[i] - t[a]) >= (d[i] - d[a]) * (t[b] - t[a]):
+                hull.pop()
+            else:
+                break
+        hull.append(i)
+    return hull
+
+def estimate_skew(send_timestamps, latencies):
+    """
+    Estimate the clock skew between client and server from the lower envelope of the one-way delays.
+    
+    A clock offset that drifts after sync_clock_ntp() adds a linear ramp to every latency. As in
+    Moon, Skelly and Towsley, the skew is the slope of the line a * t + b that lies below all
+    (send time, latency) points and minimizes the sum of the distances to them. That linear
+    program is solved on the lower convex hull: its optimum is the hull edge spanning the mean
+    send time, so queueing delay above the envelope does not bias the estimate. The points are
+    first reduced to the minimum latency of each of SKEW_BINS send time bins (vectorized), so
+    the hull loop runs over at most SKEW_BINS points however long the log is.
+    
+    Args:
+        send_timestamps: List of send timestamps in seconds
+        latencies: List of latencies in ms
+    
+    Returns:
+        skew_ms_per_s: Slope of the envelope in ms per second (1 ms/s = 1000 ppm), None if the
+            send times span less than MIN_SKEW_SPAN_S
+        t0: First send timestamp, where the correction is zero
+        hull_points: Number of lower hull vertices
+    """
+    if len(send_timestamps) < 2:
+        return None, None, 0
+    t = np.asarray(send_timestamps, dtype=np.float64)
+    d = np.asarray(latencies, dtype=np.float64)
+    order = np.lexsort((d, t))  # By send time, the lowest latency first among equal times
+    t0 = t[order[0]]
+    ts = t[order] - t0
+    if ts[-1] < MIN_SKEW_SPAN_S:
+        return None, t0, 0
+    
+    # Per-bin minima: sorted by bin, the lowest latency first, keep the first point of each bin
+    ds = d[order]
+    bins = np.minimum((ts * (SKEW_BINS / ts[-1])).astype(np.int64), SKEW_BINS - 1)
+    by_bin = np.lexsort((ds, bins))
+    _, first = np.unique(bins[by_bin], return_index=True)
+    keep = by_bin[first]
+    
+    hull = lower_hull(ts[keep].tolist(), ds[keep].tolist())
+    hull_t = ts[keep][hull]
+    hull_d = ds[keep][hull]
+    
+    # Hull edge whose time range contains the mean send time
+    k = int(np.searchsorted(hull_t, ts.mean()))
+    k = min(max(k, 1), len(hull) - 1)
+    if hull_t[k] <= hull_t[k - 1]:
+        return None, t0, len(hull)
+    skew = (hull_d[k] - hull_d[k - 1]) / (hull_t[k] - hull_t[k - 1])
+    return skew, t0, len(hull)
+
+def remove_skew(send_timestamps, latencies, skew_ms_per_s, t0):
+    """Return the latencies with the skew ramp removed, unchanged at send time t0."""
+    t = np.asarray(send_timestamps, dtype=np.float64)
+    d = np.asarray(latencies, dtype=np.float64)
+    return d - skew_ms_per_s * (t - t0)
+
+class SizeFit:
+    """
+    Least-squares fit of minimum latency against packet size, in constant memory.
+
+    Each size class keeps its minimum latency (the sample least affected by queueing), so the
+    fit is available at any time without storing packets: the intercept is the fixed delay and
+    the slope the per-byte serialization delay of the bottleneck. The fit uses centered sums
+    (Welford), since raw sums of squared sizes cancel catastrophically.
+    """
+    def __init__(self, class_bytes=SIZE_CLASS_BYTES):
+        self.class_bytes = class_bytes
+        self.minima = {}  # size class -> (size, latency_ms)
+
+    def add(self, size, latency_ms):
+        k = size // self.class_bytes
+        best = self.minima.get(k)
+        if best is not None and latency_ms >= best[1]:
+            return
+        self.minima[k] = (size, latency_ms)
+
+    def result(self):
+        """Return (fixed_delay_ms, ns_per_byte, bottleneck_mbps, classes); None values if unresolved."""
+        n = 0
+        mx = my = cxx = cxy = 0.0
+        for x, y in self.minima.values():
+            n += 1
+            dx = x - mx
+            mx += dx / n
+            my += (y - my) / n
+            cxx += dx * (x - mx)
+            cxy += dx * (y - my)
+        if n < 2 or cxx <= 0:
+            return None, None, None, n
+        slope = cxy / cxx  # ms per byte
+        intercept = my - slope * mx
+        if slope <= 0:
+            return intercept, None, None, n
+        return intercept, slope * 1e6, 8 / (slope / 1000) / 1_000_000, n
+
+class LatencySketch:
+    """
+    Mergeable latency quantile sketch with relative error guarantees (DDSketch layout).
+    
+    Values are counted in logarithmic buckets of ratio gamma = (1 + a) / (1 - a), so every
+    quantile is returned within relative accuracy a. Negative latencies (clock offset
+    errors) use a mirrored set of buckets, values near zero share one bucket.
+    """
+    MIN_INDEXABLE = 1e-9  # ms
+    
+    def __init__(self, relative_accuracy=SKETCH_RELATIVE_ACCURACY):
+        self.gamma = (1 + relative_accuracy) / (1 - relative_accuracy)
+        self.log_gamma = np.log(self.gamma)
+        self.positive = Counter()
+        self.negative = Counter()
+        self.zero = 0
+        self.count = 0
+        self.sum = 0.0
+        self.min = float('inf')
+        self.max = float('-inf')
+    
+    def _add_keys(self, store, values):
+        keys, counts = np.unique(np.ceil(np.log(values) / self.log_gamma).astype(np.int64),
+                                 return_counts=True)
+        store.update(dict(zip(keys.tolist(), counts.tolist())))
+    
+    def add(self, values):
+        values = np.asarray(values, dtype=np.float64)
+        if len(values) == 0:
+            return
+        self.count += len(values)
+        self.sum += float(values.sum())
+        self.min = min(self.min, float(values.min()))
+        self.max = max(self.max, float(values.max()))
+        pos = values[values > self.MIN_INDEXABLE]
+        neg = -values[values < -self.MIN_INDEXABLE]
+        self.zero += len(values) - len(pos) - len(neg)
+        if len(pos):
+            self._add_keys(self.positive, pos)
+        if len(neg):
+            self._add_keys(self.negative, neg)
+    
+    def _value(self, key):
+        return 2 * self.gamma ** key / (self.gamma + 1)
+    
+    def quantile(self, q):
+        """Value at quantile q (0..1), None when empty."""
+        if self.count == 0:
+            return None
+        rank = q * (self.count - 1)
+        seen = 0
+        for key in sorted(self.negative, reverse=True):
+            seen += self.negative[key]
+            if seen > rank:
+                return max(-self._value(key), self.min)
+        seen += self.zero
+        if seen > rank:
+            return 0.0
+        for key in sorted(self.positive):
+            seen += self.positive[key]
+            if seen > rank:
+                return min(self._value(key), self.max)
+        return self.max
+
+class LiveAnalysis:
+    """
+    Loss, latency percentiles and per-second series, updated batch by batch.
+    
+    Only aggregates are kept: a received-flag per sequence number for loss and duplicates,
+    a LatencySketch and per-second counters of receive time.
+    """
+    def __init__(self):
+        self.seen = np.zeros(1 << 16, dtype=np.uint8)
+        self.max_seq = -1
+        self.unique = 0
+        self.duplicates = 0
+        self.packets = 0
+        self.bytes = 0
+        self.sketch = LatencySketch()
+        self.seconds = {}  # second of receive time -> [packets, bytes, latency sum, latency max]
+    
+    def add(self, records):
+        """Add a list of (seq, send_ts, recv_ts, size, latency_ms) records."""
+        if not records:
+            return
+        seqs, _, recv_ts, sizes, latencies = (np.array(col) for col in zip(*records))
+        self.packets += len(seqs)
+        self.bytes += int(sizes.sum())
+        
+        top = int(seqs.max())
+        if top >= len(self.seen):
+            grown = np.zeros(max(top + 1, 2 * len(self.seen)), dtype=np.uint8)
+            grown[:len(self.seen)] = self.seen
+            self.seen = grown
+        self.max_seq = max(self.max_seq, top)
+        unique_seqs = np.unique(seqs)
+        new = int(np.count_nonzero(self.seen[unique_seqs] == 0))
+        self.seen[unique_seqs] = 1
+        self.unique += new
+        self.duplicates += len(seqs) - new
+        
+        self.sketch.add(latencies)
+        
+        seconds, inverse = np.unique(recv_ts.astype(np.int64), return_inverse=True)
+        packets = np.bincount(inverse)
+        nbytes = np.bincount(inverse, weights=sizes)
+        lat_sum = np.bincount(inverse, weights=latencies)
+        lat_max = np.full(len(seconds), -np.inf)
+        np.maximum.at(lat_max, inverse, latencies)
+        for i, second in enumerate(seconds.tolist()):
+            row = self.seconds.setdefault(second, [0, 0, 0.0, float('-inf')])
+            row[0] += int(packets[i])
+            row[1] += int(nbytes[i])
+            row[2] += float(lat_sum[i])
+            row[3] = max(row[3], float(lat_max[i]))
+    
+    def series(self):
+        """(bin_starts, throughput_mbps) per second of receive time, empty seconds included."""
+        if not self.seconds:
+            return np.array([]), np.array([])
+        first, last = min(self.seconds), max(self.seconds)
+        bin_starts = np.arange(last - first + 1, dtype=np.float64)
+        throughput = np.zeros(len(bin_starts))
+        for second, row in self.seconds.items():
+            throughput[second - first] = row[1] * 8 / 1_000_000
+        return bin_starts, throughput
+    
+    def print_summary(self, offset):
+        expected = self.max_seq + 1
+        lost = expected - self.unique
+        print(f"\n[{time.strftime('%H:%M:%S')}] {self.packets} packets, {self.bytes / 1e6:.1f} MB "
+              f"(log offset {offset / 1e6:.1f} MB)")
+        if expected > 0:
+            print(f"Packet loss: {lost / expected:.3%} ({lost} of {expected}), duplicates: {self.duplicates}")
+        if self.sketch.count:
+            q = self.sketch.quantile
+            print(f"Latency (ms): min={self.sketch.min:.3f} mean={self.sketch.sum / self.sketch.count:.3f} "
+                  f"p50={q(0.5):.3f} p99={q(0.99):.3f} p99.9={q(0.999):.3f} max={self.sketch.max:.3f}")
+        if len(self.seconds) >= 2:
+            # The newest second is still filling, report the one before it
+            second = sorted(self.seconds)[-2]
+            packets, nbytes, lat_sum, lat_max = self.seconds[second]
+            print(f"Second {second}: {packets} packets, {nbytes * 8 / 1e6:.2f} Mbps, "
+                  f"mean latency {lat_sum / packets:.3f} ms, max {lat_max:.3f} ms")
+
+def follow_log(file_path, packet_size=1000, refresh_s=DEFAULT_REFRESH_S):
+    """
+    Analyze a log while the server is writing it, until interrupted (Ctrl+C).
+    
+    New bytes are read from the last processed offset and only complete lines are parsed,
+    so nothing is read twice. Every refresh_s seconds the summary is printed and the
+    throughput graph rewritten. A log that shrinks (rotated or truncated) starts over.
+    """
+    state = LiveAnalysis()
+    offset = 0
+    partial = b''
+    next_refresh = time.monotonic() + refresh_s
+    dirty = False
+    print(f"Following {file_path}, summary every {refresh_s:g} s (Ctrl+C to stop)")
+    try:
+        while True:
+            try:
+                size = os.path.getsize(file_path)
+            except OSError:
+                size = None
+            if size is not None and size < offset:
+                print(f"\n{file_path} was truncated, starting over")
+                state, offset, partial = LiveAnalysis(), 0, b''
+            
+            chunk = b''
+            if size is not None and size > offset:
+                with open(file_path, 'rb') as file:
+                    file.seek(offset)
+                    chunk = file.read(FOLLOW_READ_BYTES)
+                offset += len(chunk)
+            
+            # 只解析完整的行，最后不完整的一行留到下一次
+            data = partial + chunk
+            end = data.rfind(b'\n') + 1
+            partial = data[end:]
+            if end > 0:
+                text = data[:end].decode('utf-8', errors='replace')
+                state.add([record_from_match(m, packet_size) for m in LOG_RECORD_PATTERN.finditer(text)])
+                dirty = True
+            
+            now = time.monotonic()
+            if now >= next_refresh:
+                next_refresh = now + refresh_s
+                if dirty:
+                    state.print_summary(offset)
+                    bin_starts, throughput = state.series()
+                    plot_throughput(bin_starts, throughput, 1.0)
+                    dirty = False
+            if len(chunk) < FOLLOW_READ_BYTES:
+                time.sleep(FOLLOW_POLL_S)
+    except KeyboardInterrupt:
+        pass
+    state.print_summary(offset)
+    bin_starts, throughput = state.series()
+    plot_throughput(bin_starts, throughput, 1.0)
+    print(f"\nThroughput graph saved to 'throughput_graph.png'")
+
 def plot_latency_histogram(latencies, output_file="latency_histogram.png"):
     plt.figure(figsize=(10, 6))
     plt.hist(latencies, bins=30, alpha=0.7, color='blue')
@@ -81,75 +776,88 @@ def plot_latency_histogram(latencies, output_file="latency_histogram.png"):
     plt.savefig(output_file)
     plt.close()
 
-def calculate_throughput(sequences, send_timestamps, packet_size=1000):
+def plot_latency_skew(send_timestamps, latencies, skew_ms_per_s, t0, output_file="latency_skew.png"):
+    """
+    Plot latency over send time with the fitted skew line through the lower envelope.
+    
+    Args:
+        send_timestamps: List of send timestamps in seconds
+        latencies: List of raw latencies in ms
+        skew_ms_per_s: Estimated skew in ms per second
+        t0: First send timestamp
+        output_file: Path to save the plot
+    """
+    t = np.asarray(send_timestamps, dtype=np.float64) - t0
+    d = np.asarray(latencies, dtype=np.float64)
+    # The envelope line touches the lowest point after removing the slope
+    base = np.min(d - skew_ms_per_s * t)
+    span = np.array([0.0, t.max()])
+    
+    plt.figure(figsize=(12, 6))
+    plt.plot(t, d, ',', color='blue', alpha=0.5, label='Raw latency')
+    plt.plot(span, base + skew_ms_per_s * span, color='red', linewidth=1.0,
+             label=f'Lower envelope ({skew_ms_per_s * 1000:+.3f} ppm)')
+    plt.title('Latency Over Time and Clock Skew')
+    plt.xlabel('Time (seconds from first packet)')
+    plt.ylabel('Latency (ms)')
+    plt.legend()
+    plt.grid(True, alpha=0.3)
+    plt.savefig(output_file)
+    plt.close()
+
+def calculate_throughput(recv_timestamps, sizes, bin_width=1.0):
     """
-    Calculate network throughput based on send timestamps.
+    Calculate received throughput from receive timestamps and actual packet sizes.
+    
+    All packets are binned in one vectorized pass, empty bins included, so bins well below
+    a second show microbursts and gaps that whole-second averages smooth away.
     
     Args:
-        sequences: List of sequence numbers
-        send_timestamps: List of send timestamps
-        packet_size: Size of each packet in Bytes
+        recv_timestamps: List of receive timestamps in seconds
+        sizes: List of received packet sizes in Bytes
+        bin_width: Bin width in seconds
     
     Returns:
         overall_throughput: Average throughput for the entire session in Mbps
-        throughput_per_second: Dictionary mapping each second to its throughput in Mbps
+        bin_starts: Start of each bin in seconds from the first packet
+        throughput_per_bin: Throughput of each bin in Mbps
     """
-    if not sequences or not send_timestamps or len(sequences) != len(send_timestamps):
-        return 0, {}
+    if len(recv_timestamps) == 0 or len(recv_timestamps) != len(sizes):
+        return 0, np.array([]), np.array([])
     
-    # Sort data by timestamp to ensure chronological order
-    data = sorted(zip(sequences, send_timestamps), key=lambda x: x[1])
-    seq_sorted = [x[0] for x in data]
-    ts_sorted = [x[1] for x in data]
+    ts = np.asarray(recv_timestamps, dtype=np.float64)
+    bits = np.asarray(sizes, dtype=np.float64) * 8
     
     # Overall throughput calculation
-    duration = ts_sorted[-1] - ts_sorted[0]  # Total duration in seconds
-    total_bits = len(sequences) * packet_size * 8  # Total bits transferred
-    overall_throughput = (total_bits / duration) / 1_000_000  # Convert to Mbps
-    
-    # Per-second throughput calculation
-    throughput_per_second = {}
-    
-    # Get the starting second (floor)
-    start_second = int(ts_sorted[0])
-    end_second = int(ts_sorted[-1]) + 1
-    
-    for second in range(start_second, end_second):
-        # Find packets sent in this second
-        packets_in_second = [
-            seq for seq, ts in zip(seq_sorted, ts_sorted) 
-            if second <= ts < second + 1
-        ]
-        
-        if packets_in_second:
-            # Calculate throughput for this second (Mbps)
-            bits_in_second = len(packets_in_second) * packet_size * 8
-            throughput_per_second[second] = bits_in_second / 1_000_000
+    start = ts.min()
+    duration = ts.max() - start  # Total duration in seconds
+    overall_throughput = bits.sum() / duration / 1_000_000 if duration > 0 else 0  # Convert to Mbps
+    
+    # Per-bin throughput: bin index of every packet, then bits per bin
+    bins = ((ts - start) / bin_width).astype(np.int64)
+    bits_per_bin = np.bincount(bins, weights=bits)
+    throughput_per_bin = bits_per_bin / bin_width / 1_000_000
+    bin_starts = np.arange(len(bits_per_bin)) * bin_width
     
-    return overall_throughput, throughput_per_second
+    return overall_throughput, bin_starts, throughput_per_bin
 
-def plot_throughput(throughput_per_second, output_file="throughput_graph.png"):
+def plot_throughput(bin_starts, throughput_per_bin, bin_width, output_file="throughput_graph.png"):
     """
     Plot throughput over time.
     
     Args:
-        throughput_per_second: Dictionary mapping seconds to throughput in Mbps
+        bin_starts: Start of each bin in seconds from the first packet
+        throughput_per_bin: Throughput of each bin in Mbps
+        bin_width: Bin width in seconds (for the title)
         output_file: Path to save the plot
     """
-    if not throughput_per_second:
+    if len(bin_starts) == 0:
         return
     
-    seconds = sorted(throughput_per_second.keys())
-    throughputs = [throughput_per_second[s] for s in seconds]
-    
-    # Normalize time to start from 0
-    start_time = min(seconds)
-    normalized_seconds = [s - start_time for s in seconds]
-    
     plt.figure(figsize=(12, 6))
-    plt.plot(normalized_seconds, throughputs, marker='o', linestyle='-', markersize=3)
-    plt.title('Network Throughput Over Time')
-    plt.xlabel('Time (seconds from start)')
+    plt.step(bin_starts, throughput_per_bin, where='post', linewidth=0.8)
+    plt.title(f'Received Throughput Over Time ({bin_width * 1000:g} ms bins)')
+    plt.xlabel('Time (seconds from first packet)')
     plt.ylabel('Throughput (Mbps)')
     plt.grid(True, alpha=0.3)
     plt.savefig(output_file)
@@ -161,19 +869,55 @@ def main():
     parser.add_argument('--log-file', type=str, default="server_debug_20250420_225135.log",
                         help='Path to the log file to analyze')
     parser.add_argument('--packet-size', type=int, default=1000,
-                        help='Size of each packet in Bytes (default: 1000)')
+                        help='Size of each packet in Bytes, used for logs without sizes (default: 1000)')
+    parser.add_argument('--bin-width-ms', type=float, default=DEFAULT_BIN_WIDTH_MS,
+                        help=f'Throughput bin width in milliseconds, at least {MIN_BIN_WIDTH_MS} '
+                             f'(default: {DEFAULT_BIN_WIDTH_MS:g})')
+    parser.add_argument('--cache-file', type=str, default=None,
+                        help='Side file for the parsed packet data (default: <log file>.npz)')
+    parser.add_argument('--no-cache', action='store_true',
+                        help='Always parse the log file, neither read nor write the cache')
+    parser.add_argument('--parquet-dir', type=str, default=None,
+                        help='Export packets.parquet and intervals.parquet to this directory instead of analyzing')
+    parser.add_argument('--row-group-size', type=int, default=PARQUET_ROW_GROUP_SIZE,
+                        help=f'Packet rows per Parquet row group (default: {PARQUET_ROW_GROUP_SIZE})')
+    parser.add_argument('--pcapng', type=str, default=None,
+                        help='Export the packet records to this pcapng file for Wireshark instead of analyzing')
+    parser.add_argument('--follow', action='store_true',
+                        help='Follow a log that is still being written and refresh the summary until Ctrl+C')
+    parser.add_argument('--refresh-s', type=float, default=DEFAULT_REFRESH_S,
+                        help=f'Follow mode: seconds between summaries (default: {DEFAULT_REFRESH_S:g})')
     args = parser.parse_args()
     
     log_file = args.log_file
     packet_size = args.packet_size
+    if args.bin_width_ms < MIN_BIN_WIDTH_MS:
+        parser.error(f"--bin-width-ms must be at least {MIN_BIN_WIDTH_MS}")
+    bin_width = args.bin_width_ms / 1000
+    
+    if args.parquet_dir:
+        print(f"Exporting log file to Parquet: {log_file}")
+        export_parquet(log_file, args.parquet_dir, packet_size, args.row_group_size)
+        return
+    
+    if args.follow:
+        if args.refresh_s <= 0:
+            parser.error("--refresh-s must be positive")
+        follow_log(log_file, packet_size, args.refresh_s)
+        return
     
     print(f"Parsing log file: {log_file}")
-    sequences, send_timestamps, latencies = parse_log_file(log_file)
+    sequences, send_timestamps, recv_timestamps, sizes, latencies = load_packet_data(
+        log_file, args.cache_file, use_cache=not args.no_cache, packet_size=packet_size)
     
     if not sequences:
         print("No packet sequence data found")
         return
     
+    if args.pcapng:
+        export_pcapng(sequences, send_timestamps, recv_timestamps, sizes, latencies, args.pcapng)
+        return
+    
     # Analyze packet loss
     loss_rate, lost_packets, discontinuities = analyze_packet_loss(sequences)
     print(f"\nPacket Loss Analysis:")
@@ -201,28 +945,71 @@ def main():
     print(f"Minimum latency: {min_latency:.6f} ms")
     print(f"Maximum latency: {max_latency:.6f} ms")
     
+    # 估计并去除时钟漂移（下包络线斜率），原始与校正后的统计并列输出
+    skew, t0, hull_points = estimate_skew(send_timestamps, latencies)
+    fit_latencies = latencies
+    print(f"\nClock Skew Removal (lower envelope of one-way delays):")
+    if skew is None:
+        print(f"Needs send times spanning at least {MIN_SKEW_SPAN_S:g} s")
+    else:
+        corrected = remove_skew(send_timestamps, latencies, skew, t0)
+        fit_latencies = corrected.tolist()
+        duration = max(send_timestamps) - t0
+        print(f"Estimated skew: {skew * 1000:+.3f} ppm ({skew * duration:+.6f} ms over {duration:.1f} s, "
+              f"{hull_points} hull points)")
+        raw = np.asarray(latencies, dtype=np.float64)
+        print(f"{'':20} {'Raw':>14} {'Corrected':>14}")
+        print(f"{'Mean latency:':20} {np.mean(raw):11.6f} ms {np.mean(corrected):11.6f} ms")
+        print(f"{'Latency variance:':20} {np.var(raw):10.6f} ms² {np.var(corrected):10.6f} ms²")
+        print(f"{'Minimum latency:':20} {np.min(raw):11.6f} ms {np.min(corrected):11.6f} ms")
+        print(f"{'P50 latency:':20} {np.percentile(raw, 50):11.6f} ms {np.percentile(corrected, 50):11.6f} ms")
+        print(f"{'P99 latency:':20} {np.percentile(raw, 99):11.6f} ms {np.percentile(corrected, 99):11.6f} ms")
+        print(f"{'Maximum latency:':20} {np.max(raw):11.6f} ms {np.max(corrected):11.6f} ms")
+    
+    # Fit minimum latency against packet size (the log carries no flow identity, so one fit).
+    # Uses the skew-corrected latencies, otherwise drift shifts the minima of later classes.
+    size_fit = SizeFit()
+    for size, latency in zip(sizes, fit_latencies):
+        size_fit.add(size, latency)
+    fixed_delay, ns_per_byte, bottleneck, classes = size_fit.result()
+    print(f"\nLatency vs Size ({classes} size classes of {SIZE_CLASS_BYTES} Bytes):")
+    if fixed_delay is None:
+        print("Needs packets of at least 2 size classes (client -z)")
+    elif ns_per_byte is None:
+        print(f"Fixed delay: {fixed_delay:.6f} ms, no per-byte delay resolved")
+    else:
+        print(f"Fixed delay: {fixed_delay:.6f} ms")
+        print(f"Per-byte delay: {ns_per_byte:.3f} ns/Byte (bottleneck bandwidth {bottleneck:.2f} Mbps)")
+    
     # Calculate and display throughput
-    overall_throughput, throughput_per_second = calculate_throughput(
-        sequences, send_timestamps, packet_size
+    overall_throughput, bin_starts, throughput_per_bin = calculate_throughput(
+        recv_timestamps, sizes, bin_width
     )
     
-    print(f"\nThroughput Analysis (packet size: {packet_size} Bytes):")
+    print(f"\nThroughput Analysis (received bytes, {args.bin_width_ms:g} ms bins):")
     print(f"Overall average throughput: {overall_throughput:.2f} Mbps")
     
-    if throughput_per_second:
-        max_second = max(throughput_per_second.items(), key=lambda x: x[1])
-        min_second = min(throughput_per_second.items(), key=lambda x: x[1])
-        print(f"Maximum throughput: {max_second[1]:.2f} Mbps (at second {max_second[0]})")
-        print(f"Minimum throughput: {min_second[1]:.2f} Mbps (at second {min_second[0]})")
+    if len(throughput_per_bin) > 0:
+        peak = int(np.argmax(throughput_per_bin))
+        low = int(np.argmin(throughput_per_bin))
+        print(f"Maximum throughput: {throughput_per_bin[peak]:.2f} Mbps (bin at {bin_starts[peak]:.4f} s)")
+        print(f"Minimum throughput: {throughput_per_bin[low]:.2f} Mbps (bin at {bin_starts[low]:.4f} s)")
+        if overall_throughput > 0:
+            print(f"Peak-to-average ratio: {throughput_per_bin[peak] / overall_throughput:.2f}")
+        print(f"Empty bins: {int(np.count_nonzero(throughput_per_bin == 0))} of {len(throughput_per_bin)}")
         
         # Generate throughput graph
-        plot_throughput(throughput_per_second)
+        plot_throughput(bin_starts, throughput_per_bin, bin_width)
         print(f"\nThroughput graph saved to 'throughput_graph.png'")
     
     # Generate latency histogram
     if latencies:
         plot_latency_histogram(latencies)
         print(f"\nLatency histogram saved to 'latency_histogram.png'")
+    
+    if skew is not None:
+        plot_latency_skew(send_timestamps, latencies, skew, t0)
+        print(f"Latency skew graph saved to 'latency_skew.png'")
 
 if __name__ == "__main__":
     main() 
\ No newline at end of file
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Regression test: with -E the packets sent before the first echo estimate (the first 8·N
+# data packets and the START marker) must carry the port-4000 offset, not 0. A fake server
+# whose clock runs SHIFT seconds ahead answers the sync request and the echo requests and
+# records the offset field of every packet it receives.
+set -eu
+client="$1"
+work=$(mktemp -d)
+pid=
+cleanup() {
+    [ -n "$pid" ] && { kill "$pid" 2>/dev/null || true; }
+    rm -rf "$work"
+}
+trap cleanup EXIT
+cd "$work"
+
+python3 - > fake.txt 2>&1 <<'PY' &
+import select, socket, struct, time
+SHIFT = 100.0
+ECHO_REQ, ECHO_REPLY, START, END = 0x0004, 0x0008, 0x0010, 0x0020
+now = lambda: time.monotonic() + SHIFT
+sync = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+sync.bind(("127.0.0.1", 4000))
+data = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+data.bind(("127.0.0.1", 5000))
+bad = total = 0
+deadline = time.monotonic() + 10
+while time.monotonic() < deadline:
+    r, _, _ = select.select([sync, data], [], [], 0.5)
+    if sync in r:
+        msg, addr = sync.recvfrom(64)
+        t2 = now()
+        sync.sendto(struct.pack("<ddd", struct.unpack_from("<d", msg)[0], t2, now()), addr)
+    if data in r:
+        msg, addr = data.recvfrom(65536)
+        t2 = now()
+        seq, ts, off, size, flags = struct.unpack_from("<iddiI", msg)
+        if flags & END:
+            break
+        total += 1
+        if abs(off - SHIFT) > 1.0:
+            bad += 1
+            print("seq %d flags 0x%x offset %.6f" % (seq, flags, off))
+        if flags & ECHO_REQ:
+            hdr = struct.pack("<iddiI", seq, ts, off, 44, ECHO_REPLY)
+            data.sendto(hdr + struct.pack("<dd", t2, now()), addr)
+print("received %d, bad offset %d" % (total, bad))
+PY
+pid=$!
+sleep 0.5
+
+"$client" -i 127.0.0.1 -b 1000000 -t 1 -E 4 > client.txt 2>&1
+wait "$pid" || true
+pid=
+
+cat client.txt fake.txt
+fail() { echo "FAIL: $1"; exit 1; }
+grep -q 'received [1-9][0-9]*, bad offset 0$' fake.txt || fail "packets sent before the echo estimate carry a wrong offset"
+echo "in-band sync test passed"
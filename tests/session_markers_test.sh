@@ -0,0 +1,62 @@
+#!/bin/sh
+# Regression test: the end of one session and the start of the next arrive in one receive
+# batch. The server is stopped while the datagrams queue up, so recvmmsg() returns
+# [data x5, END, START, data x3] at once; the two sessions must not blend. Then a dual-path
+# session whose path B copies arrive after path A's end marker: they belong to the session
+# and must not start a new one.
+set -eu
+server="$1"
+work=$(mktemp -d)
+pid=
+cleanup() {
+    [ -n "$pid" ] && { kill -CONT "$pid" 2>/dev/null || true; kill "$pid" 2>/dev/null || true; }
+    rm -rf "$work"
+}
+trap cleanup EXIT
+cd "$work"
+
+"$server" -N -H -I 30 > out.txt 2>&1 &
+pid=$!
+sleep 0.5
+kill -STOP "$pid"
+
+send() {
+    python3 - "$@" <<'PY'
+import socket, struct, sys, time
+START, END = 0x0010, 0x0020
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+def pkt(seq, flags, size=64):
+    hdr = struct.pack("<iddiI", seq, time.time(), 0.0, size, flags)
+    return hdr + b"\0" * (size - len(hdr))
+PATH = {"": 0, "A": 0x0040, "B": 0x0080}
+for item in sys.argv[1:]:
+    kind, n, path = (item.split(":") + ["", ""])[:3]
+    n = int(n or 0)
+    if kind == "data":
+        for seq in range(n):
+            s.sendto(pkt(seq, PATH[path]), ("127.0.0.1", 5000))
+    else:
+        s.sendto(pkt(n, (START if kind == "start" else END) | PATH[path], 28), ("127.0.0.1", 5000))
+PY
+}
+
+send start data:5 end:5 start data:3
+sleep 0.2
+kill -CONT "$pid"
+sleep 0.5
+send end:3
+sleep 0.2
+send start data:4:A end:4:A data:4:B end:4:B
+sleep 0.5
+kill "$pid"
+wait "$pid" 2>/dev/null || true
+
+cat out.txt
+fail() { echo "FAIL: $1"; exit 1; }
+[ "$(grep -c '^=== Session .* started ===' out.txt)" -eq 3 ] || fail "expected three sessions"
+grep -q 'Packets received: 5,' out.txt || fail "first session must hold the 5 packets before END"
+grep -q 'Packets received: 3,' out.txt || fail "second session must hold the 3 packets after START"
+grep -q 'Packets sent: 5, Lost: 0 ' out.txt || fail "first session loss"
+grep -q 'Packets sent: 3, Lost: 0 ' out.txt || fail "second session loss"
+grep -q 'Path B: received 4, lost 0 ' out.txt || fail "late path B copies must stay in the dual-path session"
+echo "session marker test passed"
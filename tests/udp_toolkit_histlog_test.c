@@ -0,0 +1,122 @@
+// Regression tests of the compressed V2 histogram decoder (udp_toolkit_histlog.c)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "udp_toolkit_histlog.h"
+
+#define V2_HEADER_SIZE 40
+#define BUF_SIZE       (1 << 20)
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                        \
+    do {                                                        \
+        if (!(cond)) {                                          \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__);\
+            fprintf(stderr, __VA_ARGS__);                       \
+            fprintf(stderr, "\n");                              \
+            failures++;                                         \
+        }                                                       \
+    } while (0)
+
+static uint32_t get_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be32(unsigned char* p, uint32_t v) {
+    for (int i = 3; i >= 0; i--) *p++ = (unsigned char)(v >> (8 * i));
+}
+
+static size_t put_zigzag(unsigned char* p, int64_t v) {
+    uint64_t u = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    size_t n = 0;
+    while (u >= 0x80) {
+        p[n++] = (unsigned char)(u | 0x80);
+        u >>= 7;
+    }
+    p[n++] = (unsigned char)u;
+    return n;
+}
+
+// Compressed histogram with the header of a valid encoding and the given counts payload
+static long craft(const unsigned char* valid, const unsigned char* payload, size_t payload_len,
+                  unsigned char* out, size_t cap) {
+    unsigned char raw[4096];
+    uLongf raw_len = sizeof(raw);
+    if (uncompress(raw, &raw_len, valid + 8, get_be32(valid + 4)) != Z_OK) return -1;
+    memcpy(raw + V2_HEADER_SIZE, payload, payload_len);
+    put_be32(raw + 4, (uint32_t)payload_len);
+    uLongf zlen = (uLongf)(cap - 8);
+    if (compress2(out + 8, &zlen, raw, V2_HEADER_SIZE + payload_len, Z_DEFAULT_COMPRESSION) != Z_OK) return -1;
+    memcpy(out, valid, 4);
+    put_be32(out + 4, (uint32_t)zlen);
+    return 8 + (long)zlen;
+}
+
+static void test_round_trip(struct latency_hist* src, struct latency_hist* dst, unsigned char* buf) {
+    hist_record(src, 1000);
+    hist_record(src, 1000);
+    hist_record(src, 250000);
+    hist_record(src, 3000000000LL);
+    long len = hist_encode_compressed(src, buf, BUF_SIZE);
+    CHECK(len > 0, "encode failed");
+    CHECK(hist_decode_compressed(buf, (size_t)len, dst) == 0, "decode of a valid encoding failed");
+    CHECK(dst->total_count == 4, "total count %lld, expected 4", (long long)dst->total_count);
+    for (int32_t i = 0; i < src->counts_len; i++) {
+        if (src->counts[i] != dst->counts[i]) {
+            CHECK(0, "bucket %d: %lld != %lld", i, (long long)src->counts[i], (long long)dst->counts[i]);
+            break;
+        }
+    }
+}
+
+// Zero runs that would move the index outside the counts array must be rejected untouched,
+// also when a valid count precedes them
+static void test_hostile_zero_run(struct latency_hist* src, struct latency_hist* dst, unsigned char* buf) {
+    long valid_len = hist_encode_compressed(src, buf, BUF_SIZE);
+    CHECK(valid_len > 0, "encode failed");
+    unsigned char* valid = (unsigned char*)malloc((size_t)valid_len);
+    memcpy(valid, buf, (size_t)valid_len);
+
+    const int64_t runs[] = {
+        -((int64_t)1 << 32) + 1,            // Wraps to +1 when truncated to 32 bits
+        -((int64_t)1 << 31),                // Wraps to INT32_MIN
+        -(int64_t)dst->counts_len - 1,      // Past the end
+        INT64_MIN / 2,
+    };
+    for (int lead = 0; lead < 2; lead++) {
+        for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+            unsigned char payload[32];
+            size_t n = lead ? put_zigzag(payload, 7) : 0;
+            n += put_zigzag(payload + n, runs[r]);
+            n += put_zigzag(payload + n, 5);
+            long len = craft(valid, payload, n, buf, BUF_SIZE);
+            CHECK(len > 0, "crafting failed");
+            hist_reset(dst);
+            CHECK(hist_decode_compressed(buf, (size_t)len, dst) < 0, "zero run %lld accepted (lead %d)",
+                  (long long)runs[r], lead);
+            CHECK(dst->total_count == 0 && dst->counts[0] == 0, "zero run %lld changed the histogram (lead %d)",
+                  (long long)runs[r], lead);
+        }
+    }
+    free(valid);
+}
+
+int main(void) {
+    struct latency_hist src, dst;
+    unsigned char* buf = (unsigned char*)malloc(BUF_SIZE);
+    if (!buf || hist_init(&src, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0 ||
+        hist_init(&dst, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+        perror("allocation");
+        return 1;
+    }
+    test_round_trip(&src, &dst, buf);
+    test_hostile_zero_run(&src, &dst, buf);
+    hist_free(&src);
+    hist_free(&dst);
+    free(buf);
+    if (failures == 0) printf("histlog decode tests passed\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+// Fleet statistics aggregator: merges the per-interval snapshots that udp_toolkit_server
+// instances send with -R into fleet-level throughput, loss and latency percentiles, with a
+// per-host breakdown. Histograms are merged bucket by bucket, so fleet percentiles are exact
+// to the histogram resolution rather than averages of per-host percentiles.
+// See udp_toolkit_snapshot.h for the datagram format.
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "udp_toolkit_hist.h"
+#include "udp_toolkit_histlog.h"
+#include "udp_toolkit_snapshot.h"
+
+#define MAX_HOSTS               256
+#define DEFAULT_REPORT_INTERVAL 5.0         // Seconds
+#define RECV_BUFFER_SIZE        (4 * 1024 * 1024)
+
+struct aggregator_config {
+    struct in_addr addr;    // Listen address
+    int    port;
+    double interval;        // Seconds between fleet reports
+    double duration;        // Seconds to run, 0 = until Ctrl+C
+};
+
+// Counters and merged latency of a set of snapshots
+struct agg_stats {
+    uint64_t snapshots, packets, bytes, lost, outages, negative;
+    double   first_start, last_end;         // Wall-clock span of the snapshots
+    struct latency_hist lat;
+};
+
+struct host {
+    char     name[SNAPSHOT_HOST_LEN + 1];
+    uint32_t session;                       // Session of the last snapshot
+    struct agg_stats period, total;
+};
+
+struct aggregator {
+    struct host*     hosts;
+    int              nhosts;
+    struct agg_stats period, total;         // Whole fleet
+    struct latency_hist scratch;            // Histogram of the snapshot being merged
+    uint64_t         invalid;               // Datagrams that were not valid snapshots
+    uint64_t         dropped;               // Snapshots of hosts beyond MAX_HOSTS
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static double monotonic_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog_name) {
+    printf("Usage: %s [options]\n", prog_name);
+    printf("Merges the interval snapshots of udp_toolkit_server -R into fleet-level statistics.\n");
+    printf("Options:\n");
+    printf("  -a ip           Listen address (default: all)\n");
+    printf("  -p port         Listen port (default: %d)\n", STATS_PORT);
+    printf("  -i sec          Seconds between fleet reports (default: %.0f)\n", DEFAULT_REPORT_INTERVAL);
+    printf("  -t sec          Run for sec seconds, then print the totals (default: until Ctrl+C)\n");
+    printf("  -h              Display this help message\n");
+}
+
+static int agg_stats_init(struct agg_stats* s) {
+    memset(s, 0, sizeof(*s));
+    return hist_init(&s->lat, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS);
+}
+
+static void agg_stats_reset(struct agg_stats* s) {
+    struct latency_hist lat = s->lat;
+    memset(s, 0, sizeof(*s));
+    s->lat = lat;
+    hist_reset(&s->lat);
+}
+
+static void agg_stats_add(struct agg_stats* s, const struct stats_snapshot* snap, const struct latency_hist* lat) {
+    if (s->snapshots == 0 || snap->start < s->first_start) s->first_start = snap->start;
+    if (snap->end > s->last_end) s->last_end = snap->end;
+    s->snapshots++;
+    s->packets  += snap->packets;
+    s->bytes    += snap->bytes;
+    s->lost     += snap->lost;
+    s->outages  += snap->outages;
+    s->negative += snap->negative;
+    hist_add(&s->lat, lat);
+}
+
+// One report line: throughput over the span of the snapshots, loss and merged latency
+static void agg_stats_print(const char* label, const struct agg_stats* s) {
+    double span = s->last_end - s->first_start;
+    uint64_t expected = s->packets + s->lost;
+    printf("%-20s %5llu snapshots, %10llu packets, %10.3f Mbps, loss %.3f%%, outages %llu",
+           label, (unsigned long long)s->snapshots, (unsigned long long)s->packets,
+           span > 0 ? s->bytes * 8.0 / span / 1e6 : 0.0,
+           expected > 0 ? 100.0 * s->lost / expected : 0.0, (unsigned long long)s->outages);
+    if (s->negative > 0) printf(", negative latency %llu", (unsigned long long)s->negative);
+    printf("\n");
+    const struct latency_hist* h = &s->lat;
+    if (h->total_count > 0) {
+        printf("%-20s Latency: min %.3f ms, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+               "", h->min_value / 1e6, hist_mean(h) / 1e6, hist_value_at_percentile(h, 50.0) / 1e6,
+               hist_value_at_percentile(h, 99.0) / 1e6, hist_value_at_percentile(h, 99.9) / 1e6,
+               h->max_value / 1e6);
+    }
+}
+
+static struct host* find_host(struct aggregator* agg, const char* name) {
+    for (int i = 0; i < agg->nhosts; i++) {
+        if (strcmp(agg->hosts[i].name, name) == 0) return &agg->hosts[i];
+    }
+    if (agg->nhosts >= MAX_HOSTS) return NULL;
+    struct host* h = &agg->hosts[agg->nhosts];
+    memset(h, 0, sizeof(*h));
+    snprintf(h->name, sizeof(h->name), "%s", name);
+    if (agg_stats_init(&h->period) < 0 || agg_stats_init(&h->total) < 0) {
+        hist_free(&h->period.lat);
+        hist_free(&h->total.lat);
+        return NULL;
+    }
+    agg->nhosts++;
+    return h;
+}
+
+// Merge one datagram into the host and fleet statistics
+static void handle_snapshot(struct aggregator* agg, const unsigned char* buf, size_t len,
+                            const struct sockaddr_in* from) {
+    struct stats_snapshot snap;
+    hist_reset(&agg->scratch);
+    if (snapshot_decode(buf, len, &snap) < 0 ||
+        (snap.hist_len > 0 &&
+         hist_decode_compressed(buf + SNAPSHOT_HEADER_SIZE, snap.hist_len, &agg->scratch) < 0)) {
+        agg->invalid++;
+        return;
+    }
+
+    struct host* h = find_host(agg, snap.host);
+    if (!h) {
+        if (agg->dropped++ == 0) {
+            fprintf(stderr, "Warning: More than %d hosts, ignoring snapshots of new hosts\n", MAX_HOSTS);
+        }
+        return;
+    }
+    if (h->total.snapshots == 0 || snap.session != h->session) {
+        printf("Host %s (%s): session %u\n", h->name, inet_ntoa(from->sin_addr), snap.session);
+        h->session = snap.session;
+    }
+    agg_stats_add(&h->period, &snap, &agg->scratch);
+    agg_stats_add(&h->total, &snap, &agg->scratch);
+    agg_stats_add(&agg->period, &snap, &agg->scratch);
+    agg_stats_add(&agg->total, &snap, &agg->scratch);
+}
+
+static int active_hosts(const struct aggregator* agg, int period) {
+    int n = 0;
+    for (int i = 0; i < agg->nhosts; i++) {
+        n += (period ? agg->hosts[i].period.snapshots : agg->hosts[i].total.snapshots) > 0;
+    }
+    return n;
+}
+
+// Print the snapshots received since the last report, fleet first, then per host
+static void report_period(struct aggregator* agg) {
+    if (agg->period.snapshots == 0) return;
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime_r(&now, &tm));
+
+    char label[64];
+    snprintf(label, sizeof(label), "Fleet (%d hosts)", active_hosts(agg, 1));
+    printf("[%s] Interval statistics:\n", stamp);
+    agg_stats_print(label, &agg->period);
+    for (int i = 0; i < agg->nhosts; i++) {
+        struct host* h = &agg->hosts[i];
+        if (h->period.snapshots == 0) continue;
+        snprintf(label, sizeof(label), "  %s", h->name);
+        agg_stats_print(label, &h->period);
+        agg_stats_reset(&h->period);
+    }
+    agg_stats_reset(&agg->period);
+    fflush(stdout);
+}
+
+static void report_total(const struct aggregator* agg) {
+    char label[64];
+    printf("\nTotal statistics:\n");
+    if (agg->total.snapshots == 0) {
+        printf("No snapshots received\n");
+    } else {
+        snprintf(label, sizeof(label), "Fleet (%d hosts)", active_hosts(agg, 0));
+        agg_stats_print(label, &agg->total);
+        for (int i = 0; i < agg->nhosts; i++) {
+            snprintf(label, sizeof(label), "  %s", agg->hosts[i].name);
+            agg_stats_print(label, &agg->hosts[i].total);
+        }
+    }
+    if (agg->invalid > 0) {
+        printf("Ignored %llu invalid datagrams\n", (unsigned long long)agg->invalid);
+    }
+    if (agg->dropped > 0) {
+        printf("Ignored %llu snapshots of hosts beyond the first %d\n",
+               (unsigned long long)agg->dropped, MAX_HOSTS);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    struct aggregator_config cfg = {
+        .addr     = { .s_addr = INADDR_ANY },
+        .port     = STATS_PORT,
+        .interval = DEFAULT_REPORT_INTERVAL,
+        .duration = 0,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:i:t:h")) != -1) {
+        switch (opt) {
+            case 'a':
+                if (inet_pton(AF_INET, optarg, &cfg.addr) != 1) {
+                    fprintf(stderr, "Error: Invalid listen address '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                cfg.port = atoi(optarg);
+                if (cfg.port <= 0 || cfg.port > 65535) {
+                    fprintf(stderr, "Error: Invalid port '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'i':
+                cfg.interval = atof(optarg);
+                if (cfg.interval <= 0) {
+                    fprintf(stderr, "Error: Report interval must be positive\n");
+                    return 1;
+                }
+                break;
+            case 't':
+                cfg.duration = atof(optarg);
+                if (cfg.duration < 0) {
+                    fprintf(stderr, "Error: Duration must not be negative\n");
+                    return 1;
+                }
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    // --- 1. Listen socket ---
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return 1;
+    }
+    // Every server reports at the same second boundaries, so snapshots arrive in bursts
+    int rcvbuf = RECV_BUFFER_SIZE;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port   = htons((uint16_t)cfg.port),
+        .sin_addr   = cfg.addr,
+    };
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sock);
+        return 1;
+    }
+
+    // --- 2. Host table and fleet histograms ---
+    struct aggregator agg = { 0 };
+    static unsigned char buf[SNAPSHOT_MAX_SIZE];
+    agg.hosts = (struct host*)calloc(MAX_HOSTS, sizeof(struct host));
+    if (!agg.hosts || agg_stats_init(&agg.period) < 0 || agg_stats_init(&agg.total) < 0 ||
+        hist_init(&agg.scratch, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+        perror("Failed to allocate aggregator state");
+        close(sock);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Aggregating server snapshots on %s:%d, reporting every %.0f s\n",
+           inet_ntoa(cfg.addr), cfg.port, cfg.interval);
+    fflush(stdout);
+
+    // --- 3. Receive loop ---
+    double start = monotonic_sec();
+    double next_report = start + cfg.interval;
+    while (running) {
+        double now = monotonic_sec();
+        if (now >= next_report) {
+            report_period(&agg);
+            next_report += cfg.interval;
+            if (next_report <= now) next_report = now + cfg.interval;
+        }
+        double wake = next_report;
+        if (cfg.duration > 0) {
+            if (now >= start + cfg.duration) break;
+            if (start + cfg.duration < wake) wake = start + cfg.duration;
+        }
+
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        int rc = poll(&pfd, 1, (int)((wake - now) * 1000) + 1);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (rc == 0) continue;
+
+        for (;;) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr*)&from, &from_len);
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("recvfrom");
+                break;
+            }
+            handle_snapshot(&agg, buf, (size_t)n, &from);
+        }
+    }
+
+    // --- 4. Final report ---
+    report_period(&agg);
+    report_total(&agg);
+
+    for (int i = 0; i < agg.nhosts; i++) {
+        hist_free(&agg.hosts[i].period.lat);
+        hist_free(&agg.hosts[i].total.lat);
+    }
+    free(agg.hosts);
+    hist_free(&agg.period.lat);
+    hist_free(&agg.total.lat);
+    hist_free(&agg.scratch);
+    close(sock);
+    return 0;
+}
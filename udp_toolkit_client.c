@@ -1,4 +1,4 @@
-#define _POSIX_C_SOURCE 200112L  // 为了支持CLOCK_MONOTONIC
+#define _GNU_SOURCE  // CLOCK_MONOTONIC，以及SO_BINDTODEVICE、SO_TIMESTAMPING等Linux套接字选项
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,14 +12,87 @@
 #include <getopt.h>         // 添加getopt头文件以确保optarg被定义
 #include <errno.h>          // errno
 #include <fcntl.h>          // fcntl, O_NONBLOCK
+#include <sys/select.h>     // select
+#include <poll.h>           // poll
+#include <math.h>           // sqrt
+#include <net/if.h>         // IF_NAMESIZE
+#include <linux/errqueue.h> // sock_extended_err, scm_timestamping
+#include <linux/net_tstamp.h> // SOF_TIMESTAMPING_*
+
+#include "udp_toolkit_proto.h"
+#include "udp_toolkit_engine.h"
+#include "udp_toolkit_slo.h"
+#include "udp_toolkit_fec.h"
+#include "udp_toolkit_hist.h"
 
 #define DEFAULT_SERVER_IP "127.0.0.1"
-#define SYNC_PORT   4000
-#define DATA_PORT   5000
 #define DEFAULT_PACKET_SIZE 1000      // bytes
 #define DEFAULT_BANDWIDTH   1000000   // bps (1 Mbps)
 #define DEFAULT_DURATION    10        // seconds
-#define HEADER_SIZE         20        // Seq(4) + send_ts(8) + offset(8) + packet_size(4)
+#define DEFAULT_RR_WINDOW   1         // 闭环模式下的在途请求数
+#define DEFAULT_RR_TIMEOUT_MS 1000    // 请求超时（毫秒）
+#define DEFAULT_SYNC_CLIENTS  100     // 同步负载模式下模拟的代理数
+#define DEFAULT_SYNC_RATE     1000    // 同步负载模式下的总请求速率（req/s）
+#define ECHO_FILTER_GROUP     8       // 带内同步：每组回显样本中取往返延迟最小的一个
+#define DEFAULT_ENGINE        "socket" // 数据通道I/O引擎
+#define RR_RX_BATCH           16      // 闭环模式：每次从引擎读取的响应数
+#define SIZE_SWEEP_STEPS      16      // 包大小扫描：在最小和最大包大小之间均匀取的大小个数
+#define SIZE_SWEEP_STRIDE     7       // 与SIZE_SWEEP_STEPS互质，相邻包的大小交错而不是单调递增
+#define BLAST_BATCH           32      // 饱和模式：每次交给引擎发送的包数（<= IO_ENGINE_MAX_BATCH）
+#define TX_TS_RING            4096    // 发送时间戳：等待内核时间戳的包记录数（2的幂）
+#define TX_TS_DRAIN_EVERY     32      // 发送时间戳：每发送这么多个包读取一次错误队列
+#define TX_TS_FINISH_WAIT     0.1     // 发送时间戳：结束时等待剩余时间戳的最长时间（秒）
+
+// 测试模式
+enum client_mode {
+    MODE_CBR,   // 开环恒定比特率发送（默认）
+    MODE_RR,    // 闭环请求/响应
+    MODE_SYNC,  // 时钟同步负载生成
+    MODE_BLAST, // 不限速饱和发送
+};
+
+// 双路径冗余发送中的一条路径（-D）
+struct send_path {
+    char src_ip[16];            // 绑定的源地址，空表示由路由决定
+    char ifname[IF_NAMESIZE];   // 绑定的网卡（SO_BINDTODEVICE），空表示不绑定
+    char dst_ip[16];            // 目的地址，空表示-i指定的服务器地址
+};
+
+// 客户端配置
+struct client_config {
+    enum client_mode mode;
+    long   bandwidth;       // bps
+    int    duration;        // 秒
+    int    packet_size;     // 字节
+    char   server_ip[16];
+    int    rr_window;       // 闭环模式：最大在途请求数
+    double rr_rate;         // 闭环模式：固定请求速率（req/s），0表示按窗口发送
+    int    rr_timeout_ms;   // 闭环模式：请求超时
+    int    sync_clients;    // 同步负载模式：模拟的代理（socket）数量
+    int    echo_every;      // 带内同步：每N个数据包请求一次时间戳回显，0表示关闭
+    int    min_packet_size; // 包大小扫描：最小包大小，0表示固定使用packet_size
+    const char* engine;     // 数据通道I/O引擎（udp_toolkit_engine.h）
+    struct slo_set slos;    // 运行结束时评估的SLO
+    int    npaths;          // 双路径冗余发送：0表示关闭，否则为2
+    struct send_path paths[2];
+    int    fec_k;           // FEC：每fec_k个数据包之后插入一个XOR校验包，0表示关闭
+    int    tx_timing;       // 发送路径计时：发送调用耗时和内核发送时间戳
+};
+
+// 带内时钟同步估计器：对回显样本做最小延迟滤波，
+// 再对滤波后的点做增量最小二乘拟合 offset(t) = a + b * (t - t0)，b即时钟漂移
+struct inband_sync {
+    uint64_t samples;       // 收到的回显样本数
+    int      group_count;   // 当前组内样本数
+    double   best_delay;    // 当前组内最小往返延迟
+    double   best_t;        // 该样本的发送时间t1
+    double   best_offset;   // 该样本的offset
+    double   min_delay;     // 全程最小往返延迟
+    double   t0;            // 拟合的时间原点（第一个滤波点）
+    double   n, st, so, stt, sto;  // 最小二乘累加量
+    double   a, b;          // 当前拟合结果
+    int      valid;         // 是否已有估计
+};
 
 // 获取单调时钟的浮点秒
 static double monotonic_sec() {
@@ -45,17 +118,17 @@ double sync_clock_ntp(int sock, const char* server_ip) {
 
     // 准备NTP样式时间同步消息
     double t1, t2, t3, t4;
-    char buffer[sizeof(double) * 3];  // 存储t1,t2,t3
+    struct sync_msg msg;  // 存储t1,t2,t3
     ssize_t bytes_sent, bytes_received;
     
     // 记录发送时间t1
     t1 = monotonic_sec();
     
     // 准备发送的消息
-    memcpy(buffer, &t1, sizeof(t1));
+    msg.t1 = t1;
     
     // 发送t1到服务器
-    bytes_sent = sendto(sock, buffer, sizeof(double), 0, 
+    bytes_sent = sendto(sock, &msg, sizeof(msg.t1), 0, 
                  (struct sockaddr*)&server_addr, server_addr_len);
     if (bytes_sent < 0) {
         perror("Error sending sync request");
@@ -63,7 +136,7 @@ double sync_clock_ntp(int sock, const char* server_ip) {
     }
     
     // 等待服务器回复(t2,t3)
-    bytes_received = recvfrom(sock, buffer, sizeof(buffer), 0,
+    bytes_received = recvfrom(sock, &msg, sizeof(msg), 0,
                     (struct sockaddr*)&server_addr, &server_addr_len);
     if (bytes_received < 0) {
         perror("Error receiving sync response");
@@ -73,12 +146,18 @@ double sync_clock_ntp(int sock, const char* server_ip) {
     // 记录接收时间t4
     t4 = monotonic_sec();
     
-    // 从回复中提取t2
-    memcpy(&t2, buffer, sizeof(t2));
-    t3 = t2;  // 在简化的服务器中，t3≈t2
+    if (bytes_received < (ssize_t)sizeof(msg)) {
+        fprintf(stderr, "Error: Short sync response (%zd bytes)\n", bytes_received);
+        return 0.0;
+    }
+    
+    // 从回复中提取t2、t3（回复的第一个字段是回显的t1）
+    t2 = msg.t2;
+    t3 = msg.t3;
     
     // 计算往返延迟
     double delay = (t4 - t1) - (t3 - t2);
+    printf("Clock sync round-trip delay: %.6f ms\n", delay * 1e3);
     
     // 计算时钟偏移
     double offset = ((t2 - t1) + (t3 - t4)) / 2.0;
@@ -100,9 +179,46 @@ void print_usage(const char* prog_name) {
     printf("  -b bandwidth    Specify sending bandwidth in bps (default: %d)\n", DEFAULT_BANDWIDTH);
     printf("  -t time         Specify test duration in seconds (default: %d)\n", DEFAULT_DURATION);
     printf("  -s size         Specify packet size in bytes (default: %d)\n", DEFAULT_PACKET_SIZE);
+    printf("  -m mode         Test mode: cbr (open-loop constant bit rate), rr (request/response),\n");
+    printf("                  sync (clock sync load generator) or blast (unpaced, as fast as the\n");
+    printf("                  engine allows, -b is ignored) (default: cbr)\n");
+    printf("  -w window       rr mode: number of outstanding requests (default: %d)\n", DEFAULT_RR_WINDOW);
+    printf("  -R rate         rr mode: send requests at a fixed rate in req/s instead of a window\n");
+    printf("                  sync mode: total sync request rate in req/s (default: %d)\n", DEFAULT_SYNC_RATE);
+    printf("  -T timeout_ms   rr mode: request timeout in milliseconds (default: %d)\n", DEFAULT_RR_TIMEOUT_MS);
+    printf("  -n clients      sync mode: number of simulated agents, one socket each (default: %d)\n", DEFAULT_SYNC_CLIENTS);
+    printf("  -E n            cbr mode: request a timestamp echo every n data packets and estimate\n");
+    printf("                  offset and drift in-band instead of syncing on port %d\n", SYNC_PORT);
+    printf("  -z min_size     cbr mode: vary the packet size between min_size and -s size so the server\n");
+    printf("                  can fit latency against size (fixed delay and bottleneck bandwidth)\n");
+    printf("  -e, --engine name  Data path I/O engine (default: %s):\n", DEFAULT_ENGINE);
+    io_engine_list(stdout, "                    ");
+    printf("  -D, --dual-path A,B  cbr mode: send every packet twice, over path A and path B, each\n");
+    printf("                  \"[src_ip][%%ifname][@dst_ip]\": bind to a source address and/or interface\n");
+    printf("                  and optionally send to another server address; the server reports which\n");
+    printf("                  copy arrived first, per-path latency and the first-copy-wins stream\n");
+    printf("  -F, --fec K     cbr mode: send an XOR parity packet after every K data packets (K <= %d);\n", FEC_MAX_K);
+    printf("                  the server rebuilds one lost packet per block and reports the residual loss\n");
+    printf("  -k, --tx-timing cbr mode: time every send call and read SO_TIMESTAMPING SCHED (qdisc) and\n");
+    printf("                  SOFTWARE (driver) transmit timestamps from the error queue; reports the\n");
+    printf("                  send call, user->qdisc, qdisc->driver and user->driver delay distributions\n");
+    printf("  -S, --slo expr  Evaluate SLOs at the end of the run, e.g. \"p99<500us,tps>10000\" (repeatable).\n");
+    printf("                  rr mode: loss (timeouts), min, mean, max, pNN (round trip), tps;\n");
+    printf("                  cbr and blast modes: throughput, pps (as sent). Exit code %d if any SLO\n", SLO_EXIT_FAIL);
+    printf("                  failed, %d if one could not be measured\n", SLO_EXIT_NO_DATA);
     printf("  -h              Display this help message\n");
     printf("Example:\n");
     printf("  %s -i 192.168.1.100 -b 5000000 -t 30 -s 500    Test with 5Mbps bandwidth for 30 seconds using 500-byte packets\n", prog_name);
+    printf("  %s -m rr -w 8 -s 64                             Keep 8 requests of 64 bytes outstanding\n", prog_name);
+    printf("  %s -m sync -n 1000 -R 20000                     Simulate 1000 agents syncing at 20000 req/s\n", prog_name);
+    printf("  %s -m blast -e mmsg -s 64 -t 10                 Send 64-byte packets as fast as possible for 10 seconds\n", prog_name);
+    printf("  %s -D %%eth0,%%eth1 -b 10000000                    Send a 10Mbps stream over both eth0 and eth1\n", prog_name);
+}
+
+// 包大小扫描：第seq个包的大小，在[min_size, max_size]的SIZE_SWEEP_STEPS个等距大小间交错取值
+static int sweep_packet_size(int seq, int min_size, int max_size) {
+    int step = (int)(((long long)seq * SIZE_SWEEP_STRIDE) % SIZE_SWEEP_STEPS);
+    return min_size + (int)((long long)(max_size - min_size) * step / (SIZE_SWEEP_STEPS - 1));
 }
 
 // 动态计算发送间隔（秒）
@@ -111,46 +227,1122 @@ double calculate_interval(int packet_size, long bandwidth) {
     return (packet_size * 8.0) / bandwidth;
 }
 
+// 闭环模式下单个在途请求的状态
+struct rr_slot {
+    int    seq;
+    double send_ts;
+    int    active;
+};
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// 已排序数组的百分位数（最近秩法）
+static double percentile_sorted(const double* v, size_t n, double p) {
+    if (n == 0) return 0.0;
+    size_t rank = (size_t)(p / 100.0 * n + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return v[rank - 1];
+}
+
+// 发送会话控制标记（仅包头）。结束标记的seq携带已发送的数据包数，发送多次以防丢失
+static void send_session_marker(struct io_engine* eng, const struct sockaddr_in* server_addr,
+                                uint32_t flags, int count, double offset) {
+    char buf[HEADER_SIZE];
+    struct pkt_header hdr = {
+        .seq = count, .send_ts = monotonic_sec(), .offset = offset,
+        .packet_size = HEADER_SIZE, .flags = flags
+    };
+    pkt_header_encode(buf, &hdr);
+    struct io_pkt p = { .buf = buf, .len = sizeof(buf), .addr = (struct sockaddr_in*)server_addr };
+    struct io_pkt copies[3] = { p, p, p };
+    io_send_batch(eng, copies, (flags & PKT_FLAG_SESSION_END) ? 3 : 1);
+}
+
+// 已排序样本的百分位数，供SLO评估使用
+struct sorted_samples {
+    const double* v;
+    size_t        n;
+};
+
+static double sorted_samples_percentile(const void* ctx, double p) {
+    const struct sorted_samples* s = (const struct sorted_samples*)ctx;
+    return percentile_sorted(s->v, s->n, p);
+}
+
+// 发送一个闭环请求
+static int rr_send_request(struct io_engine* eng, const struct sockaddr_in* server_addr, char* buf,
+                           int packet_size, int seq, double offset, double* send_ts) {
+    struct pkt_header hdr = {
+        .seq = seq, .send_ts = monotonic_sec(), .offset = offset,
+        .packet_size = packet_size, .flags = PKT_FLAG_REQUEST
+    };
+    pkt_header_encode(buf, &hdr);
+    struct io_pkt p = { .buf = buf, .len = packet_size, .addr = (struct sockaddr_in*)server_addr };
+    if (io_send_batch(eng, &p, 1) < 1) return -1;
+    *send_ts = hdr.send_ts;
+    return 0;
+}
+
+// 闭环请求/响应测试：维持固定数量的在途请求（或固定请求速率+超时），统计每个请求的往返延迟
+static int run_rr_test(struct io_engine* eng, const struct sockaddr_in* server_addr,
+                       const struct client_config* cfg, double offset) {
+    double timeout = cfg->rr_timeout_ms / 1000.0;
+
+    // 在途请求环形表，容量为2的幂，覆盖最大在途数量
+    size_t max_outstanding = cfg->rr_rate > 0 ? (size_t)(cfg->rr_rate * timeout) + 1
+                                              : (size_t)cfg->rr_window;
+    size_t ring_size = 1;
+    while (ring_size < max_outstanding) ring_size <<= 1;
+    size_t ring_mask = ring_size - 1;
+
+    struct rr_slot* slots = calloc(ring_size, sizeof(*slots));
+    char* tx_buffer = malloc(cfg->packet_size);
+    char* rx_buffer = malloc((size_t)RR_RX_BATCH * MAX_PACKET_SIZE);
+    size_t lat_cap = 1 << 16, lat_count = 0;
+    double* latencies = malloc(lat_cap * sizeof(double));
+    if (!slots || !tx_buffer || !rx_buffer || !latencies) {
+        perror("Error allocating request/response buffers");
+        free(slots); free(tx_buffer); free(rx_buffer); free(latencies);
+        return 1;
+    }
+    memset(tx_buffer, 0, cfg->packet_size);
+    struct io_pkt rx_pkts[RR_RX_BATCH];
+    for (int i = 0; i < RR_RX_BATCH; i++) {
+        rx_pkts[i] = (struct io_pkt){ .buf = rx_buffer + (size_t)i * MAX_PACKET_SIZE, .cap = MAX_PACKET_SIZE };
+    }
+
+    uint64_t sent = 0, received = 0, timeouts = 0, late = 0, skipped = 0;
+    size_t outstanding = 0;
+    int next_seq = 0, oldest_seq = 0;
+    double start_time = monotonic_sec();
+    double end_time = start_time + cfg->duration;
+    double next_send_time = start_time;
+    double last_report = start_time;
+
+    if (cfg->rr_rate > 0) {
+        printf("Starting request/response test: %.0f req/s, timeout %d ms, request size %d bytes\n",
+               cfg->rr_rate, cfg->rr_timeout_ms, cfg->packet_size);
+    } else {
+        printf("Starting request/response test: window %d, timeout %d ms, request size %d bytes\n",
+               cfg->rr_window, cfg->rr_timeout_ms, cfg->packet_size);
+    }
+
+    while (1) {
+        double now = monotonic_sec();
+        int sending = now < end_time;
+
+        // 测试结束后只等待剩余的在途请求
+        if (!sending && (outstanding == 0 || now >= end_time + timeout)) break;
+
+        // 1. 回收超时请求（按序号顺序发送，最老的请求最先超时）
+        while (oldest_seq < next_seq) {
+            struct rr_slot* slot = &slots[oldest_seq & ring_mask];
+            if (slot->active) {
+                if (now - slot->send_ts < timeout) break;
+                slot->active = 0;
+                outstanding--;
+                timeouts++;
+            }
+            oldest_seq++;
+        }
+
+        // 2. 发送新请求
+        if (sending) {
+            if (cfg->rr_rate > 0) {
+                while (now >= next_send_time) {
+                    if (outstanding < ring_size && (size_t)(next_seq - oldest_seq) < ring_size) {
+                        struct rr_slot* slot = &slots[next_seq & ring_mask];
+                        if (rr_send_request(eng, server_addr, tx_buffer, cfg->packet_size,
+                                            next_seq, offset, &slot->send_ts) < 0) {
+                            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Error sending request");
+                            break;
+                        }
+                        slot->seq = next_seq++;
+                        slot->active = 1;
+                        outstanding++;
+                        sent++;
+                    } else {
+                        skipped++;  // 在途表已满，放弃这个发送时刻
+                    }
+                    next_send_time = start_time + (sent + skipped) / cfg->rr_rate;
+                }
+            } else {
+                while (outstanding < (size_t)cfg->rr_window &&
+                       (size_t)(next_seq - oldest_seq) < ring_size) {
+                    struct rr_slot* slot = &slots[next_seq & ring_mask];
+                    if (rr_send_request(eng, server_addr, tx_buffer, cfg->packet_size,
+                                        next_seq, offset, &slot->send_ts) < 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Error sending request");
+                        break;
+                    }
+                    slot->seq = next_seq++;
+                    slot->active = 1;
+                    outstanding++;
+                    sent++;
+                }
+            }
+        }
+
+        // 3. 等待响应，直到下一个发送时刻、最早的超时或测试结束
+        double deadline = sending ? end_time : end_time + timeout;
+        if (oldest_seq < next_seq) {
+            double expire = slots[oldest_seq & ring_mask].send_ts + timeout;
+            if (expire < deadline) deadline = expire;
+        }
+        if (sending && cfg->rr_rate > 0 && next_send_time < deadline) deadline = next_send_time;
+        double wait = deadline - monotonic_sec();
+        if (wait < 0) wait = 0;
+
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(eng->sock, &readfds);
+        struct timeval tv = {
+            .tv_sec  = (time_t)wait,
+            .tv_usec = (suseconds_t)((wait - (time_t)wait) * 1e6)
+        };
+        if (select(eng->sock + 1, &readfds, NULL, NULL, &tv) < 0) {
+            if (errno == EINTR) continue;
+            perror("select");
+            break;
+        }
+
+        // 4. 读空socket中的所有响应（接收时间优先使用内核时间戳）
+        int nrx = 0;
+        while (FD_ISSET(eng->sock, &readfds) && (nrx = io_recv_batch(eng, rx_pkts, RR_RX_BATCH)) > 0) {
+            double poll_ts = monotonic_sec();
+            for (int k = 0; k < nrx; k++) {
+                double recv_ts = rx_pkts[k].rx_ts > 0 ? rx_pkts[k].rx_ts : poll_ts;
+                if (rx_pkts[k].len < HEADER_SIZE) continue;
+
+                struct pkt_header hdr;
+                pkt_header_decode(rx_pkts[k].buf, &hdr);
+                if (!(hdr.flags & PKT_FLAG_RESPONSE)) continue;
+
+                struct rr_slot* slot = &slots[hdr.seq & ring_mask];
+                if (hdr.seq < oldest_seq || hdr.seq >= next_seq || !slot->active || slot->seq != hdr.seq) {
+                    late++;  // 已超时或重复的响应
+                    continue;
+                }
+                slot->active = 0;
+                outstanding--;
+                received++;
+
+                if (lat_count == lat_cap) {
+                    double* grown = realloc(latencies, lat_cap * 2 * sizeof(double));
+                    if (!grown) continue;
+                    latencies = grown;
+                    lat_cap *= 2;
+                }
+                latencies[lat_count++] = recv_ts - slot->send_ts;
+            }
+        }
+
+        // 每秒输出一次状态
+        now = monotonic_sec();
+        if (sending && now - last_report >= 1.0) {
+            printf("Sent %llu requests, received %llu responses, %zu outstanding, %llu timeouts, remaining time %.1f seconds\n",
+                   (unsigned long long)sent, (unsigned long long)received, outstanding,
+                   (unsigned long long)timeouts, end_time - now);
+            last_report = now;
+        }
+    }
+
+    // 剩余未响应的请求计为超时
+    timeouts += outstanding;
+    send_session_marker(eng, server_addr, PKT_FLAG_SESSION_END, (int)sent, offset);
+
+    double elapsed = monotonic_sec() - start_time;
+    qsort(latencies, lat_count, sizeof(double), compare_double);
+    double sum = 0.0;
+    for (size_t i = 0; i < lat_count; i++) sum += latencies[i];
+
+    printf("\nRequest/Response Summary:\n");
+    printf("Requests sent: %llu, responses: %llu, timeouts: %llu, late responses: %llu",
+           (unsigned long long)sent, (unsigned long long)received,
+           (unsigned long long)timeouts, (unsigned long long)late);
+    if (skipped) printf(", skipped sends: %llu", (unsigned long long)skipped);
+    printf("\n");
+    printf("Achieved rate: %.1f transactions/s over %.3f seconds\n", received / elapsed, elapsed);
+    if (lat_count > 0) {
+        printf("Round-trip latency (ms): min=%.3f mean=%.3f p50=%.3f p90=%.3f p99=%.3f p99.9=%.3f max=%.3f\n",
+               latencies[0] * 1e3, sum / lat_count * 1e3,
+               percentile_sorted(latencies, lat_count, 50.0) * 1e3,
+               percentile_sorted(latencies, lat_count, 90.0) * 1e3,
+               percentile_sorted(latencies, lat_count, 99.0) * 1e3,
+               percentile_sorted(latencies, lat_count, 99.9) * 1e3,
+               latencies[lat_count - 1] * 1e3);
+    }
+
+    // SLO评估：丢失率为超时请求的比例，延迟为往返延迟
+    int rc = 0;
+    if (cfg->slos.count > 0) {
+        struct slo_measure m;
+        struct sorted_samples samples = { latencies, lat_count };
+        slo_measure_init(&m);
+        if (sent > 0) m.loss = 100.0 * timeouts / sent;
+        if (elapsed > 0) m.tps = received / elapsed;
+        if (lat_count > 0) {
+            m.lat_min        = latencies[0];
+            m.lat_mean       = sum / lat_count;
+            m.lat_max        = latencies[lat_count - 1];
+            m.lat_percentile = sorted_samples_percentile;
+            m.lat_ctx        = &samples;
+        }
+        rc = slo_evaluate(&cfg->slos, &m, stdout);
+    }
+
+    free(slots);
+    free(tx_buffer);
+    free(rx_buffer);
+    free(latencies);
+    return rc;
+}
+
+// 解析一条路径"[src_ip][%ifname][@dst_ip]"（spec的前len个字节）
+static int parse_send_path(const char* spec, size_t len, struct send_path* p) {
+    char buf[64];
+    memset(p, 0, sizeof(*p));
+    if (len >= sizeof(buf)) return -1;
+    memcpy(buf, spec, len);
+    buf[len] = '\0';
+
+    char* dst = strchr(buf, '@');
+    if (dst) {
+        *dst++ = '\0';
+        if (!validate_ipv4(dst)) return -1;
+        strcpy(p->dst_ip, dst);
+    }
+    char* ifname = strchr(buf, '%');
+    if (ifname) {
+        *ifname++ = '\0';
+        if (ifname[0] == '\0' || strlen(ifname) >= sizeof(p->ifname)) return -1;
+        strcpy(p->ifname, ifname);
+    }
+    if (buf[0] != '\0') {
+        if (!validate_ipv4(buf)) return -1;
+        strcpy(p->src_ip, buf);
+    }
+    return 0;
+}
+
+// 把数据socket绑定到路径的源地址和网卡上
+static int bind_send_path(int sock, const struct send_path* p) {
+    if (p->ifname[0] != '\0' &&
+        setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, p->ifname, (socklen_t)strlen(p->ifname) + 1) < 0) {
+        fprintf(stderr, "Error binding to interface %s: %s\n", p->ifname, strerror(errno));
+        return -1;
+    }
+    if (p->src_ip[0] != '\0') {
+        struct sockaddr_in src = { .sin_family = AF_INET, .sin_port = 0 };
+        inet_pton(AF_INET, p->src_ip, &src.sin_addr);
+        if (bind(sock, (struct sockaddr*)&src, sizeof(src)) < 0) {
+            fprintf(stderr, "Error binding to %s: %s\n", p->src_ip, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 双路径冗余发送时一条路径的发送状态
+struct path_tx {
+    struct io_engine*  eng;
+    struct sockaddr_in dst;
+    uint32_t           flag;        // PKT_FLAG_PATH_A或PKT_FLAG_PATH_B
+    uint64_t           sent;
+    uint64_t           bytes;
+    uint64_t           dropped;     // 本地发送失败（发送缓冲区满、路由不可达等）的副本
+};
+
+// 把同一个包（相同的seq和send_ts）经两条路径各发一份。偶数包先走路径A、奇数包先走路径B，
+// 两条路径平均分担先发的优势。某一份发送失败只计入该路径的丢弃数，不重试，以免推迟另一份。
+// 时间戳回显只在路径A的副本上请求，回显由路径A的socket接收。
+static void dual_path_send(struct path_tx* paths, char* buf, const struct pkt_header* hdr, int len) {
+    for (int k = 0; k < 2; k++) {
+        struct path_tx* p = &paths[(hdr->seq + k) & 1];
+        uint32_t flags = hdr->flags | p->flag;
+        if (p->flag != PKT_FLAG_PATH_A) flags &= ~(uint32_t)PKT_FLAG_ECHO_REQ;
+        memcpy(buf + HDR_OFF_FLAGS, &flags, sizeof(flags));
+
+        struct io_pkt pkt = { .buf = buf, .len = len, .addr = &p->dst };
+        if (io_send_batch(p->eng, &pkt, 1) < 1) {
+            if (p->dropped++ == 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "Warning: Sending on path %c failed: %s\n",
+                        p->flag == PKT_FLAG_PATH_A ? 'A' : 'B', strerror(errno));
+            }
+        } else {
+            p->sent++;
+            p->bytes += (uint64_t)len;
+        }
+    }
+}
+
+// 丢弃socket错误队列中的ICMP错误（开启IP_RECVERR后由内核排入）
+static void drain_error_queue(int sock) {
+    char data[256], ctrl[512];
+    for (;;) {
+        struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+        struct msghdr msg = {
+            .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl)
+        };
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+    }
+}
+
+// 饱和（blast）模式：不做节拍控制，在测试时长内以引擎允许的最快速度批量发送。
+// 每个包只读一次时钟（即发送时间戳），秒边界和结束时间都用这个时间戳判断。
+// 内核拒绝的包会重试，因此序列号连续，服务器看到的丢包就是路径丢包；本地拒绝单独计数，
+// blocked和dropped按包计，每个包只按第一次被拒绝的原因计一次（重试不重复计数）：
+//   blocked  - 发送缓冲区满（EAGAIN），等待可写后重试
+//   dropped  - 本地队列丢弃（ENOBUFS，需要IP_RECVERR才会报告，否则内核静默丢弃）
+//   errors   - 之前的包引起的ICMP错误（端口不可达等），按次数计
+static int run_blast_test(struct io_engine* eng, const struct sockaddr_in* server_addr,
+                          const struct client_config* cfg, double offset) {
+    // 让本地队列丢包以ENOBUFS报告，而不是计入SndbufErrors后静默丢弃
+    int enable = 1;
+    if (setsockopt(eng->sock, IPPROTO_IP, IP_RECVERR, &enable, sizeof(enable)) < 0) {
+        perror("Warning: setsockopt IP_RECVERR, local queue drops will not be counted");
+    }
+
+    char* buffers = calloc(BLAST_BATCH, cfg->packet_size);
+    if (!buffers) {
+        perror("Error allocating packet buffers");
+        return 1;
+    }
+    struct io_pkt pkts[BLAST_BATCH];
+    for (int i = 0; i < BLAST_BATCH; i++) {
+        pkts[i].buf  = buffers + (size_t)i * cfg->packet_size;
+        pkts[i].len  = cfg->packet_size;
+        pkts[i].addr = (struct sockaddr_in*)server_addr;
+    }
+
+    uint64_t sent = 0, blocked = 0, dropped = 0, errors = 0;
+    uint64_t sent_interval = 0, blocked_interval = 0, dropped_interval = 0, errors_interval = 0;
+    double start_time  = monotonic_sec();
+    double end_time    = start_time + cfg->duration;
+    double last_report = start_time;
+    double now         = start_time;
+    int    failed      = 0;
+
+    printf("Blasting %d-byte packets to %s for %d seconds, press Ctrl+C to terminate...\n",
+           cfg->packet_size, cfg->server_ip, cfg->duration);
+
+    while (now < end_time && !failed) {
+        // 构造一批包，序列号只分配给最终被内核接受的包
+        for (int i = 0; i < BLAST_BATCH; i++) {
+            now = monotonic_sec();
+            struct pkt_header hdr = {
+                .seq = (int32_t)(sent + (uint64_t)i), .send_ts = now, .offset = offset,
+                .packet_size = cfg->packet_size, .flags = 0
+            };
+            pkt_header_encode(pkts[i].buf, &hdr);
+        }
+
+        // 引擎在第一个失败的包处停止，失败时未发出的就是pkts[done]；counted之前的包已计过数
+        int done = 0, counted = 0;
+        while (done < BLAST_BATCH) {
+            int r = io_send_batch(eng, pkts + done, BLAST_BATCH - done);
+            if (r > 0) {
+                done += r;
+                continue;
+            }
+            int first = done >= counted;
+            if (first) counted = done + 1;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                blocked_interval += (uint64_t)first;
+                fd_set wfds;
+                FD_ZERO(&wfds);
+                FD_SET(eng->sock, &wfds);
+                struct timeval tv = { .tv_sec = 0, .tv_usec = 10000 };
+                select(eng->sock + 1, NULL, &wfds, NULL, &tv);
+            } else if (errno == ENOBUFS) {
+                dropped_interval += (uint64_t)first;
+            } else if (errno == ECONNREFUSED || errno == EHOSTUNREACH || errno == ENETUNREACH ||
+                       errno == EHOSTDOWN || errno == ENETDOWN) {
+                errors_interval++;
+                drain_error_queue(eng->sock);
+            } else {
+                perror("Error sending packet");
+                failed = 1;
+                break;
+            }
+
+            // 重试的包重新打时间戳，等待时间不计入单向延迟
+            now = monotonic_sec();
+            for (int i = done; i < BLAST_BATCH; i++) {
+                memcpy(pkts[i].buf + HDR_OFF_SEND_TS, &now, sizeof(now));
+            }
+        }
+        sent_interval += (uint64_t)done;
+        sent          += (uint64_t)done;
+
+        // 每秒输出一次实际达到的速率
+        if (now - last_report >= 1.0 || now >= end_time || failed) {
+            double interval = now - last_report;
+            printf("[%.0f-%.0f s] Sent %llu packets: %.0f pps, %.3f Mbps, blocked %llu, dropped %llu, errors %llu\n",
+                   last_report - start_time, now - start_time, (unsigned long long)sent_interval,
+                   sent_interval / interval, sent_interval * cfg->packet_size * 8.0 / interval / 1e6,
+                   (unsigned long long)blocked_interval, (unsigned long long)dropped_interval,
+                   (unsigned long long)errors_interval);
+            blocked += blocked_interval;
+            dropped += dropped_interval;
+            errors  += errors_interval;
+            sent_interval = blocked_interval = dropped_interval = errors_interval = 0;
+            last_report = now;
+        }
+    }
+
+    send_session_marker(eng, server_addr, PKT_FLAG_SESSION_END, (int)sent, offset);
+
+    double elapsed = now - start_time;
+    printf("\nBlast Summary:\n");
+    printf("Packets sent: %llu, Bytes: %llu in %.3f seconds\n", (unsigned long long)sent,
+           (unsigned long long)(sent * (uint64_t)cfg->packet_size), elapsed);
+    printf("Achieved rate: %.0f pps, %.3f Mbps (engine %s)\n", sent / elapsed,
+           sent * cfg->packet_size * 8.0 / elapsed / 1e6, eng->ops->name);
+    printf("Local rejections (retried): send buffer full %llu packets, queue drops %llu packets, ICMP errors %llu\n",
+           (unsigned long long)blocked, (unsigned long long)dropped, (unsigned long long)errors);
+
+    free(buffers);
+    if (failed) return 1;
+
+    // SLO评估：发送端只知道达到的速率
+    if (cfg->slos.count > 0) {
+        struct slo_measure m;
+        slo_measure_init(&m);
+        if (elapsed > 0) {
+            m.throughput = sent * cfg->packet_size * 8.0 / elapsed;
+            m.pps        = sent / elapsed;
+        }
+        return slo_evaluate(&cfg->slos, &m, stdout);
+    }
+    return 0;
+}
+
+// 向样本数组追加一个值，按需扩容
+static void append_sample(double** v, size_t* count, size_t* cap, double x) {
+    if (*count == *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 4096;
+        double* grown = realloc(*v, new_cap * sizeof(double));
+        if (!grown) return;
+        *v = grown;
+        *cap = new_cap;
+    }
+    (*v)[(*count)++] = x;
+}
+
+// 时钟同步负载生成：用多个socket模拟一批同时同步的代理，
+// 统计同步服务的往返延迟以及排队对offset估计造成的离散程度
+static int run_sync_load(const struct client_config* cfg) {
+    double rate = cfg->rr_rate > 0 ? cfg->rr_rate : DEFAULT_SYNC_RATE;
+    int nclients = cfg->sync_clients;
+
+    struct sockaddr_in sync_addr;
+    memset(&sync_addr, 0, sizeof(sync_addr));
+    sync_addr.sin_family = AF_INET;
+    sync_addr.sin_port = htons(SYNC_PORT);
+    inet_pton(AF_INET, cfg->server_ip, &sync_addr.sin_addr);
+
+    struct pollfd* pfds = calloc(nclients, sizeof(*pfds));
+    if (!pfds) {
+        perror("Error allocating sync sockets");
+        return 1;
+    }
+    int opened = 0;
+    for (; opened < nclients; opened++) {
+        int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (fd < 0) {
+            perror("Error creating sync socket");
+            break;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        pfds[opened].fd = fd;
+        pfds[opened].events = POLLIN;
+    }
+    if (opened == 0) {
+        free(pfds);
+        return 1;
+    }
+    if (opened < nclients) {
+        printf("Warning: only %d of %d sync sockets could be created\n", opened, nclients);
+    }
+
+    double *rtts = NULL, *offsets = NULL;
+    size_t rtt_count = 0, rtt_cap = 0, off_count = 0, off_cap = 0;
+    uint64_t sent = 0, received = 0, send_errors = 0;
+    double start_time = monotonic_sec();
+    double end_time = start_time + cfg->duration;
+    double drain_end = end_time + 1.0;  // 结束后再等待1秒收取剩余回复
+    double next_send_time = start_time;
+    double last_report = start_time;
+    double last_rx = start_time;
+
+    printf("Starting sync load: %d agents, %.0f req/s total, %d seconds\n", opened, rate, cfg->duration);
+
+    while (1) {
+        double now = monotonic_sec();
+        if (now >= drain_end || (now >= end_time && received + send_errors >= sent)) break;
+
+        // 1. 按固定速率轮流从各个代理发送同步请求
+        while (now < end_time && now >= next_send_time) {
+            struct sync_msg msg = { .t1 = monotonic_sec() };
+            if (sendto(pfds[sent % opened].fd, &msg, sizeof(msg.t1), 0,
+                       (struct sockaddr*)&sync_addr, sizeof(sync_addr)) < 0) {
+                send_errors++;
+            }
+            sent++;
+            next_send_time = start_time + sent / rate;
+        }
+
+        // 2. 等待回复；发送间隔小于1ms时轮询
+        double wait = (now < end_time ? next_send_time : drain_end) - monotonic_sec();
+        int wait_ms = wait > 0.001 ? (int)(wait * 1e3) : 0;
+        int ready = poll(pfds, opened, wait_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // 3. 处理回复：每个回复都携带t1，无需保存在途状态
+        for (int i = 0; i < opened && ready > 0; i++) {
+            if (!(pfds[i].revents & POLLIN)) continue;
+            ready--;
+            struct sync_msg msg;
+            while (recvfrom(pfds[i].fd, &msg, sizeof(msg), 0, NULL, NULL) == (ssize_t)sizeof(msg)) {
+                double t4 = monotonic_sec();
+                last_rx = t4;
+                received++;
+                append_sample(&rtts, &rtt_count, &rtt_cap, (t4 - msg.t1) - (msg.t3 - msg.t2));
+                append_sample(&offsets, &off_count, &off_cap, ((msg.t2 - msg.t1) + (msg.t3 - t4)) / 2.0);
+            }
+        }
+
+        // 每秒输出一次状态
+        now = monotonic_sec();
+        if (now < end_time && now - last_report >= 1.0) {
+            printf("Sent %llu sync requests, received %llu responses, remaining time %.1f seconds\n",
+                   (unsigned long long)sent, (unsigned long long)received, end_time - now);
+            last_report = now;
+        }
+    }
+
+    double elapsed = (last_rx > start_time ? last_rx : monotonic_sec()) - start_time;
+    printf("\nSync Load Summary:\n");
+    printf("Requests sent: %llu, responses: %llu, lost: %llu, send errors: %llu\n",
+           (unsigned long long)sent, (unsigned long long)received,
+           (unsigned long long)(sent - received - send_errors), (unsigned long long)send_errors);
+    printf("Achieved response rate: %.1f req/s over %.3f seconds\n", received / elapsed, elapsed);
+    if (rtt_count > 0) {
+        qsort(rtts, rtt_count, sizeof(double), compare_double);
+        printf("Sync round-trip delay (ms): min=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f\n",
+               rtts[0] * 1e3,
+               percentile_sorted(rtts, rtt_count, 50.0) * 1e3,
+               percentile_sorted(rtts, rtt_count, 90.0) * 1e3,
+               percentile_sorted(rtts, rtt_count, 99.0) * 1e3,
+               rtts[rtt_count - 1] * 1e3);
+
+        double sum = 0.0, sq = 0.0;
+        for (size_t i = 0; i < off_count; i++) sum += offsets[i];
+        double mean = sum / off_count;
+        for (size_t i = 0; i < off_count; i++) sq += (offsets[i] - mean) * (offsets[i] - mean);
+        qsort(offsets, off_count, sizeof(double), compare_double);
+        printf("Offset estimate (ms): mean=%.6f stddev=%.6f min=%.6f max=%.6f\n",
+               mean * 1e3, sqrt(sq / off_count) * 1e3,
+               offsets[0] * 1e3, offsets[off_count - 1] * 1e3);
+    }
+
+    for (int i = 0; i < opened; i++) close(pfds[i].fd);
+    free(pfds);
+    free(rtts);
+    free(offsets);
+    return 0;
+}
+
+// 当前估计的时钟偏移；尚无估计时返回同步端口测得的初始偏移seed
+static double inband_offset_at(const struct inband_sync* est, double t, double seed) {
+    return est->valid ? est->a + est->b * (t - est->t0) : seed;
+}
+
+// 加入一个回显样本
+static void inband_sync_add(struct inband_sync* est, double t1, double t2, double t3, double t4) {
+    double delay  = (t4 - t1) - (t3 - t2);
+    double offset = ((t2 - t1) + (t3 - t4)) / 2.0;
+
+    est->samples++;
+    if (est->samples == 1 || delay < est->min_delay) est->min_delay = delay;
+    if (est->group_count == 0 || delay < est->best_delay) {
+        est->best_delay  = delay;
+        est->best_t      = t1;
+        est->best_offset = offset;
+    }
+    if (++est->group_count < ECHO_FILTER_GROUP) return;
+
+    // 一组结束：用延迟最小的样本更新拟合
+    est->group_count = 0;
+    if (est->n == 0) est->t0 = est->best_t;
+    double t = est->best_t - est->t0;
+    est->n   += 1;
+    est->st  += t;
+    est->so  += est->best_offset;
+    est->stt += t * t;
+    est->sto += t * est->best_offset;
+
+    double denom = est->n * est->stt - est->st * est->st;
+    est->b = (est->n >= 2 && denom > 0) ? (est->n * est->sto - est->st * est->so) / denom : 0.0;
+    est->a = (est->so - est->b * est->st) / est->n;
+    est->valid = 1;
+}
+
+// 读空数据socket上的回显回复（t4优先使用内核接收时间戳）
+static void inband_sync_poll(struct io_engine* eng, char* buf, struct inband_sync* est) {
+    struct io_pkt p = { .buf = buf, .cap = MAX_PACKET_SIZE };
+    while (io_recv_batch(eng, &p, 1) > 0) {
+        double t4 = p.rx_ts > 0 ? p.rx_ts : monotonic_sec();
+        if (p.len < ECHO_REPLY_SIZE) continue;
+
+        struct pkt_header hdr;
+        pkt_header_decode(buf, &hdr);
+        if (!(hdr.flags & PKT_FLAG_ECHO_REPLY)) continue;
+
+        double t2, t3;
+        memcpy(&t2, buf + ECHO_OFF_T2, sizeof(t2));
+        memcpy(&t3, buf + ECHO_OFF_T3, sizeof(t3));
+        inband_sync_add(est, hdr.send_ts, t2, t3, t4);
+    }
+}
+
+struct tx_timing;
+static int tx_timing_drain(struct tx_timing* t);
+
+// 等待到指定时间点，期间及时接收回显回复（使t4尽量准确）。错误队列非空时poll一直返回POLLERR，
+// 每次都读空它（tx非空时是发送时间戳，否则是ICMP错误），否则等待会变成忙轮询
+static void inband_sync_wait(struct io_engine* eng, char* buf, struct inband_sync* est, double deadline,
+                             struct tx_timing* tx) {
+    while (1) {
+        double wait = deadline - monotonic_sec();
+        if (wait <= 0) break;
+        struct pollfd pfd = { .fd = eng->sock, .events = POLLIN };
+        struct timespec ts = {
+            .tv_sec  = (time_t)wait,
+            .tv_nsec = (long)((wait - (time_t)wait) * 1e9)
+        };
+        if (ppoll(&pfd, 1, &ts, NULL) <= 0) break;
+        if (pfd.revents & POLLERR) {
+            if (tx) tx_timing_drain(tx);
+            else drain_error_queue(eng->sock);
+        }
+        if (pfd.revents & POLLIN) inband_sync_poll(eng, buf, est);
+    }
+}
+
+// 等待到下一个发送时间点（带内同步时echo_buffer非空，边等待边接收回显）
+static void wait_send_slot(double next_send_time, struct io_engine* eng, char* echo_buffer, struct inband_sync* est,
+                           struct tx_timing* tx) {
+    double sleep_time = next_send_time - monotonic_sec();
+    if (echo_buffer) {
+        if (sleep_time > 0) inband_sync_wait(eng, echo_buffer, est, next_send_time, tx);
+        else inband_sync_poll(eng, echo_buffer, est);
+    } else if (sleep_time > 0) {
+        struct timespec req = {
+            .tv_sec = (time_t)sleep_time,
+            .tv_nsec = (long)((sleep_time - (time_t)sleep_time) * 1e9)
+        };
+        nanosleep(&req, NULL);
+    } else if (sleep_time < -0.1) {
+        // 如果严重落后于计划发送时间（超过100ms），输出警告
+        printf("Warning: Sending rate too high, behind schedule by %.3f seconds\n", -sleep_time);
+    }
+}
+
+// 发送路径计时（-k）：每次发送调用的耗时，以及内核在包进入qdisc（SCHED）和交给驱动
+// （SOFTWARE）时记录的发送时间戳。时间戳从socket错误队列读取，按OPT_ID（内核为每个被接受
+// 的递增编号）与调用前的用户态时间配对，得到每个包的
+//   user->qdisc    发送调用开始到进入qdisc（系统调用和协议栈）
+//   qdisc->driver  qdisc排队和调度
+//   user->driver   两者之和
+struct tx_slot {
+    uint32_t id;            // 记录所属的发送调用编号
+    int      sent;          // 数据报被接受，等待时间戳
+    int      failed;        // 发送调用失败：内核可能已为它分配了OPT_ID，也可能没有
+    int64_t  user_ns;       // 发送调用前的CLOCK_REALTIME（内核发送时间戳使用的时钟）
+    int64_t  sched_ns;      // SCHED时间戳，0表示尚未收到
+};
+
+struct tx_timing {
+    int      sock;
+    uint32_t calls;             // 发送调用数（含失败的），即下一个记录的编号
+    uint32_t accepted;          // 被内核接受的数据报数
+    uint32_t skew;              // 发送调用编号 - OPT_ID：未分配OPT_ID的失败调用数
+    uint32_t since_drain;
+    uint64_t sched_count, snd_count;
+    uint64_t unmatched;         // 记录已被覆盖或不属于计时发送的时间戳
+    struct latency_hist call;   // 发送调用耗时
+    struct latency_hist sched;  // user->qdisc
+    struct latency_hist driver; // qdisc->driver
+    struct latency_hist total;  // user->driver
+    struct tx_slot ring[TX_TS_RING];
+};
+
+static int64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct tx_timing* tx_timing_create(int sock) {
+    struct tx_timing* t = (struct tx_timing*)calloc(1, sizeof(*t));
+    if (!t) {
+        perror("Error allocating send timing state");
+        return NULL;
+    }
+    t->sock = sock;
+    struct latency_hist* hists[] = { &t->call, &t->sched, &t->driver, &t->total };
+    for (int i = 0; i < 4; i++) {
+        if (hist_init(hists[i], HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+            perror("Error allocating send timing histograms");
+            for (int j = 0; j < i; j++) hist_free(hists[j]);
+            free(t);
+            return NULL;
+        }
+    }
+
+    // OPT_TSONLY：错误队列中只返回时间戳，不返回包内容
+    unsigned int flags = SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE |
+                         SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        perror("setsockopt SO_TIMESTAMPING");
+        for (int i = 0; i < 4; i++) hist_free(hists[i]);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static void tx_timing_free(struct tx_timing* t) {
+    if (!t) return;
+    hist_free(&t->call);
+    hist_free(&t->sched);
+    hist_free(&t->driver);
+    hist_free(&t->total);
+    free(t);
+}
+
+// 读取错误队列中已到达的发送时间戳，返回读到的个数（ICMP错误一并丢弃）
+static int tx_timing_drain(struct tx_timing* t) {
+    int count = 0;
+    for (;;) {
+        char data[64], ctrl[512];
+        struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+        struct msghdr msg = {
+            .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl)
+        };
+        if (recvmsg(t->sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        const struct scm_timestamping* tss = NULL;
+        const struct sock_extended_err* serr = NULL;
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+                tss = (const struct scm_timestamping*)CMSG_DATA(cm);
+            } else if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_RECVERR) {
+                serr = (const struct sock_extended_err*)CMSG_DATA(cm);
+            }
+        }
+        if (!tss || !serr || serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) continue;
+        count++;
+
+        // 失败的发送调用不一定消耗OPT_ID。OPT_ID按调用顺序递增，所以ee_data加上skew落在一个
+        // 失败调用上时，说明它没有消耗OPT_ID，跳过它重新对齐
+        int64_t ts_ns = (int64_t)tss->ts[0].tv_sec * 1000000000LL + tss->ts[0].tv_nsec;
+        uint32_t id = serr->ee_data + t->skew;
+        while (id != t->calls && t->ring[id & (TX_TS_RING - 1)].id == id && t->ring[id & (TX_TS_RING - 1)].failed) {
+            t->skew++;
+            id++;
+        }
+        struct tx_slot* slot = &t->ring[id & (TX_TS_RING - 1)];
+        if (!slot->sent || slot->id != id) {
+            t->unmatched++;
+            continue;
+        }
+        if (serr->ee_info == SCM_TSTAMP_SCHED) {
+            t->sched_count++;
+            slot->sched_ns = ts_ns;
+            hist_record(&t->sched, ts_ns - slot->user_ns);
+        } else if (serr->ee_info == SCM_TSTAMP_SND) {
+            t->snd_count++;
+            hist_record(&t->total, ts_ns - slot->user_ns);
+            if (slot->sched_ns > 0) hist_record(&t->driver, ts_ns - slot->sched_ns);
+            slot->sent = 0;
+        }
+    }
+    return count;
+}
+
+// 发送一个包并计时；t为NULL时只发送。返回值和errno同io_send_batch
+static int tx_send(struct tx_timing* t, struct io_engine* eng, const struct io_pkt* pkt) {
+    if (!t) return io_send_batch(eng, pkt, 1);
+
+    int64_t user_ns = realtime_ns();
+    double start = monotonic_sec();
+    int r = io_send_batch(eng, pkt, 1);
+    int saved_errno = errno;
+    hist_record(&t->call, (int64_t)((monotonic_sec() - start) * 1e9));
+    // 每次调用都记录，失败的调用留作OPT_ID对齐的依据；环形记录被覆盖时，迟到的时间戳计为unmatched
+    struct tx_slot* slot = &t->ring[t->calls & (TX_TS_RING - 1)];
+    slot->id       = t->calls++;
+    slot->sent     = r == 1;
+    slot->failed   = r != 1;
+    slot->user_ns  = user_ns;
+    slot->sched_ns = 0;
+    if (r == 1) {
+        t->accepted++;
+        if (++t->since_drain >= TX_TS_DRAIN_EVERY) {
+            t->since_drain = 0;
+            tx_timing_drain(t);
+        }
+    }
+    errno = saved_errno;
+    return r;
+}
+
+// 发送结束后收取剩余的时间戳，最多等待TX_TS_FINISH_WAIT秒
+static void tx_timing_finish(struct tx_timing* t) {
+    double deadline = monotonic_sec() + TX_TS_FINISH_WAIT;
+    while (t->snd_count + t->unmatched < t->accepted && monotonic_sec() < deadline) {
+        if (tx_timing_drain(t) == 0) {
+            struct pollfd pfd = { .fd = t->sock, .events = 0 };  // 错误队列非空时返回POLLERR
+            poll(&pfd, 1, 1);
+        }
+    }
+}
+
+static void tx_timing_print_hist(const char* name, const struct latency_hist* h) {
+    if (h->total_count == 0) {
+        printf("  %-14s no samples\n", name);
+        return;
+    }
+    printf("  %-14s %llu samples, min %.3f us, mean %.3f us, p50 %.3f us, p99 %.3f us, p99.9 %.3f us, max %.3f us\n",
+           name, (unsigned long long)h->total_count, h->min_value / 1e3, hist_mean(h) / 1e3,
+           hist_value_at_percentile(h, 50.0) / 1e3, hist_value_at_percentile(h, 99.0) / 1e3,
+           hist_value_at_percentile(h, 99.9) / 1e3, h->max_value / 1e3);
+}
+
+static void tx_timing_report(const struct tx_timing* t, const char* engine) {
+    printf("\nSend Path Timing (engine %s):\n", engine);
+    printf("Datagrams accepted: %u, SCHED timestamps: %llu, SOFTWARE timestamps: %llu, unmatched: %llu\n",
+           t->accepted, (unsigned long long)t->sched_count, (unsigned long long)t->snd_count,
+           (unsigned long long)t->unmatched);
+    tx_timing_print_hist("send call", &t->call);
+    tx_timing_print_hist("user->qdisc", &t->sched);
+    tx_timing_print_hist("qdisc->driver", &t->driver);
+    tx_timing_print_hist("user->driver", &t->total);
+    if (t->accepted > 0 && t->snd_count == 0) {
+        printf("  No SOFTWARE transmit timestamps: the driver does not call skb_tx_timestamp()\n");
+    }
+}
+
+// FEC编码器：边发送边把当前块的数据包（含包头，按最长包补零）XOR进校验包
+struct fec_encoder {
+    char*    parity;        // MAX_PACKET_SIZE字节，FEC_OFF_DATA之后是XOR
+    int      count;         // 当前块已加入的数据包数
+    int32_t  first_seq;     // 当前块的第一个序列号
+    int32_t  len_xor;       // 块内数据包长度的XOR
+    int      max_len;       // 块内最长数据包
+    uint64_t sent, bytes;   // 发出的校验包
+    uint64_t dropped;       // 本地发送失败的校验包
+};
+
+// 把一个数据包（发送成功或放弃重试的都算，服务器按块内全部K个包恢复）加入当前块
+static void fec_encoder_add(struct fec_encoder* f, const char* pkt, int len, int32_t seq) {
+    if (f->count == 0) f->first_seq = seq;
+    fec_xor(f->parity + FEC_OFF_DATA, pkt, (size_t)len);
+    f->len_xor ^= len;
+    if (len > f->max_len) f->max_len = len;
+    f->count++;
+}
+
+// 发送当前块的校验包并开始新块，返回校验包长度。发送失败不重试
+static int fec_send_parity(struct fec_encoder* f, struct io_engine* eng, struct tx_timing* tx,
+                           const struct sockaddr_in* server_addr, double offset) {
+    int len = FEC_OFF_DATA + f->max_len;
+    struct pkt_header hdr = {
+        .seq = f->first_seq, .send_ts = monotonic_sec(), .offset = offset,
+        .packet_size = len, .flags = PKT_FLAG_FEC_PARITY
+    };
+    pkt_header_encode(f->parity, &hdr);
+    int32_t k = f->count;
+    memcpy(f->parity + FEC_OFF_K, &k, sizeof(k));
+    memcpy(f->parity + FEC_OFF_LEN_XOR, &f->len_xor, sizeof(f->len_xor));
+
+    struct io_pkt p = { .buf = f->parity, .len = len, .addr = (struct sockaddr_in*)server_addr };
+    if (tx_send(tx, eng, &p) < 1) {
+        f->dropped++;
+    } else {
+        f->sent++;
+        f->bytes += (uint64_t)len;
+    }
+
+    memset(f->parity + FEC_OFF_DATA, 0, (size_t)f->max_len);
+    f->count   = 0;
+    f->len_xor = 0;
+    f->max_len = 0;
+    return len;
+}
+
 int main(int argc, char* argv[]) {
     // 参数默认值
-    long bandwidth = DEFAULT_BANDWIDTH;
-    int duration = DEFAULT_DURATION;
-    int packet_size = DEFAULT_PACKET_SIZE;
-    char server_ip[16] = DEFAULT_SERVER_IP;
+    struct client_config cfg = {
+        .mode          = MODE_CBR,
+        .bandwidth     = DEFAULT_BANDWIDTH,
+        .duration      = DEFAULT_DURATION,
+        .packet_size   = DEFAULT_PACKET_SIZE,
+        .server_ip     = DEFAULT_SERVER_IP,
+        .rr_window     = DEFAULT_RR_WINDOW,
+        .rr_rate       = 0.0,
+        .rr_timeout_ms = DEFAULT_RR_TIMEOUT_MS,
+        .sync_clients  = DEFAULT_SYNC_CLIENTS,
+        .echo_every    = 0,
+        .min_packet_size = 0,
+        .engine        = DEFAULT_ENGINE,
+        .slos          = { .count = 0 },
+        .npaths        = 0,
+        .fec_k         = 0,
+        .tx_timing     = 0,
+    };
     
     // 解析命令行参数
     int opt;
-    while ((opt = getopt(argc, argv, "i:b:t:s:h")) != -1) {
+    static const struct option long_options[] = {
+        { "engine",    required_argument, NULL, 'e' },
+        { "slo",       required_argument, NULL, 'S' },
+        { "dual-path", required_argument, NULL, 'D' },
+        { "fec",       required_argument, NULL, 'F' },
+        { "tx-timing", no_argument,       NULL, 'k' },
+        { "help",      no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    while ((opt = getopt_long(argc, argv, "i:b:t:s:m:w:R:T:n:E:z:e:S:D:F:kh", long_options, NULL)) != -1) {
         switch (opt) {
             case 'i':
                 if (!validate_ipv4(optarg)) {
                     fprintf(stderr, "Error: Invalid IPv4 address format\n");
                     return 1;
                 }
-                strncpy(server_ip, optarg, sizeof(server_ip) - 1);
-                server_ip[sizeof(server_ip) - 1] = '\0';  // 确保字符串以null结尾
+                strncpy(cfg.server_ip, optarg, sizeof(cfg.server_ip) - 1);
+                cfg.server_ip[sizeof(cfg.server_ip) - 1] = '\0';  // 确保字符串以null结尾
                 break;
             case 'b':
-                bandwidth = atol(optarg);
-                if (bandwidth <= 0) {
+                cfg.bandwidth = atol(optarg);
+                if (cfg.bandwidth <= 0) {
                     fprintf(stderr, "Error: Bandwidth must be positive\n");
                     return 1;
                 }
                 break;
             case 't':
-                duration = atoi(optarg);
-                if (duration <= 0) {
+                cfg.duration = atoi(optarg);
+                if (cfg.duration <= 0) {
                     fprintf(stderr, "Error: Test duration must be positive\n");
                     return 1;
                 }
                 break;
             case 's':
-                packet_size = atoi(optarg);
-                if (packet_size <= HEADER_SIZE) {  // 确保包大小足够容纳头部
-                    fprintf(stderr, "Error: Packet size must be at least %d bytes\n", HEADER_SIZE + 1);
+                cfg.packet_size = atoi(optarg);
+                if (cfg.packet_size <= HEADER_SIZE || cfg.packet_size > MAX_PACKET_SIZE) {  // 确保包大小足够容纳头部
+                    fprintf(stderr, "Error: Packet size must be between %d and %d bytes\n",
+                            HEADER_SIZE + 1, MAX_PACKET_SIZE);
+                    return 1;
+                }
+                break;
+            case 'm':
+                if (strcmp(optarg, "cbr") == 0) {
+                    cfg.mode = MODE_CBR;
+                } else if (strcmp(optarg, "rr") == 0) {
+                    cfg.mode = MODE_RR;
+                } else if (strcmp(optarg, "sync") == 0) {
+                    cfg.mode = MODE_SYNC;
+                } else if (strcmp(optarg, "blast") == 0) {
+                    cfg.mode = MODE_BLAST;
+                } else {
+                    fprintf(stderr, "Error: Unknown mode '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                cfg.rr_window = atoi(optarg);
+                if (cfg.rr_window <= 0) {
+                    fprintf(stderr, "Error: Window must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'R':
+                cfg.rr_rate = atof(optarg);
+                if (cfg.rr_rate <= 0) {
+                    fprintf(stderr, "Error: Request rate must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'T':
+                cfg.rr_timeout_ms = atoi(optarg);
+                if (cfg.rr_timeout_ms <= 0) {
+                    fprintf(stderr, "Error: Request timeout must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'n':
+                cfg.sync_clients = atoi(optarg);
+                if (cfg.sync_clients <= 0) {
+                    fprintf(stderr, "Error: Number of sync clients must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'E':
+                cfg.echo_every = atoi(optarg);
+                if (cfg.echo_every <= 0) {
+                    fprintf(stderr, "Error: Echo interval must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'z':
+                cfg.min_packet_size = atoi(optarg);
+                if (cfg.min_packet_size <= HEADER_SIZE) {
+                    fprintf(stderr, "Error: Minimum packet size must be larger than %d bytes\n", HEADER_SIZE);
                     return 1;
                 }
                 break;
+            case 'e':
+                cfg.engine = optarg;
+                if (!io_engine_find(cfg.engine)) {
+                    fprintf(stderr, "Error: Unknown I/O engine '%s'\n", cfg.engine);
+                    return 1;
+                }
+                break;
+            case 'S':
+                if (slo_parse(&cfg.slos, optarg) < 0) return 1;
+                break;
+            case 'D': {
+                const char* comma = strchr(optarg, ',');
+                if (!comma || strchr(comma + 1, ',') ||
+                    parse_send_path(optarg, (size_t)(comma - optarg), &cfg.paths[0]) < 0 ||
+                    parse_send_path(comma + 1, strlen(comma + 1), &cfg.paths[1]) < 0) {
+                    fprintf(stderr, "Error: Dual path must be two paths \"[src_ip][%%ifname][@dst_ip]\" separated by a comma\n");
+                    return 1;
+                }
+                cfg.npaths = 2;
+                break;
+            }
+            case 'F':
+                cfg.fec_k = atoi(optarg);
+                if (cfg.fec_k < 1 || cfg.fec_k > FEC_MAX_K) {
+                    fprintf(stderr, "Error: FEC block size must be between 1 and %d\n", FEC_MAX_K);
+                    return 1;
+                }
+                break;
+            case 'k':
+                cfg.tx_timing = 1;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -160,9 +1352,68 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (cfg.min_packet_size > cfg.packet_size) {
+        fprintf(stderr, "Error: Minimum packet size must not exceed the packet size\n");
+        return 1;
+    }
+    if (cfg.min_packet_size > 0 && cfg.mode != MODE_CBR) {
+        fprintf(stderr, "Error: Packet size sweep (-z) is only supported in cbr mode\n");
+        return 1;
+    }
+
     printf("Configuration: Server IP = %s, Bandwidth = %ld bps, Test Duration = %d seconds, Packet Size = %d bytes\n", 
-           server_ip, bandwidth, duration, packet_size);
+           cfg.server_ip, cfg.bandwidth, cfg.duration, cfg.packet_size);
+    if (cfg.min_packet_size > 0) {
+        printf("Packet size sweep: %d-%d bytes in %d steps\n", cfg.min_packet_size, cfg.packet_size, SIZE_SWEEP_STEPS);
+    }
+    if (cfg.mode == MODE_BLAST) {
+        printf("Blast mode: unpaced, the bandwidth setting is ignored\n");
+    }
+    if (cfg.fec_k > 0) {
+        if (cfg.mode != MODE_CBR || cfg.npaths > 0) {
+            fprintf(stderr, "Error: FEC is only supported in cbr mode without dual-path sending\n");
+            return 1;
+        }
+        if (cfg.packet_size > MAX_PACKET_SIZE - FEC_OFF_DATA) {
+            fprintf(stderr, "Error: With FEC the packet size must not exceed %d bytes\n", MAX_PACKET_SIZE - FEC_OFF_DATA);
+            return 1;
+        }
+        printf("FEC: one XOR parity packet after every %d data packets (%.1f%% packet overhead)\n",
+               cfg.fec_k, 100.0 / cfg.fec_k);
+    }
+    if (cfg.echo_every > 0 && cfg.mode != MODE_CBR) {
+        fprintf(stderr, "Error: In-band clock sync (-E) is only supported in cbr mode\n");
+        return 1;
+    }
+    if (cfg.tx_timing && (cfg.mode != MODE_CBR || cfg.npaths > 0)) {
+        fprintf(stderr, "Error: Send path timing is only supported in cbr mode without dual-path sending\n");
+        return 1;
+    }
+    if (cfg.npaths > 0) {
+        if (cfg.mode != MODE_CBR) {
+            fprintf(stderr, "Error: Dual-path sending is only supported in cbr mode\n");
+            return 1;
+        }
+        for (int p = 0; p < cfg.npaths; p++) {
+            printf("Path %c: source %s, interface %s, destination %s\n", 'A' + p,
+                   cfg.paths[p].src_ip[0] ? cfg.paths[p].src_ip : "any",
+                   cfg.paths[p].ifname[0] ? cfg.paths[p].ifname : "any",
+                   cfg.paths[p].dst_ip[0] ? cfg.paths[p].dst_ip : cfg.server_ip);
+        }
+    }
+
+    // 时钟同步负载模式不发送数据包
+    if (cfg.mode == MODE_SYNC) {
+        if (cfg.slos.count > 0) {
+            fprintf(stderr, "Error: SLOs are not supported in sync mode\n");
+            return 1;
+        }
+        return run_sync_load(&cfg);
+    }
 
+    // 1-2. 通过同步端口计算时钟偏移（带内同步时作为初始估计，之后由数据包回显细化）
+    double offset = 0.0;
+    int use_inband_sync = cfg.echo_every > 0;
     // 1. 创建同步 socket
     int sock_sync = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (sock_sync < 0) { 
@@ -181,9 +1432,12 @@ int main(int argc, char* argv[]) {
     }
 
     // 2. 计算时钟偏移
-    double offset = sync_clock_ntp(sock_sync, server_ip);
+    offset = sync_clock_ntp(sock_sync, cfg.server_ip);
     printf("Clock Offset: %.9f seconds\n", offset);
     close(sock_sync);
+    if (use_inband_sync) {
+        printf("In-band clock sync: timestamp echo every %d data packets\n", cfg.echo_every);
+    }
 
     // 3. 创建数据发送 socket
     int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -206,6 +1460,12 @@ int main(int argc, char* argv[]) {
         close(sock);
         return 1;
     }
+
+    // 双路径冗余发送：数据socket作为路径A
+    if (cfg.npaths > 0 && bind_send_path(sock, &cfg.paths[0]) < 0) {
+        close(sock);
+        return 1;
+    }
     
     // 设置目标地址
     struct sockaddr_in server_addr;
@@ -213,56 +1473,170 @@ int main(int argc, char* argv[]) {
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(DATA_PORT);
     
-    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) != 1) {
+    const char* data_ip = cfg.npaths > 0 && cfg.paths[0].dst_ip[0] ? cfg.paths[0].dst_ip : cfg.server_ip;
+    if (inet_pton(AF_INET, data_ip, &server_addr.sin_addr) != 1) {
         fprintf(stderr, "Error: Invalid IP address\n");
         close(sock);
         return 1;
     }
 
+    // 打开数据通道I/O引擎（同时开启内核接收时间戳）
+    struct io_engine engine;
+    if (io_engine_open(&engine, cfg.engine, sock) < 0) {
+        close(sock);
+        return 1;
+    }
+    printf("Data path I/O engine: %s\n", engine.ops->name);
+
+    // 路径B：另开一个绑定到路径B的socket和引擎
+    struct path_tx paths[2] = {
+        { .eng = &engine, .dst = server_addr, .flag = PKT_FLAG_PATH_A },
+        { .flag = PKT_FLAG_PATH_B },
+    };
+    struct io_engine engine_b = { .ops = NULL };
+    int sock_b = -1;
+    if (cfg.npaths > 0) {
+        paths[1].dst = server_addr;
+        if (cfg.paths[1].dst_ip[0]) inet_pton(AF_INET, cfg.paths[1].dst_ip, &paths[1].dst.sin_addr);
+        sock_b = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock_b < 0) {
+            perror("Error creating path B socket");
+            io_engine_close(&engine);
+            close(sock);
+            return 1;
+        }
+        if (fcntl(sock_b, F_SETFL, fcntl(sock_b, F_GETFL, 0) | O_NONBLOCK) == -1) {
+            perror("Error setting path B socket to non-blocking mode");
+            close(sock_b);
+            io_engine_close(&engine);
+            close(sock);
+            return 1;
+        }
+        if (bind_send_path(sock_b, &cfg.paths[1]) < 0 || io_engine_open(&engine_b, cfg.engine, sock_b) < 0) {
+            close(sock_b);
+            io_engine_close(&engine);
+            close(sock);
+            return 1;
+        }
+        paths[1].eng = &engine_b;
+    }
+
+    // 通知服务器开始新的测试会话（服务器据此重置统计）
+    send_session_marker(&engine, &server_addr, PKT_FLAG_SESSION_START, 0, offset);
+
+    // 闭环请求/响应模式和饱和发送模式
+    if (cfg.mode == MODE_RR || cfg.mode == MODE_BLAST) {
+        int rc = cfg.mode == MODE_RR ? run_rr_test(&engine, &server_addr, &cfg, offset)
+                                     : run_blast_test(&engine, &server_addr, &cfg, offset);
+        io_engine_close(&engine);
+        close(sock);
+        return rc;
+    }
+
     // 4. 初始计算发送间隔
-    double initial_interval = calculate_interval(packet_size, bandwidth);
+    double initial_interval = calculate_interval(cfg.packet_size, cfg.bandwidth);
     printf("Initial interval: %.9f seconds (theoretical)\n", initial_interval);
 
     // 5. 分配包缓冲区（只分配一次）
-    char* packet_buffer = (char*)malloc(packet_size);
+    char* packet_buffer = (char*)malloc(cfg.packet_size);
     if (!packet_buffer) {
         perror("Error allocating packet buffer");
+        io_engine_close(&engine_b);
+        if (sock_b >= 0) close(sock_b);
+        io_engine_close(&engine);
         close(sock);
         return 1;
     }
     
     // 初始化缓冲区（只有头部会被覆盖，其余部分可以预填充）
-    memset(packet_buffer, 0, packet_size);
+    memset(packet_buffer, 0, cfg.packet_size);
+
+    // 带内同步的回显接收缓冲区
+    struct inband_sync est = {0};
+    char* echo_buffer = NULL;
+    if (use_inband_sync && !(echo_buffer = (char*)malloc(MAX_PACKET_SIZE))) {
+        perror("Error allocating echo buffer");
+        free(packet_buffer);
+        io_engine_close(&engine_b);
+        if (sock_b >= 0) close(sock_b);
+        io_engine_close(&engine);
+        close(sock);
+        return 1;
+    }
+
+    // FEC校验包缓冲区
+    struct fec_encoder fec = {0};
+    if (cfg.fec_k > 0 && !(fec.parity = (char*)calloc(1, MAX_PACKET_SIZE))) {
+        perror("Error allocating parity buffer");
+        free(echo_buffer);
+        free(packet_buffer);
+        io_engine_close(&engine_b);
+        if (sock_b >= 0) close(sock_b);
+        io_engine_close(&engine);
+        close(sock);
+        return 1;
+    }
+
+    // 发送路径计时：在开始标记之后开启，OPT_ID从第一个数据包开始编号
+    struct tx_timing* tx = NULL;
+    if (cfg.tx_timing && !(tx = tx_timing_create(sock))) {
+        free(fec.parity);
+        free(echo_buffer);
+        free(packet_buffer);
+        io_engine_close(&engine);
+        close(sock);
+        return 1;
+    }
 
     // 6. 发送循环 - 基于时间而不是固定包数
     double start_time = monotonic_sec();
-    double end_time = start_time + duration;
+    double end_time = start_time + cfg.duration;
     int seq = 0;
     double next_send_time = start_time;
     int retry_count = 0;
+    uint64_t packets_sent = 0, bytes_sent = 0;  // 被内核接受的包，用于SLO评估
     
-    printf("Starting to send packets to %s, press Ctrl+C to terminate...\n", server_ip);
+    printf("Starting to send packets to %s, press Ctrl+C to terminate...\n", cfg.server_ip);
     
     while (monotonic_sec() < end_time) {
+        // FEC：一个块的K个数据包之后发送校验包，校验包占用自己的发送时隙
+        if (cfg.fec_k > 0 && fec.count == cfg.fec_k) {
+            int parity_len = fec_send_parity(&fec, &engine, tx, &server_addr,
+                                             use_inband_sync ? inband_offset_at(&est, monotonic_sec(), offset) : offset);
+            next_send_time += calculate_interval(parity_len, cfg.bandwidth);
+            wait_send_slot(next_send_time, &engine, echo_buffer, &est, tx);
+            continue;
+        }
+
         double send_ts = monotonic_sec();
         
-        // 可以动态调整单个包的大小（这里示例固定使用命令行参数指定的大小）
-        int current_packet_size = packet_size;
+        // 动态调整单个包的大小（-z时在最小和最大包大小之间扫描）
+        int current_packet_size = cfg.min_packet_size > 0
+                                ? sweep_packet_size(seq, cfg.min_packet_size, cfg.packet_size)
+                                : cfg.packet_size;
         
         // 重新计算此包的发送间隔（如果包大小可变）
-        double current_interval = calculate_interval(current_packet_size, bandwidth);
-        
-        // 构造 payload：| seq(4B) | send_ts(8B) | offset(8B) | packet_size(4B) | ...
-        memcpy(packet_buffer, &seq, sizeof(seq));
-        memcpy(packet_buffer + 4, &send_ts, sizeof(send_ts));
-        memcpy(packet_buffer + 12, &offset, sizeof(offset));
-        memcpy(packet_buffer + 20, &current_packet_size, sizeof(current_packet_size));
-
-        // 发送数据包
-        ssize_t bytes_sent = sendto(sock, packet_buffer, current_packet_size, 0,
-                           (struct sockaddr*)&server_addr, sizeof(server_addr));
+        double current_interval = calculate_interval(current_packet_size, cfg.bandwidth);
         
-        if (bytes_sent < 0) {
+        // 构造 payload：| seq(4B) | send_ts(8B) | offset(8B) | packet_size(4B) | flags(4B) | ...
+        struct pkt_header hdr = {
+            .seq = seq, .send_ts = send_ts, .offset = offset,
+            .packet_size = current_packet_size, .flags = 0
+        };
+        if (use_inband_sync) {
+            // 从第一个包起每N个包请求一次回显，回显负载不随估计状态变化；
+            // 前8·N个包尚无回显估计，沿用同步端口的初始偏移
+            hdr.offset = inband_offset_at(&est, send_ts, offset);
+            if (seq % cfg.echo_every == 0) hdr.flags |= PKT_FLAG_ECHO_REQ;
+        }
+        if (cfg.fec_k > 0) hdr.flags |= PKT_FLAG_FEC_DATA | ((uint32_t)cfg.fec_k << PKT_FEC_K_SHIFT);
+        pkt_header_encode(packet_buffer, &hdr);
+
+        // 发送数据包（双路径时每条路径各一份，不重试）
+        struct io_pkt pkt = { .buf = packet_buffer, .len = current_packet_size, .addr = &server_addr };
+        if (cfg.npaths > 0) {
+            dual_path_send(paths, packet_buffer, &hdr, current_packet_size);
+        } else if (tx_send(tx, &engine, &pkt) < 1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // 非阻塞socket可能出现的暂时错误，可以重试
                 retry_count++;
@@ -270,6 +1644,7 @@ int main(int argc, char* argv[]) {
                     // 如果多次重试仍失败，输出警告并继续
                     printf("Warning: Send buffer full, packet %d dropped after %d retries\n", 
                            seq, retry_count);
+                    if (cfg.fec_k > 0) fec_encoder_add(&fec, packet_buffer, current_packet_size, seq);
                     retry_count = 0;
                     seq++;  // 仍然递增序列号以保持连续性
                 }
@@ -282,40 +1657,92 @@ int main(int argc, char* argv[]) {
             }
         } else {
             retry_count = 0;  // 重置重试计数器
+            packets_sent++;
+            bytes_sent += (uint64_t)current_packet_size;
+            if (cfg.fec_k > 0) fec_encoder_add(&fec, packet_buffer, current_packet_size, seq);
         }
 
         // 每1000个包输出一次状态
         if (seq % 1000 == 0) {
             printf("Sent %d packets, size=%d bytes, interval=%.9f sec, remaining time %.1f seconds\n", 
                    seq, current_packet_size, current_interval, end_time - monotonic_sec());
+            if (use_inband_sync && est.valid) {
+                printf("In-band sync: offset=%.9f sec, drift=%.3f ppm, samples=%llu\n",
+                       inband_offset_at(&est, send_ts, offset), est.b * 1e6, (unsigned long long)est.samples);
+            }
         }
         
         seq++;
 
-        // 计算下一个发送时间点
-        next_send_time = start_time + (seq * current_interval);
-        
-        // 计算需要睡眠的时间（精确控制发送速率）
-        double current_time = monotonic_sec();
-        double sleep_time = next_send_time - current_time;
+        // 计算下一个发送时间点（按本包大小累加，包大小可变时仍保持目标带宽）
+        next_send_time += current_interval;
         
-        // 只有需要睡眠时才睡眠
-        if (sleep_time > 0) {
-            struct timespec req = {
-                .tv_sec = (time_t)sleep_time,
-                .tv_nsec = (long)((sleep_time - (time_t)sleep_time) * 1e9)
-            };
-            nanosleep(&req, NULL);
-        } else if (sleep_time < -0.1) {
-            // 如果严重落后于计划发送时间（超过100ms），输出警告
-            printf("Warning: Sending rate too high, behind schedule by %.3f seconds\n", -sleep_time);
-        }
+        // 只有需要睡眠时才睡眠，精确控制发送速率
+        wait_send_slot(next_send_time, &engine, echo_buffer, &est, tx);
+    }
+    if (fec.count > 0) {
+        // 最后一个不完整的块（校验包里的k小于K）
+        fec_send_parity(&fec, &engine, tx, &server_addr,
+                        use_inband_sync ? inband_offset_at(&est, monotonic_sec(), offset) : offset);
     }
 
+    double elapsed = monotonic_sec() - start_time;
     printf("Test completed! Total packets sent: %d\n", seq);
+    if (tx) tx_timing_finish(tx);  // 在结束标记之前，结束标记不计时
+    if (use_inband_sync) {
+        inband_sync_wait(&engine, echo_buffer, &est, monotonic_sec() + 0.1, tx);  // 收取最后的回显
+    }
+    double end_offset = use_inband_sync ? inband_offset_at(&est, monotonic_sec(), offset) : offset;
+    if (cfg.npaths > 0) {
+        // 结束标记也经路径B发送，路径A中断时服务器仍能得知发送数；开始标记只发一次，重复会开启新会话。
+        // 标记带路径标志：服务器收齐两条路径的结束标记才结束会话，较慢路径上迟到的副本不会开启新会话
+        send_session_marker(&engine, &server_addr, PKT_FLAG_SESSION_END | PKT_FLAG_PATH_A, seq, end_offset);
+        send_session_marker(&engine_b, &paths[1].dst, PKT_FLAG_SESSION_END | PKT_FLAG_PATH_B, seq, end_offset);
+        for (int p = 0; p < 2; p++) {
+            printf("Path %c: sent %llu copies, %llu bytes, dropped locally %llu\n", 'A' + p,
+                   (unsigned long long)paths[p].sent, (unsigned long long)paths[p].bytes,
+                   (unsigned long long)paths[p].dropped);
+            packets_sent += paths[p].sent;
+            bytes_sent   += paths[p].bytes;
+        }
+    } else {
+        send_session_marker(&engine, &server_addr, PKT_FLAG_SESSION_END, seq, end_offset);
+    }
+    if (cfg.fec_k > 0) {
+        printf("FEC: %llu parity packets sent (%llu bytes), dropped locally %llu\n",
+               (unsigned long long)fec.sent, (unsigned long long)fec.bytes, (unsigned long long)fec.dropped);
+        packets_sent += fec.sent;
+        bytes_sent   += fec.bytes;
+    }
+    if (tx) tx_timing_report(tx, engine.ops->name);
+    if (use_inband_sync) {
+        if (est.valid) {
+            printf("In-band clock sync: %llu echo samples, final offset=%.9f sec, drift=%.3f ppm, min RTT=%.6f ms\n",
+                   (unsigned long long)est.samples, inband_offset_at(&est, monotonic_sec(), offset),
+                   est.b * 1e6, est.min_delay * 1e3);
+        } else {
+            printf("In-band clock sync: no echo replies received\n");
+        }
+    }
     
+    // SLO评估：发送端只知道发出的速率，丢包和延迟由服务器评估
+    int rc = 0;
+    if (cfg.slos.count > 0) {
+        struct slo_measure m;
+        slo_measure_init(&m);
+        m.throughput = bytes_sent * 8.0 / elapsed;
+        m.pps        = packets_sent / elapsed;
+        rc = slo_evaluate(&cfg.slos, &m, stdout);
+    }
+
     // 释放资源
+    tx_timing_free(tx);
+    free(fec.parity);
+    free(echo_buffer);
     free(packet_buffer);
+    io_engine_close(&engine_b);
+    if (sock_b >= 0) close(sock_b);
+    io_engine_close(&engine);
     close(sock);
-    return 0;
+    return rc;
 }
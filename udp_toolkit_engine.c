@@ -0,0 +1,204 @@
+// I/O engines for the data path, see udp_toolkit_engine.h
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "udp_toolkit_engine.h"
+
+double realtime_to_monotonic_delta(void) {
+    struct timespec rt, mt;
+    clock_gettime(CLOCK_MONOTONIC, &mt);
+    clock_gettime(CLOCK_REALTIME, &rt);
+    return (mt.tv_sec + mt.tv_nsec * 1e-9) - (rt.tv_sec + rt.tv_nsec * 1e-9);
+}
+
+double kernel_rx_timestamp(struct msghdr* msg) {
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+            return ts.tv_sec + ts.tv_nsec * 1e-9;
+        }
+    }
+    return 0.0;
+}
+
+static int enable_rx_timestamps(int sock) {
+    int enable = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        perror("setsockopt SO_TIMESTAMPNS");
+        return -1;
+    }
+    return 0;
+}
+
+// Kernel timestamp of msg on the monotonic clock, 0 when the kernel did not provide one
+static double rx_ts_monotonic(struct msghdr* msg, double rt_delta) {
+    double kts = kernel_rx_timestamp(msg);
+    return kts > 0 ? kts + rt_delta : 0.0;
+}
+
+// --- socket: one recvmsg()/sendto() per datagram, the baseline ---
+
+static int socket_open(struct io_engine* e) {
+    e->priv = NULL;
+    return enable_rx_timestamps(e->sock);
+}
+
+static int socket_recv_batch(struct io_engine* e, struct io_pkt* pkts, int n) {
+    double rt_delta = realtime_to_monotonic_delta();
+    int received = 0;
+    for (; received < n; received++) {
+        char ctrl[CMSG_SPACE(sizeof(struct timespec))];
+        struct io_pkt* p = &pkts[received];
+        struct iovec iov = { .iov_base = p->buf, .iov_len = (size_t)p->cap };
+        struct msghdr msg = {
+            .msg_name       = p->addr,
+            .msg_namelen    = p->addr ? sizeof(*p->addr) : 0,
+            .msg_iov        = &iov,
+            .msg_iovlen     = 1,
+            .msg_control    = ctrl,
+            .msg_controllen = sizeof(ctrl),
+        };
+        ssize_t len = recvmsg(e->sock, &msg, MSG_DONTWAIT);
+        if (len < 0) {
+            if (received > 0 || errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        p->len   = (int)len;
+        p->rx_ts = rx_ts_monotonic(&msg, rt_delta);
+    }
+    return received;
+}
+
+static int socket_send_batch(struct io_engine* e, const struct io_pkt* pkts, int n) {
+    int sent = 0;
+    for (; sent < n; sent++) {
+        const struct io_pkt* p = &pkts[sent];
+        if (sendto(e->sock, p->buf, (size_t)p->len, 0,
+                   (const struct sockaddr*)p->addr, sizeof(*p->addr)) < 0) {
+            return sent > 0 ? sent : -1;
+        }
+    }
+    return sent;
+}
+
+static void socket_close(struct io_engine* e) {
+    (void)e;
+}
+
+// --- mmsg: recvmmsg()/sendmmsg(), one syscall per batch ---
+
+struct mmsg_state {
+    struct iovec   iovs[IO_ENGINE_MAX_BATCH];
+    struct mmsghdr hdrs[IO_ENGINE_MAX_BATCH];
+    char           ctrl[IO_ENGINE_MAX_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+};
+
+static int mmsg_open(struct io_engine* e) {
+    e->priv = calloc(1, sizeof(struct mmsg_state));
+    if (!e->priv) return -1;
+    return enable_rx_timestamps(e->sock);
+}
+
+static int mmsg_recv_batch(struct io_engine* e, struct io_pkt* pkts, int n) {
+    struct mmsg_state* st = (struct mmsg_state*)e->priv;
+    if (n > IO_ENGINE_MAX_BATCH) n = IO_ENGINE_MAX_BATCH;
+    for (int i = 0; i < n; i++) {
+        st->iovs[i].iov_base = pkts[i].buf;
+        st->iovs[i].iov_len  = (size_t)pkts[i].cap;
+        struct msghdr* m = &st->hdrs[i].msg_hdr;
+        m->msg_name       = pkts[i].addr;
+        m->msg_namelen    = pkts[i].addr ? sizeof(*pkts[i].addr) : 0;
+        m->msg_iov        = &st->iovs[i];
+        m->msg_iovlen     = 1;
+        m->msg_control    = st->ctrl[i];
+        m->msg_controllen = sizeof(st->ctrl[i]);
+        m->msg_flags      = 0;
+    }
+
+    int received = recvmmsg(e->sock, st->hdrs, (unsigned int)n, MSG_DONTWAIT, NULL);
+    if (received < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+    double rt_delta = realtime_to_monotonic_delta();
+    for (int i = 0; i < received; i++) {
+        pkts[i].len   = (int)st->hdrs[i].msg_len;
+        pkts[i].rx_ts = rx_ts_monotonic(&st->hdrs[i].msg_hdr, rt_delta);
+    }
+    return received;
+}
+
+static int mmsg_send_batch(struct io_engine* e, const struct io_pkt* pkts, int n) {
+    struct mmsg_state* st = (struct mmsg_state*)e->priv;
+    if (n > IO_ENGINE_MAX_BATCH) n = IO_ENGINE_MAX_BATCH;
+    for (int i = 0; i < n; i++) {
+        st->iovs[i].iov_base = pkts[i].buf;
+        st->iovs[i].iov_len  = (size_t)pkts[i].len;
+        memset(&st->hdrs[i], 0, sizeof(st->hdrs[i]));
+        st->hdrs[i].msg_hdr.msg_name    = pkts[i].addr;
+        st->hdrs[i].msg_hdr.msg_namelen = sizeof(*pkts[i].addr);
+        st->hdrs[i].msg_hdr.msg_iov     = &st->iovs[i];
+        st->hdrs[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    // sendmmsg() stops at the first failing datagram; report what went out
+    int sent = 0;
+    while (sent < n) {
+        int r = sendmmsg(e->sock, st->hdrs + sent, (unsigned int)(n - sent), 0);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return sent > 0 ? sent : -1;
+        }
+        sent += r;
+    }
+    return sent;
+}
+
+static void mmsg_close(struct io_engine* e) {
+    free(e->priv);
+    e->priv = NULL;
+}
+
+static const struct io_engine_ops io_engines[] = {
+    { "socket", "one recvmsg()/sendto() system call per datagram",
+      socket_open, socket_recv_batch, socket_send_batch, socket_close },
+    { "mmsg",   "recvmmsg()/sendmmsg(), one system call per batch",
+      mmsg_open, mmsg_recv_batch, mmsg_send_batch, mmsg_close },
+};
+
+const struct io_engine_ops* io_engine_find(const char* name) {
+    for (size_t i = 0; i < sizeof(io_engines) / sizeof(io_engines[0]); i++) {
+        if (strcmp(io_engines[i].name, name) == 0) return &io_engines[i];
+    }
+    return NULL;
+}
+
+int io_engine_open(struct io_engine* e, const char* name, int sock) {
+    e->ops  = io_engine_find(name);
+    e->sock = sock;
+    e->priv = NULL;
+    if (!e->ops) {
+        fprintf(stderr, "Error: Unknown I/O engine '%s'\n", name);
+        return -1;
+    }
+    if (e->ops->open(e) < 0) {
+        e->ops->close(e);
+        return -1;
+    }
+    return 0;
+}
+
+void io_engine_close(struct io_engine* e) {
+    if (e->ops) e->ops->close(e);
+    e->ops = NULL;
+}
+
+void io_engine_list(FILE* out, const char* prefix) {
+    for (size_t i = 0; i < sizeof(io_engines) / sizeof(io_engines[0]); i++) {
+        fprintf(out, "%s%-8s %s\n", prefix, io_engines[i].name, io_engines[i].description);
+    }
+}
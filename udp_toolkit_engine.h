@@ -0,0 +1,77 @@
+// I/O engines for the data path of udp_toolkit_client.c and udp_toolkit_server.c.
+//
+// An engine moves batches of datagrams between a UDP socket and caller-owned buffers and
+// stamps received packets with their kernel receive time. Everything above it (headers,
+// statistics, pacing) is shared, so engines can be benchmarked against each other with
+// identical statistics code. New engines add an io_engine_ops table to udp_toolkit_engine.c.
+#ifndef UDP_TOOLKIT_ENGINE_H
+#define UDP_TOOLKIT_ENGINE_H
+
+#include <stdio.h>
+#include <netinet/in.h>     // struct sockaddr_in
+#include <sys/socket.h>     // struct msghdr
+
+#define IO_ENGINE_MAX_BATCH 64      // Largest batch an engine accepts in one call
+
+// One datagram of a batch
+struct io_pkt {
+    char*               buf;        // Packet data
+    int                 len;        // recv: received length; send: bytes to send
+    int                 cap;        // recv: size of buf
+    struct sockaddr_in* addr;       // recv: filled with the source; send: destination
+    double              rx_ts;      // recv: kernel receive time on the monotonic clock, 0 if unavailable
+};
+
+struct io_engine;
+
+struct io_engine_ops {
+    const char* name;
+    const char* description;
+
+    // Set up per-engine state for e->sock and enable receive timestamps; 0 or -1
+    int  (*open)(struct io_engine* e);
+
+    // Receive up to n datagrams without blocking. Returns the number received, 0 when the
+    // socket is drained, -1 on errors other than EAGAIN (errno set).
+    int  (*recv_batch)(struct io_engine* e, struct io_pkt* pkts, int n);
+
+    // Send n datagrams. Returns the number sent (the rest were not sent), -1 when none
+    // could be sent (errno set, EAGAIN for a full send buffer).
+    int  (*send_batch)(struct io_engine* e, const struct io_pkt* pkts, int n);
+
+    void (*close)(struct io_engine* e);
+};
+
+struct io_engine {
+    const struct io_engine_ops* ops;
+    int                         sock;   // Owned by the caller, not closed by the engine
+    void*                       priv;
+};
+
+// Look up an engine by name, NULL when there is none
+const struct io_engine_ops* io_engine_find(const char* name);
+
+// Open engine name on sock. Returns -1 for unknown names or setup failures.
+int io_engine_open(struct io_engine* e, const char* name, int sock);
+
+// Release the engine state (the socket stays open)
+void io_engine_close(struct io_engine* e);
+
+// Print the available engines for usage messages, one per line after prefix
+void io_engine_list(FILE* out, const char* prefix);
+
+static inline int io_recv_batch(struct io_engine* e, struct io_pkt* pkts, int n) {
+    return e->ops->recv_batch(e, pkts, n);
+}
+
+static inline int io_send_batch(struct io_engine* e, const struct io_pkt* pkts, int n) {
+    return e->ops->send_batch(e, pkts, n);
+}
+
+// Get CLOCK_REALTIME - CLOCK_MONOTONIC, used to move kernel timestamps onto the monotonic clock
+double realtime_to_monotonic_delta(void);
+
+// Extract the SCM_TIMESTAMPNS receive time (CLOCK_REALTIME) of a message, or return 0 when absent
+double kernel_rx_timestamp(struct msghdr* msg);
+
+#endif // UDP_TOOLKIT_ENGINE_H
@@ -0,0 +1,27 @@
+// XOR parity for the FEC mode of udp_toolkit_client.c (encoder) and udp_toolkit_server.c (decoder).
+//
+// The parity is updated once per data packet at the full packet rate, so the XOR runs on 32-byte
+// GCC vector types; the compiler maps them to SSE2, AVX2 or NEON registers for the target.
+#ifndef UDP_TOOLKIT_FEC_H
+#define UDP_TOOLKIT_FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>         // memcpy
+
+typedef uint8_t fec_vec __attribute__((vector_size(32)));
+
+// XOR len bytes of src into dst
+static inline void fec_xor(char* dst, const char* src, size_t len) {
+    size_t i = 0;
+    for (; i + sizeof(fec_vec) <= len; i += sizeof(fec_vec)) {
+        fec_vec a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    for (; i < len; i++) dst[i] ^= src[i];
+}
+
+#endif // UDP_TOOLKIT_FEC_H
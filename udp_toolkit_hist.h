@@ -0,0 +1,147 @@
+// Log-linear latency histogram shared by the toolkit binaries.
+//
+// The bucket layout is the one used by HdrHistogram (lowest discernible value 1, unit
+// magnitude 0), so the counts array can be exported to HdrHistogram tooling as-is.
+// Values are unsigned integers, the toolkit records latencies in nanoseconds.
+#ifndef UDP_TOOLKIT_HIST_H
+#define UDP_TOOLKIT_HIST_H
+
+#include <stdint.h>
+#include <stdlib.h>         // calloc, free
+#include <string.h>         // memset
+
+#define HIST_SIGNIFICANT_DIGITS 3
+#define HIST_HIGHEST_VALUE      3600000000000LL  // 1 hour in nanoseconds
+
+struct latency_hist {
+    int64_t  highest_trackable;
+    int32_t  significant_digits;
+    int32_t  sub_bucket_count;                  // 2048 for 3 significant digits
+    int32_t  sub_bucket_half_count;
+    int32_t  sub_bucket_half_count_magnitude;
+    int32_t  bucket_count;
+    int32_t  counts_len;
+    int32_t  leading_zero_count_base;
+    int64_t  sub_bucket_mask;
+    int64_t  total_count;
+    int64_t  min_value;                         // INT64_MAX when empty
+    int64_t  max_value;
+    double   sum;                               // For the mean
+    int64_t* counts;
+};
+
+static inline int hist_init(struct latency_hist* h, int64_t highest_trackable, int significant_digits) {
+    memset(h, 0, sizeof(*h));
+    int64_t largest_single_unit = 2;
+    for (int i = 0; i < significant_digits; i++) largest_single_unit *= 10;
+
+    int32_t sub_bucket_count_magnitude = 0;
+    while ((1LL << sub_bucket_count_magnitude) < largest_single_unit) sub_bucket_count_magnitude++;
+
+    h->highest_trackable               = highest_trackable;
+    h->significant_digits              = significant_digits;
+    h->sub_bucket_half_count_magnitude = sub_bucket_count_magnitude - 1;
+    h->sub_bucket_count                = 1 << sub_bucket_count_magnitude;
+    h->sub_bucket_half_count           = h->sub_bucket_count / 2;
+    h->sub_bucket_mask                 = (int64_t)h->sub_bucket_count - 1;
+    h->leading_zero_count_base         = 64 - h->sub_bucket_half_count_magnitude - 1;
+
+    int64_t smallest_untrackable = h->sub_bucket_count;
+    int32_t buckets = 1;
+    while (smallest_untrackable <= highest_trackable) {
+        if (smallest_untrackable > INT64_MAX / 2) { buckets++; break; }
+        smallest_untrackable <<= 1;
+        buckets++;
+    }
+    h->bucket_count = buckets;
+    h->counts_len   = (buckets + 1) * h->sub_bucket_half_count;
+    h->min_value    = INT64_MAX;
+    h->counts       = (int64_t*)calloc(h->counts_len, sizeof(int64_t));
+    return h->counts ? 0 : -1;
+}
+
+static inline void hist_free(struct latency_hist* h) {
+    free(h->counts);
+    h->counts = NULL;
+}
+
+static inline void hist_reset(struct latency_hist* h) {
+    memset(h->counts, 0, h->counts_len * sizeof(int64_t));
+    h->total_count = 0;
+    h->min_value   = INT64_MAX;
+    h->max_value   = 0;
+    h->sum         = 0.0;
+}
+
+// Counts index of a value; values above the trackable range land in the last bucket
+static inline int32_t hist_index(const struct latency_hist* h, int64_t value) {
+    if (value < 0) value = 0;
+    if (value > h->highest_trackable) value = h->highest_trackable;
+    int32_t bucket = h->leading_zero_count_base - __builtin_clzll((uint64_t)(value | h->sub_bucket_mask));
+    int32_t sub    = (int32_t)(value >> bucket);
+    return ((bucket + 1) << h->sub_bucket_half_count_magnitude) + (sub - h->sub_bucket_half_count);
+}
+
+// Lowest value that maps to a counts index
+static inline int64_t hist_value_at_index(const struct latency_hist* h, int32_t index) {
+    int32_t bucket = (index >> h->sub_bucket_half_count_magnitude) - 1;
+    int32_t sub    = (index & (h->sub_bucket_half_count - 1)) + h->sub_bucket_half_count;
+    if (bucket < 0) {
+        sub -= h->sub_bucket_half_count;
+        bucket = 0;
+    }
+    return (int64_t)sub << bucket;
+}
+
+// Highest value that maps to the same counts index as value
+static inline int64_t hist_highest_equivalent(const struct latency_hist* h, int64_t value) {
+    int32_t index  = hist_index(h, value);
+    int32_t bucket = (index >> h->sub_bucket_half_count_magnitude) - 1;
+    if (bucket < 0) bucket = 0;
+    return hist_value_at_index(h, index) + ((int64_t)1 << bucket) - 1;
+}
+
+// Record a value whose counts index was computed in advance
+static inline void hist_record_index(struct latency_hist* h, int32_t index, int64_t value) {
+    h->counts[index]++;
+    h->total_count++;
+    h->sum += (double)value;
+    if (value < h->min_value) h->min_value = value;
+    if (value > h->max_value) h->max_value = value;
+}
+
+static inline void hist_record(struct latency_hist* h, int64_t value) {
+    if (value < 0) value = 0;
+    hist_record_index(h, hist_index(h, value), value);
+}
+
+// Merge src into dst; both must share the same layout
+static inline void hist_add(struct latency_hist* dst, const struct latency_hist* src) {
+    for (int32_t i = 0; i < dst->counts_len; i++) dst->counts[i] += src->counts[i];
+    dst->total_count += src->total_count;
+    dst->sum         += src->sum;
+    if (src->min_value < dst->min_value) dst->min_value = src->min_value;
+    if (src->max_value > dst->max_value) dst->max_value = src->max_value;
+}
+
+// Value at a percentile (0-100), reported as the highest equivalent value of its bucket
+static inline int64_t hist_value_at_percentile(const struct latency_hist* h, double percentile) {
+    if (h->total_count == 0) return 0;
+    int64_t target = (int64_t)(percentile / 100.0 * h->total_count + 0.5);
+    if (target < 1) target = 1;
+    int64_t seen = 0;
+    for (int32_t i = 0; i < h->counts_len; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            int64_t v = hist_highest_equivalent(h, hist_value_at_index(h, i));
+            return v < h->max_value ? v : h->max_value;
+        }
+    }
+    return h->max_value;
+}
+
+static inline double hist_mean(const struct latency_hist* h) {
+    return h->total_count ? h->sum / h->total_count : 0.0;
+}
+
+#endif // UDP_TOOLKIT_HIST_H
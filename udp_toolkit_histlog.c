@@ -0,0 +1,269 @@
+// HdrHistogram interval log writer, see udp_toolkit_histlog.h
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "udp_toolkit_histlog.h"
+
+#define V2_ENCODING_COOKIE      (0x1c849303 | 0x10)
+#define V2_COMPRESSION_COOKIE   (0x1c849304 | 0x10)
+#define V2_HEADER_SIZE          40
+#define ZIGZAG_MAX_BYTES        9
+
+struct hist_log {
+    FILE*          out;
+    double         start_mono;      // Monotonic time of interval timestamp 0
+    unsigned char* raw;             // Uncompressed V2 encoding
+    size_t         raw_cap;
+    unsigned char* packed;          // Compression cookie, length and zlib stream
+    size_t         packed_cap;
+    char*          text;            // Base64 of packed
+    size_t         text_cap;
+};
+
+static unsigned char* put_be32(unsigned char* p, uint32_t v) {
+    for (int i = 3; i >= 0; i--) *p++ = (unsigned char)(v >> (8 * i));
+    return p;
+}
+
+static unsigned char* put_be64(unsigned char* p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) *p++ = (unsigned char)(v >> (8 * i));
+    return p;
+}
+
+// ZigZag LEB128 as in HdrHistogram's ZigZagEncoding (counts never reach the 9-byte form)
+static unsigned char* put_zigzag(unsigned char* p, int64_t v) {
+    uint64_t u = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    while (u >= 0x80) {
+        *p++ = (unsigned char)(u | 0x80);
+        u >>= 7;
+    }
+    *p++ = (unsigned char)u;
+    return p;
+}
+
+// V2 encoding: header, then the counts up to the max value with runs of empty buckets
+// written as one negative run length
+static size_t encode_v2(const struct latency_hist* h, unsigned char* buf) {
+    unsigned char* p = buf + V2_HEADER_SIZE;
+    int32_t limit = h->total_count > 0 ? hist_index(h, h->max_value) + 1 : 1;
+    for (int32_t i = 0; i < limit;) {
+        int64_t count = h->counts[i++];
+        if (count == 0) {
+            int64_t zeros = 1;
+            while (i < limit && h->counts[i] == 0) {
+                zeros++;
+                i++;
+            }
+            p = put_zigzag(p, zeros > 1 ? -zeros : 0);
+        } else {
+            p = put_zigzag(p, count);
+        }
+    }
+    size_t payload = (size_t)(p - buf) - V2_HEADER_SIZE;
+
+    double ratio = 1.0;     // integerToDoubleValueConversionRatio
+    uint64_t ratio_bits;
+    memcpy(&ratio_bits, &ratio, sizeof(ratio_bits));
+    unsigned char* q = buf;
+    q = put_be32(q, V2_ENCODING_COOKIE);
+    q = put_be32(q, (uint32_t)payload);
+    q = put_be32(q, 0);                                 // normalizingIndexOffset
+    q = put_be32(q, (uint32_t)h->significant_digits);
+    q = put_be64(q, 1);                                 // lowestDiscernibleValue
+    q = put_be64(q, (uint64_t)h->highest_trackable);
+    put_be64(q, ratio_bits);
+    return V2_HEADER_SIZE + payload;
+}
+
+// Compression cookie, payload length and zlib stream of the V2 encoding in raw; returns the
+// length written to out or -1
+static long pack_v2(const unsigned char* raw, size_t raw_len, unsigned char* out, size_t cap) {
+    if (cap < 8) return -1;
+    uLongf zlen = (uLongf)(cap - 8);
+    if (compress2(out + 8, &zlen, raw, (uLong)raw_len, Z_DEFAULT_COMPRESSION) != Z_OK) return -1;
+    put_be32(put_be32(out, V2_COMPRESSION_COOKIE), (uint32_t)zlen);
+    return 8 + (long)zlen;
+}
+
+static uint32_t get_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get_be64(const unsigned char* p) {
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+// Read one ZigZag LEB128 value; NULL past end or on overlong encodings
+static const unsigned char* get_zigzag(const unsigned char* p, const unsigned char* end, int64_t* v) {
+    uint64_t u = 0;
+    for (int shift = 0; shift < 63; shift += 7) {
+        if (p == end) return NULL;
+        unsigned char b = *p++;
+        u |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+long hist_encode_compressed(const struct latency_hist* h, unsigned char* out, size_t cap) {
+    unsigned char* raw = (unsigned char*)malloc(V2_HEADER_SIZE + (size_t)h->counts_len * ZIGZAG_MAX_BYTES);
+    if (!raw) return -1;
+    long len = pack_v2(raw, encode_v2(h, raw), out, cap);
+    free(raw);
+    return len;
+}
+
+int hist_decode_compressed(const unsigned char* in, size_t len, struct latency_hist* h) {
+    if (len < 8 || get_be32(in) != V2_COMPRESSION_COOKIE || get_be32(in + 4) > len - 8) return -1;
+    uLongf raw_len = V2_HEADER_SIZE + (uLongf)h->counts_len * ZIGZAG_MAX_BYTES;
+    unsigned char* raw = (unsigned char*)malloc(raw_len);
+    if (!raw) return -1;
+    int rc = -1;
+    if (uncompress(raw, &raw_len, in + 8, get_be32(in + 4)) != Z_OK || raw_len < V2_HEADER_SIZE ||
+        get_be32(raw) != V2_ENCODING_COOKIE || get_be32(raw + 4) > raw_len - V2_HEADER_SIZE ||
+        (int32_t)get_be32(raw + 12) != h->significant_digits ||
+        (int64_t)get_be64(raw + 24) != h->highest_trackable) {
+        goto out;
+    }
+
+    // Pass 0 validates the whole payload, pass 1 applies it: h is untouched on malformed input.
+    // Index arithmetic in 64 bits: a hostile zero run must not wrap the index
+    for (int apply = 0; apply < 2; apply++) {
+        const unsigned char* p   = raw + V2_HEADER_SIZE;
+        const unsigned char* end = p + get_be32(raw + 4);
+        for (int64_t i = 0; p < end;) {
+            int64_t v;
+            if (!(p = get_zigzag(p, end, &v))) goto out;
+            if (v < 0) {
+                if (v == INT64_MIN || -v > h->counts_len - i) goto out;
+                i += -v;
+                continue;
+            }
+            if (i < 0 || i >= h->counts_len) goto out;
+            if (v > 0 && apply) {
+                int64_t lowest = hist_value_at_index(h, (int32_t)i);
+                int64_t highest = hist_highest_equivalent(h, lowest);
+                h->counts[i]   += v;
+                h->total_count += v;
+                h->sum         += (double)v * (lowest + highest) / 2;
+                if (lowest < h->min_value) h->min_value = lowest;
+                if (highest > h->max_value) h->max_value = highest;
+            }
+            i++;
+        }
+    }
+    rc = 0;
+out:
+    free(raw);
+    return rc;
+}
+
+static void base64_encode(const unsigned char* in, size_t len, char* out) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    for (; i + 2 < len; i += 3) {
+        uint32_t v = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+        *out++ = table[(v >> 18) & 63];
+        *out++ = table[(v >> 12) & 63];
+        *out++ = table[(v >> 6) & 63];
+        *out++ = table[v & 63];
+    }
+    if (i < len) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        *out++ = table[(v >> 18) & 63];
+        *out++ = table[(v >> 12) & 63];
+        *out++ = i + 1 < len ? table[(v >> 6) & 63] : '=';
+        *out++ = '=';
+    }
+    *out = '\0';
+}
+
+// Size the buffers for histograms with counts_len buckets
+static int reserve(struct hist_log* log, int32_t counts_len) {
+    size_t raw_cap = V2_HEADER_SIZE + (size_t)counts_len * ZIGZAG_MAX_BYTES;
+    if (raw_cap <= log->raw_cap) return 0;
+
+    size_t packed_cap = 8 + compressBound((uLong)raw_cap);
+    size_t text_cap   = (packed_cap + 2) / 3 * 4 + 1;
+    unsigned char* raw    = (unsigned char*)realloc(log->raw, raw_cap);
+    if (raw) log->raw = raw;
+    unsigned char* packed = (unsigned char*)realloc(log->packed, packed_cap);
+    if (packed) log->packed = packed;
+    char* text = (char*)realloc(log->text, text_cap);
+    if (text) log->text = text;
+    if (!raw || !packed || !text) return -1;
+
+    log->raw_cap    = raw_cap;
+    log->packed_cap = packed_cap;
+    log->text_cap   = text_cap;
+    return 0;
+}
+
+struct hist_log* hist_log_open(const char* path, double start_mono) {
+    struct hist_log* log = (struct hist_log*)calloc(1, sizeof(*log));
+    if (!log) return NULL;
+    log->out = fopen(path, "w");
+    if (!log->out) {
+        fprintf(stderr, "Error: Cannot create histogram log %s\n", path);
+        free(log);
+        return NULL;
+    }
+    log->start_mono = start_mono;
+
+    // Wall-clock time of start_mono
+    struct timespec rt, mt;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mt);
+    double start_epoch = (rt.tv_sec + rt.tv_nsec * 1e-9) - ((mt.tv_sec + mt.tv_nsec * 1e-9) - start_mono);
+
+    char date[64];
+    time_t secs = (time_t)start_epoch;
+    struct tm tm;
+    strftime(date, sizeof(date), "%a %b %d %H:%M:%S %Z %Y", localtime_r(&secs, &tm));
+
+    fprintf(log->out, "#[Logged with udp_toolkit_server]\n");
+    fprintf(log->out, "#[Histogram log format version 1.3]\n");
+    fprintf(log->out, "#[StartTime: %.3f (seconds since epoch), %s]\n", start_epoch, date);
+    fprintf(log->out, "#[BaseTime: %.3f (seconds since epoch)]\n", start_epoch);
+    fprintf(log->out, "\"StartTimestamp\",\"Interval_Length\",\"Interval_Max\",\"Interval_Compressed_Histogram\"\n");
+    fflush(log->out);
+    return log;
+}
+
+int hist_log_write(struct hist_log* log, double start, double end, const struct latency_hist* h) {
+    if (reserve(log, h->counts_len) < 0) {
+        perror("Failed to allocate histogram log buffers");
+        return -1;
+    }
+
+    long packed_len = pack_v2(log->raw, encode_v2(h, log->raw), log->packed, log->packed_cap);
+    if (packed_len < 0) {
+        fprintf(stderr, "Error: Cannot compress histogram for the histogram log\n");
+        return -1;
+    }
+    base64_encode(log->packed, (size_t)packed_len, log->text);
+
+    int64_t max = h->total_count > 0 ? hist_highest_equivalent(h, h->max_value) : 0;
+    fprintf(log->out, "%.3f,%.3f,%.3f,%s\n", start - log->start_mono, end - start,
+            max / HIST_LOG_MAX_VALUE_RATIO, log->text);
+    fflush(log->out);
+    return 0;
+}
+
+void hist_log_close(struct hist_log* log) {
+    if (!log) return;
+    fclose(log->out);
+    free(log->raw);
+    free(log->packed);
+    free(log->text);
+    free(log);
+}
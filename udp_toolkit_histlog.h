@@ -0,0 +1,36 @@
+// HdrHistogram interval log writer for the latency histograms of udp_toolkit_hist.h.
+//
+// Writes the "Histogram log format version 1.3" text format with one line per reporting
+// interval and the histogram in the compressed V2 encoding (zlib, base64), so the output can
+// be read by HdrHistogram's HistogramLogReader, HistogramLogProcessor and plotters as-is.
+#ifndef UDP_TOOLKIT_HISTLOG_H
+#define UDP_TOOLKIT_HISTLOG_H
+
+#include <stdio.h>
+
+#include "udp_toolkit_hist.h"
+
+// Interval_Max is written in milliseconds for nanosecond values, the HdrHistogram default ratio
+#define HIST_LOG_MAX_VALUE_RATIO 1e6
+
+struct hist_log;
+
+// Create path and write the log header. start_mono is the monotonic time that interval
+// timestamps are relative to; the matching wall-clock time is written as StartTime/BaseTime.
+struct hist_log* hist_log_open(const char* path, double start_mono);
+
+// Append one interval [start, end) (monotonic seconds) holding the values of h; 0 or -1
+int hist_log_write(struct hist_log* log, double start, double end, const struct latency_hist* h);
+
+void hist_log_close(struct hist_log* log);
+
+// Compressed V2 encoding of h (compression cookie, length, zlib stream), the binary form of a
+// log line's histogram, e.g. for sending it to another process. Returns the length or -1.
+long hist_encode_compressed(const struct latency_hist* h, unsigned char* out, size_t cap);
+
+// Add the counts of a compressed V2 histogram to h, which must have the same layout. Min,
+// max and sum are derived from the buckets, as HdrHistogram does. 0, or -1 on malformed input
+// (h is left untouched).
+int hist_decode_compressed(const unsigned char* in, size_t len, struct latency_hist* h);
+
+#endif // UDP_TOOLKIT_HISTLOG_H
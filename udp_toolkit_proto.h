@@ -0,0 +1,139 @@
+// Wire format shared by udp_toolkit_client.c and udp_toolkit_server.c. The XDP program
+// (udp_toolkit_xdp.bpf.c) includes it for the constants only, the C helpers are left out there.
+#ifndef UDP_TOOLKIT_PROTO_H
+#define UDP_TOOLKIT_PROTO_H
+
+#ifndef __bpf__
+#include <stdint.h>
+#include <string.h>         // memcpy
+#endif
+
+#define SYNC_PORT   4000
+#define DATA_PORT   5000
+#define MAX_PACKET_SIZE 8192    // Maximum supported packet size
+
+// Data packet layout:
+// | seq(4) | send_ts(8) | offset(8) | packet_size(4) | flags(4) | payload ... |
+#define HDR_OFF_SEQ         0
+#define HDR_OFF_SEND_TS     4
+#define HDR_OFF_OFFSET      12
+#define HDR_OFF_SIZE        20
+#define HDR_OFF_FLAGS       24
+#define HEADER_SIZE         28
+
+// Packet flags
+#define PKT_FLAG_REQUEST        0x0001  // Closed-loop request, the server must respond
+#define PKT_FLAG_RESPONSE       0x0002  // Server response to a PKT_FLAG_REQUEST packet
+#define PKT_FLAG_ECHO_REQ       0x0004  // Data packet asking the server for a timestamp echo
+#define PKT_FLAG_ECHO_REPLY     0x0008  // Timestamp echo sent back over the data 5-tuple
+#define PKT_FLAG_SESSION_START  0x0010  // Control: a test session starts (header only)
+#define PKT_FLAG_SESSION_END    0x0020  // Control: the session ends, seq carries packets sent
+#define PKT_FLAGS_CONTROL       (PKT_FLAG_SESSION_START | PKT_FLAG_SESSION_END)
+#define PKT_FLAG_PATH_A         0x0040  // Dual-path stream: copy (or end marker) sent over the first path
+#define PKT_FLAG_PATH_B         0x0080  // Dual-path stream: copy (or end marker) sent over the second path
+#define PKT_FLAGS_PATH          (PKT_FLAG_PATH_A | PKT_FLAG_PATH_B)
+#define PKT_FLAG_FEC_DATA       0x0100  // Data packet of an FEC stream, block size K in bits 24-31
+#define PKT_FLAG_FEC_PARITY     0x0200  // XOR parity packet of an FEC block
+#define PKT_FLAG_HOP_TRAIL      0x0400  // Relays appended a hop trail to the packet
+#define PKT_FEC_K_SHIFT         24
+
+// Echo reply layout: | header (seq, send_ts = t1 echoed) | t2(8) | t3(8) |
+#define ECHO_OFF_T2         HEADER_SIZE
+#define ECHO_OFF_T3         (HEADER_SIZE + 8)
+#define ECHO_REPLY_SIZE     (HEADER_SIZE + 16)
+
+// FEC parity layout: | header (seq = first data seq of the block) | k(4) | len_xor(4) | parity ... |
+// Data packet seq s belongs to the block starting at s - s % K. The parity is the XOR of the block's
+// k data packets (k < K only for the last block), headers included, each zero-padded to the longest;
+// len_xor is the XOR of their lengths. One lost data packet per block can be rebuilt.
+#define FEC_MAX_K           64
+#define FEC_OFF_K           HEADER_SIZE
+#define FEC_OFF_LEN_XOR     (HEADER_SIZE + 4)
+#define FEC_OFF_DATA        (HEADER_SIZE + 8)
+
+// Hop trail appended to data packets by relays (server --relay), one entry per relay:
+// | packet as sent ... | hop 1 | ... | hop n | hops(4) |
+// hop: | recv_ts(8) | send_ts(8) | offset(8) | packets(4) |
+// Times are on the relay's monotonic clock, offset is its clock offset to the next hop, so a
+// time of hop i maps to the receiver's clock by adding the offsets of hops i..n. packets counts
+// the data packets of the session the relay had received, this one included. The packet bytes
+// before the trail are left as sent.
+#define HOP_TRAIL_MAX       8
+#define HOP_OFF_RECV_TS     0
+#define HOP_OFF_SEND_TS     8
+#define HOP_OFF_OFFSET      16
+#define HOP_OFF_PACKETS     24
+#define HOP_ENTRY_SIZE      28
+#define HOP_COUNT_SIZE      4
+
+#ifndef __bpf__
+struct hop_entry {
+    double   recv_ts;       // Relay receive time (relay monotonic clock)
+    double   send_ts;       // Relay forward time (relay monotonic clock)
+    double   offset;        // Relay->next hop clock offset
+    uint32_t packets;       // Data packets of the session received by the relay
+};
+
+static inline int hop_trail_size(int hops) {
+    return hops * HOP_ENTRY_SIZE + HOP_COUNT_SIZE;
+}
+
+// Number of hops of the trail ending at buf + len, -1 if it is malformed
+static inline int hop_trail_hops(const char* buf, int len) {
+    int32_t hops;
+    if (len < HEADER_SIZE + HOP_COUNT_SIZE) return -1;
+    memcpy(&hops, buf + len - HOP_COUNT_SIZE, sizeof(hops));
+    if (hops < 1 || hops > HOP_TRAIL_MAX || len - hop_trail_size(hops) < HEADER_SIZE) return -1;
+    return hops;
+}
+
+// Entry i (0 = first relay) of the trail starting at trail
+static inline void hop_entry_decode(const char* trail, int i, struct hop_entry* e) {
+    const char* p = trail + (size_t)i * HOP_ENTRY_SIZE;
+    memcpy(&e->recv_ts, p + HOP_OFF_RECV_TS, sizeof(e->recv_ts));
+    memcpy(&e->send_ts, p + HOP_OFF_SEND_TS, sizeof(e->send_ts));
+    memcpy(&e->offset,  p + HOP_OFF_OFFSET,  sizeof(e->offset));
+    memcpy(&e->packets, p + HOP_OFF_PACKETS, sizeof(e->packets));
+}
+
+static inline void hop_entry_encode(char* trail, int i, const struct hop_entry* e) {
+    char* p = trail + (size_t)i * HOP_ENTRY_SIZE;
+    memcpy(p + HOP_OFF_RECV_TS, &e->recv_ts, sizeof(e->recv_ts));
+    memcpy(p + HOP_OFF_SEND_TS, &e->send_ts, sizeof(e->send_ts));
+    memcpy(p + HOP_OFF_OFFSET,  &e->offset,  sizeof(e->offset));
+    memcpy(p + HOP_OFF_PACKETS, &e->packets, sizeof(e->packets));
+}
+
+struct pkt_header {
+    int32_t  seq;           // Sequence number
+    double   send_ts;       // Client send time (client monotonic clock)
+    double   offset;        // Client->server clock offset at send time
+    int32_t  packet_size;   // Size of the whole packet as sent
+    uint32_t flags;         // PKT_FLAG_*
+};
+
+// Clock sync message: the client sends t1, the server fills in t2 (receive) and t3 (send)
+struct sync_msg {
+    double t1;  // Client send time
+    double t2;  // Server receive time
+    double t3;  // Server send time
+};
+
+static inline void pkt_header_encode(char* buf, const struct pkt_header* h) {
+    memcpy(buf + HDR_OFF_SEQ,     &h->seq,         sizeof(h->seq));
+    memcpy(buf + HDR_OFF_SEND_TS, &h->send_ts,     sizeof(h->send_ts));
+    memcpy(buf + HDR_OFF_OFFSET,  &h->offset,      sizeof(h->offset));
+    memcpy(buf + HDR_OFF_SIZE,    &h->packet_size, sizeof(h->packet_size));
+    memcpy(buf + HDR_OFF_FLAGS,   &h->flags,       sizeof(h->flags));
+}
+
+static inline void pkt_header_decode(const char* buf, struct pkt_header* h) {
+    memcpy(&h->seq,         buf + HDR_OFF_SEQ,     sizeof(h->seq));
+    memcpy(&h->send_ts,     buf + HDR_OFF_SEND_TS, sizeof(h->send_ts));
+    memcpy(&h->offset,      buf + HDR_OFF_OFFSET,  sizeof(h->offset));
+    memcpy(&h->packet_size, buf + HDR_OFF_SIZE,    sizeof(h->packet_size));
+    memcpy(&h->flags,       buf + HDR_OFF_FLAGS,   sizeof(h->flags));
+}
+#endif // __bpf__
+
+#endif // UDP_TOOLKIT_PROTO_H
@@ -1,4 +1,4 @@
-#define _POSIX_C_SOURCE 200112L  // For CLOCK_MONOTONIC support
+#define _GNU_SOURCE     // For recvmmsg/sendmmsg (also provides CLOCK_MONOTONIC)
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,16 +8,65 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <math.h>           // fabs
 #include <stdint.h>         // uint64_t
 #include <arpa/inet.h>      // inet_ntoa
 #include <stdarg.h>         // va_list, va_start, va_end
+#include <getopt.h>         // getopt, optarg
+#include <errno.h>          // errno
+#include <pthread.h>        // Analysis threads
+#include <stdatomic.h>      // Lock-free descriptor rings
+#include <sched.h>          // sched_yield
+#include <signal.h>         // sigaction
+#include <fcntl.h>          // open (--bench)
+
+#ifdef HAVE_LIBBPF
+#include "udp_toolkit_xdp.h"
+#endif
+#ifdef HAVE_ZLIB
+#include "udp_toolkit_histlog.h"
+#else
+struct hist_log;
+#endif
+
+#include "udp_toolkit_proto.h"
+#include "udp_toolkit_hist.h"
+#include "udp_toolkit_engine.h"
+#include "udp_toolkit_slo.h"
+#include "udp_toolkit_fec.h"
+#include "udp_toolkit_snapshot.h"
 
-#define SYNC_PORT   4000
-#define DATA_PORT   5000
-#define MAX_PACKET_SIZE 8192    // Maximum supported packet size
 #define DEBUG       1           // Set to 0 to disable debug output
-#define HEADER_SIZE 20          // Seq(4) + send_ts(8) + offset(8) + packet_size(4)
+#define MAX_PENDING_RESPONSES 65536 // Responses waiting for their simulated service time
+#define SYNC_BATCH  64          // Sync requests drained per recvmmsg call
+#define RECV_BATCH  64          // Data packets drained per engine receive call (<= IO_ENGINE_MAX_BATCH)
+#define DEFAULT_ENGINE       "mmsg" // Data path I/O engine
+#define DEFAULT_RING_SIZE    65536  // Packet descriptors per analysis ring
+#define MAX_ANALYSIS_THREADS 16
+#define DEFAULT_IDLE_TIMEOUT 5.0    // Seconds without data packets that end a session
+#define DEFAULT_OUTAGE_FACTOR 10.0  // Arrival pause, in expected packet intervals, that counts as an outage
+#define OUTAGE_MIN_PAUSE     0.005  // Shorter pauses are never outages (scheduling jitter)
+#define OUTAGE_LOG_MAX       64     // Outage events kept between two reports
+#define SIZE_FIT_CLASS_SHIFT 7      // Size classes of 128 bytes for the latency-vs-size fit
+#define SIZE_FIT_CLASSES     (MAX_PACKET_SIZE >> SIZE_FIT_CLASS_SHIFT)
+#define SIZE_FIT_MAX_FLOWS   16
+#define BENCH_BATCHES        20000  // Batches run through each receive path variant by --bench
+#define BENCH_WARMUP         2000   // Leading batches of each run that are not timed
+#define DUAL_RACE_WINDOW     65536  // Sequence numbers tracked by the dual-path race (power of 2)
+#define FEC_WINDOW_BLOCKS    64     // FEC blocks kept open for late packets (power of 2)
+#define HOP_SEGMENTS         (2 * HOP_TRAIL_MAX + 1)    // Links and relays of a hop trail
+#define RELAY_SYNC_PROBES    16     // Clock sync probes a relay sends to its next hop
+#define RELAY_SYNC_TIMEOUT_US 200000 // Wait for each probe's answer
+
+// Receive path features, fixed at startup (-T, -N, -H). Each combination is compiled into its
+// own copy of the decode and analysis stages (rx_variants), so the per-packet loops carry no
+// branches on them.
+#define RX_FEAT_KERNEL_TS    0x1    // Kernel receive timestamps, else one clock read per batch
+#define RX_FEAT_CAPTURE      0x2    // Per-packet records on stderr (the input of parse_logs.py)
+#define RX_FEAT_HIST         0x4    // Latency histograms
+#define RX_FEAT_VARIANTS     8
+
+// Stages instantiated once per feature combination must be inlined so the feature tests fold away
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
 
 // Get monotonic clock time in seconds
 static double monotonic_sec() {
@@ -37,39 +86,2041 @@ static void debug_print(const char* format, ...) {
     }
 }
 
+// A request/response reply held back until its simulated service time elapses
+struct pending_response {
+    struct sockaddr_in addr;    // Requesting client
+    struct pkt_header  hdr;     // Response header (echoes seq/send_ts/offset)
+    double             due;     // Monotonic time at which to send the response
+};
+
+// FIFO of pending responses; service time is constant so due times are ordered
+struct response_queue {
+    struct pending_response* items;
+    size_t head, count;
+};
+
+// Server configuration
+struct server_config {
+    int    response_size;   // Response size in bytes, 0 = same size as the request
+    double service_time;    // Simulated per-request service time in seconds
+    int    analysis_threads;// Analysis threads fed through descriptor rings, 0 = analyze inline
+    size_t ring_size;       // Descriptors per ring (power of 2)
+    const char* xdp_ifname; // Attach the XDP counting sink to this interface, NULL = off
+    const char* xdp_obj;    // XDP object path, NULL = next to the executable
+    double idle_timeout;    // Seconds without data packets that end a session
+    double outage_factor;   // Outage threshold in expected packet intervals
+    const char* engine;     // Data path I/O engine (udp_toolkit_engine.h)
+    const char* hist_log;   // HdrHistogram interval log path, NULL = off
+    const char* report_to;  // Aggregator "ip[:port]" for interval snapshots, NULL = off
+    const char* report_name;// Host name in the snapshots, NULL = gethostname()
+    const char* relay_to;   // Relay mode: next hop "ip[:port]", NULL = final receiver
+    struct in_addr bind_addr; // Address of the sync and data sockets
+    struct slo_set slos;    // SLOs evaluated at the end of every session
+    int    once;            // Exit after the first session
+    unsigned rx_features;   // RX_FEAT_* of the receive path
+    int    bench;           // Benchmark the receive path variants and exit
+};
+
+// Cleared by SIGINT/SIGTERM so the main loop can shut down (and detach XDP) cleanly
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+// Print usage help
+static void print_usage(const char* prog_name) {
+    printf("Usage: %s [options]\n", prog_name);
+    printf("Options:\n");
+    printf("  -r size         Response size in bytes for request/response mode (default: same as request)\n");
+    printf("  -d usec         Simulated service time per request in microseconds (default: 0)\n");
+    printf("  -A threads      Analyze packets on separate threads fed by lock-free rings (default: 0, inline)\n");
+    printf("  -q entries      Descriptors per analysis ring, rounded up to a power of 2 (default: %d)\n", DEFAULT_RING_SIZE);
+    printf("  -I sec          Idle time in seconds after which a test session ends (default: %.0f)\n", DEFAULT_IDLE_TIMEOUT);
+    printf("  -O factor       Report arrival pauses longer than factor expected packet intervals as outages (default: %.0f)\n", DEFAULT_OUTAGE_FACTOR);
+    printf("  -X ifname       Count data packets in-kernel with an XDP program on ifname and drop them\n");
+    printf("  -P path         XDP object file (default: %s next to the executable)\n", "udp_toolkit_xdp.bpf.o");
+    printf("  -e, --engine name  Data path I/O engine (default: %s):\n", DEFAULT_ENGINE);
+    io_engine_list(stdout, "                    ");
+    printf("  -T, --timestamps source  Receive timestamps: kernel (per packet) or user (one clock read\n");
+    printf("                  per batch) (default: kernel)\n");
+    printf("  -N, --no-capture  Do not log per-packet records (the input of parse_logs.py)\n");
+    printf("  -H, --no-histogram  Do not keep latency histograms (no percentiles in the reports)\n");
+    printf("  -L, --hist-log path  Write the latency histogram of every reporting interval to an\n");
+    printf("                  HdrHistogram interval log (compressed V2 encoding)\n");
+    printf("  -R, --report-to ip[:port]  Send a snapshot of every session interval (counters and\n");
+    printf("                  latency histogram) to udp_toolkit_aggregator (default port: %d)\n", STATS_PORT);
+    printf("  --report-name name  Host name in the snapshots (default: the system host name)\n");
+    printf("  -a, --address ip  Bind the sync and data sockets to this address (default: all)\n");
+    printf("  -F, --relay ip[:port]  Relay mode: forward every data port datagram to the next hop\n");
+    printf("                  (default port: %d), appending receive and send times to data packets\n", DATA_PORT);
+    printf("  -S, --slo expr  Evaluate SLOs at the end of every session, e.g. \"loss<0.01%%,p99<500us\";\n");
+    printf("                  metrics: loss, min, mean, max, pNN, throughput, pps, tps, outages. Exit code\n");
+    printf("                  %d if any SLO failed, %d if one could not be measured (repeatable)\n",
+           SLO_EXIT_FAIL, SLO_EXIT_NO_DATA);
+    printf("  --once          Exit after the first test session\n");
+    printf("  --bench         Measure the per-packet cost of every receive path variant and exit\n");
+    printf("  -h              Display this help message\n");
+}
+
+// Send the response for a request, padding it to the configured response size
+static int send_response(struct io_engine* eng, char* buf, const struct pending_response* resp) {
+    pkt_header_encode(buf, &resp->hdr);
+    struct io_pkt p = {
+        .buf = buf, .len = resp->hdr.packet_size, .addr = (struct sockaddr_in*)&resp->addr
+    };
+    return io_send_batch(eng, &p, 1);
+}
+
+// Clock sync statistics, reset every reporting interval except the total
+struct sync_stats {
+    uint64_t total;         // Total sync requests answered
+    uint64_t interval;      // Requests answered in the current interval
+    double   latency_sum;   // Sum of t3 - t2 in the current interval
+    double   latency_max;   // Max of t3 - t2 in the current interval
+};
+
+// Answer an in-band echo request on the data socket: t1 is echoed in the header,
+// t2 is the data packet's receive time and t3 is taken just before sending.
+static void send_echo_reply(struct io_engine* eng, char* buf, const struct pkt_header* req,
+                            double t2, struct sockaddr_in* addr) {
+    struct pkt_header hdr = *req;
+    hdr.flags       = PKT_FLAG_ECHO_REPLY;
+    hdr.packet_size = ECHO_REPLY_SIZE;
+    pkt_header_encode(buf, &hdr);
+    memcpy(buf + ECHO_OFF_T2, &t2, sizeof(t2));
+    double t3 = monotonic_sec();
+    memcpy(buf + ECHO_OFF_T3, &t3, sizeof(t3));
+    struct io_pkt p = { .buf = buf, .len = ECHO_REPLY_SIZE, .addr = addr };
+    io_send_batch(eng, &p, 1);
+}
+
 // 服务器端处理时钟同步请求
-void handle_time_sync(int sock, struct sockaddr_in* client_addr, socklen_t addr_len) {
-    struct {
-        double t1;  // 客户端发送时间
-        double t2;  // 服务器接收时间
-        double t3;  // 服务器发送时间
-    } msg;
-
-    // 接收客户端的t1
-    recvfrom(sock, &msg, sizeof(msg), 0, 
-             (struct sockaddr*)client_addr, &addr_len);
-
-    // 记录t2
-    msg.t2 = monotonic_sec();
-    
-    // 记录t3
-    msg.t3 = monotonic_sec();
+// Drains all pending sync requests in batches: t2 is the kernel receive timestamp of each
+// request, t3 is taken right before the batch is sent back with a single sendmmsg().
+static void handle_time_sync(int sock, struct sync_stats* stats) {
+    struct sync_msg    msgs[SYNC_BATCH];
+    struct sockaddr_in addrs[SYNC_BATCH];
+    struct iovec       iovs[SYNC_BATCH];
+    struct mmsghdr     hdrs[SYNC_BATCH];
+    char               ctrl[SYNC_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+
+    while (1) {
+        for (int i = 0; i < SYNC_BATCH; i++) {
+            iovs[i].iov_base = &msgs[i];
+            iovs[i].iov_len  = sizeof(msgs[i]);
+            memset(&hdrs[i], 0, sizeof(hdrs[i]));
+            hdrs[i].msg_hdr.msg_name       = &addrs[i];
+            hdrs[i].msg_hdr.msg_namelen    = sizeof(addrs[i]);
+            hdrs[i].msg_hdr.msg_iov        = &iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen     = 1;
+            hdrs[i].msg_hdr.msg_control    = ctrl[i];
+            hdrs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+        }
+
+        // 接收客户端的t1（一次取一批）
+        int n = recvmmsg(sock, hdrs, SYNC_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) perror("sync recvmmsg");
+            return;
+        }
+
+        // 记录t2：优先使用内核接收时间戳，换算到单调时钟
+        double fallback_t2 = monotonic_sec();
+        double rt_delta    = realtime_to_monotonic_delta();
+        for (int i = 0; i < n; i++) {
+            double kts = kernel_rx_timestamp(&hdrs[i].msg_hdr);
+            msgs[i].t2 = kts > 0 ? kts + rt_delta : fallback_t2;
+        }
+
+        // 记录t3
+        double t3 = monotonic_sec();
+        for (int i = 0; i < n; i++) {
+            msgs[i].t3 = t3;
+            iovs[i].iov_len = sizeof(msgs[i]);
+            hdrs[i].msg_hdr.msg_control    = NULL;
+            hdrs[i].msg_hdr.msg_controllen = 0;
+
+            double latency = t3 - msgs[i].t2;
+            stats->latency_sum += latency;
+            if (latency > stats->latency_max) stats->latency_max = latency;
+        }
+
+        // 发送t2和t3回客户端
+        int sent = 0;
+        while (sent < n) {
+            int r = sendmmsg(sock, hdrs + sent, n - sent, 0);
+            if (r <= 0) {
+                perror("sync sendmmsg");
+                break;
+            }
+            sent += r;
+        }
+        stats->total    += n;
+        stats->interval += n;
+
+        if (n < SYNC_BATCH) return;
+    }
+}
+
+// Arrival pause longer than the outage threshold
+struct outage_event {
+    double  start;                      // Receive time of the last packet before the pause
+    double  end;                        // Receive time of the first packet after it
+    int32_t seq_before;
+    int32_t seq_after;
+    int32_t lost;                       // Packets missing between the two
+};
+
+// Latency-vs-size fit of one flow. Each size class keeps its minimum latency, the sample
+// least affected by queueing; a least-squares line through these minima separates the fixed
+// delay (intercept) from the per-byte serialization delay (slope) of the bottleneck. Only the
+// minima are kept, so the analysis threads' fits merge exactly and memory stays constant.
+struct size_fit_flow {
+    struct sockaddr_in addr;
+    double  min_latency[SIZE_FIT_CLASSES];
+    int32_t min_size[SIZE_FIT_CLASSES];         // Size of the minimum sample, 0 = class empty
+    int     classes;                            // Non-empty classes
+    uint64_t packets;                           // Packets fitted, untracked if the merge drops the flow
+};
+
+struct size_fit {
+    int                  nflows;
+    uint64_t             untracked;             // Packets of flows beyond SIZE_FIT_MAX_FLOWS
+    struct size_fit_flow flows[SIZE_FIT_MAX_FLOWS];
+};
+
+// Flow of from, added if there is room; NULL when SIZE_FIT_MAX_FLOWS flows are tracked
+static struct size_fit_flow* size_fit_flow_get(struct size_fit* fit, const struct sockaddr_in* from) {
+    for (int i = 0; i < fit->nflows; i++) {
+        if (fit->flows[i].addr.sin_addr.s_addr == from->sin_addr.s_addr &&
+            fit->flows[i].addr.sin_port == from->sin_port) {
+            return &fit->flows[i];
+        }
+    }
+    if (fit->nflows == SIZE_FIT_MAX_FLOWS) return NULL;
+    struct size_fit_flow* f = &fit->flows[fit->nflows++];
+    memset(f, 0, sizeof(*f));
+    f->addr = *from;
+    return f;
+}
+
+static void size_fit_class_min(struct size_fit_flow* f, int k, int32_t size, double latency) {
+    if (f->min_size[k] == 0) {
+        f->classes++;
+    } else if (latency >= f->min_latency[k]) {
+        return;
+    }
+    f->min_size[k]    = size;
+    f->min_latency[k] = latency;
+}
+
+static void size_fit_add(struct size_fit* fit, const struct sockaddr_in* from, int32_t size, double latency) {
+    struct size_fit_flow* f = size_fit_flow_get(fit, from);
+    if (!f) {
+        fit->untracked++;
+        return;
+    }
+    int k = size >> SIZE_FIT_CLASS_SHIFT;
+    if (k >= SIZE_FIT_CLASSES) k = SIZE_FIT_CLASSES - 1;
+    size_fit_class_min(f, k, size, latency);
+    f->packets++;
+}
+
+// Fold the class minima of src into dst and clear src
+static void size_fit_merge(struct size_fit* dst, struct size_fit* src) {
+    for (int i = 0; i < src->nflows; i++) {
+        const struct size_fit_flow* sf = &src->flows[i];
+        struct size_fit_flow* f = size_fit_flow_get(dst, &sf->addr);
+        if (!f) {
+            dst->untracked += sf->packets;
+            continue;
+        }
+        for (int k = 0; k < SIZE_FIT_CLASSES; k++) {
+            if (sf->min_size[k] != 0) size_fit_class_min(f, k, sf->min_size[k], sf->min_latency[k]);
+        }
+        f->packets += sf->packets;
+    }
+    dst->untracked += src->untracked;
+    src->nflows    = 0;
+    src->untracked = 0;
+}
+
+static void size_fit_report(const struct size_fit* fit) {
+    for (int i = 0; i < fit->nflows; i++) {
+        const struct size_fit_flow* f = &fit->flows[i];
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &f->addr.sin_addr, ip, sizeof(ip));
+        // Centered sums (Welford): raw sums of squared sizes cancel catastrophically
+        double n = 0.0, mx = 0.0, my = 0.0, cxx = 0.0, cxy = 0.0;
+        for (int k = 0; k < SIZE_FIT_CLASSES; k++) {
+            if (f->min_size[k] == 0) continue;
+            double x = f->min_size[k], y = f->min_latency[k];
+            double dx = x - mx;
+            n   += 1.0;
+            mx  += dx / n;
+            my  += (y - my) / n;
+            cxx += dx * (x - mx);
+            cxy += dx * (y - my);
+        }
+        if (f->classes < 2 || cxx <= 0) {
+            printf("Size fit %s:%d: needs packets of at least 2 size classes (client -z)\n",
+                   ip, ntohs(f->addr.sin_port));
+            continue;
+        }
+        double slope     = cxy / cxx;       // Seconds per byte
+        double intercept = my - slope * mx;
+        if (slope <= 0) {
+            printf("Size fit %s:%d: fixed delay %.3f ms, no per-byte delay resolved (%d size classes)\n",
+                   ip, ntohs(f->addr.sin_port), intercept * 1e3, f->classes);
+            continue;
+        }
+        printf("Size fit %s:%d: fixed delay %.3f ms, %.3f ns/byte, bottleneck %.3f Mbps (%d size classes)\n",
+               ip, ntohs(f->addr.sin_port), intercept * 1e3, slope * 1e9, 8.0 / slope / 1e6, f->classes);
+    }
+    if (fit->untracked > 0) {
+        printf("Size fit: %llu packets of further flows not fitted\n", (unsigned long long)fit->untracked);
+    }
+}
+
+// Data stream statistics
+struct data_stats {
+    uint64_t bytes_interval;            // Current interval bytes
+    uint64_t total_bytes;               // Total received bytes
+    uint64_t total_packets;             // Total received packets counter
+    int      last_seq;                  // Last sequence number (for gap detection), -1 before the first packet
+    int      total_gaps;                // Count of sequence gaps
+    uint64_t negative_latency;          // Packets with a negative latency (recorded as 0)
+    int      capture_gaps;              // Running gap count of the per-packet records (not harvested)
+
+    // Outage detection. The expected packet interval is a moving average of the sender's
+    // spacing (send_ts difference per sequence step), so lost packets do not stretch it.
+    double   last_send_ts;              // Send time of the last in-order packet
+    double   last_recv_ts;              // Receive time of the last packet, 0 before the first
+    double   send_interval;             // Expected packet interval, 0 until known
+    uint64_t outages;                   // Outages detected
+    double   outage_time;               // Cumulative outage duration in seconds
+    uint64_t outage_lost;               // Packets lost during outages
+    int      n_outage_log;              // Events not reported yet (at most OUTAGE_LOG_MAX kept)
+    struct outage_event outage_log[OUTAGE_LOG_MAX];
+
+    struct size_fit size_fit;           // Latency-vs-size fit per flow, kept for the whole session
+    struct dual_race* dual;             // Dual-path race (I/O thread only), NULL until a dual-path packet
+    struct fec_decoder* fec;            // FEC decoder (I/O thread only), NULL until an FEC packet
+    struct hop_trail* hops;             // Hop trail breakdown (I/O thread only), NULL until a relayed packet
+    struct relay* relay;                // Relay mode forwarder (I/O thread only), NULL = final receiver
+
+    struct latency_hist lat_interval;   // One-way latency of the current interval (ns)
+    struct latency_hist lat_total;      // One-way latency since start (ns)
+};
+
+// One batch of received data packets. The I/O engine fills the row buffers, the decode stage
+// then copies the header fields of all valid packets into struct-of-arrays columns so that
+// latency, gap detection and histogram bucketing run as simple loops over whole columns.
+struct rx_batch {
+    // Row buffers filled by the I/O engine
+    char*              bufs;                            // RECV_BATCH * MAX_PACKET_SIZE
+    struct io_pkt      pkts[RECV_BATCH];
+    struct sockaddr_in addrs[RECV_BATCH];
+
+    // Decoded columns, count entries each (packets shorter than the header are skipped)
+    int      count;
+    int32_t  slot[RECV_BATCH];          // Row of the packet in bufs/addrs
+    int32_t  seq[RECV_BATCH];
+    double   send_ts[RECV_BATCH];
+    double   offset[RECV_BATCH];
+    int32_t  size[RECV_BATCH];          // Actual received size
+    int32_t  reported_size[RECV_BATCH];
+    uint32_t flags[RECV_BATCH];
+    double   recv_ts[RECV_BATCH];       // Kernel receive time on the monotonic clock
+
+    // Derived columns
+    double   latency[RECV_BATCH];       // One-way latency in seconds
+    int64_t  latency_ns[RECV_BATCH];    // Latency clamped at 0, in nanoseconds
+    int32_t  bucket[RECV_BATCH];        // Histogram counts index of latency_ns
+    int32_t  gap[RECV_BATCH];           // Packets missing right before this one
+
+    // Session control markers of the batch, kept out of the columns. ctrl_pos keeps their
+    // place in the stream: the marker arrived after the first ctrl_pos[c] data columns.
+    int      nctrl;
+    uint32_t ctrl_flags[RECV_BATCH];
+    int32_t  ctrl_seq[RECV_BATCH];
+    double   ctrl_ts[RECV_BATCH];
+    int32_t  ctrl_pos[RECV_BATCH];
+    int32_t  ctrl_slot[RECV_BATCH];     // Row of the marker in bufs/addrs
+};
+
+// Decode stage: copy the header fields of n received datagrams into columns. Control markers
+// go to the ctrl list, packets shorter than the header are skipped.
+ALWAYS_INLINE void rx_batch_decode_impl(struct rx_batch* b, int n, const unsigned feat) {
+    // User-space timestamps: one clock read for the whole batch, right after the receive call
+    double batch_ts = monotonic_sec();
+    for (int i = 0; i < n; i++) {
+        int len = b->pkts[i].len;
+        if (len < HEADER_SIZE) {
+            debug_print("Received invalid data packet (size: %d, min expected: %d)\n", len, HEADER_SIZE);
+            continue;
+        }
+        const char* buf = b->bufs + (size_t)i * MAX_PACKET_SIZE;
+        double ts = batch_ts;
+        if (feat & RX_FEAT_KERNEL_TS) {
+            if (b->pkts[i].rx_ts > 0) ts = b->pkts[i].rx_ts;
+        }
+        uint32_t flags;
+        memcpy(&flags, buf + HDR_OFF_FLAGS, sizeof(flags));
+        if (flags & PKT_FLAGS_CONTROL) {
+            int c = b->nctrl++;
+            b->ctrl_flags[c] = flags;
+            memcpy(&b->ctrl_seq[c], buf + HDR_OFF_SEQ, sizeof(b->ctrl_seq[c]));
+            b->ctrl_ts[c]   = ts;
+            b->ctrl_pos[c]  = b->count;
+            b->ctrl_slot[c] = i;
+            continue;
+        }
+
+        // Packets that passed relays: strip the hop trail and add the relays' clock offsets,
+        // so send_ts + offset is on this clock
+        double trail_offset = 0.0;
+        if (flags & PKT_FLAG_HOP_TRAIL) {
+            int hops = hop_trail_hops(buf, len);
+            if (hops < 0) {
+                debug_print("Received data packet with a malformed hop trail (size: %d)\n", len);
+                continue;
+            }
+            len -= hop_trail_size(hops);
+            for (int h = 0; h < hops; h++) {
+                double off;
+                memcpy(&off, buf + len + h * HOP_ENTRY_SIZE + HOP_OFF_OFFSET, sizeof(off));
+                trail_offset += off;
+            }
+        }
+
+        int k = b->count++;
+        b->slot[k] = i;
+        b->size[k] = len;
+        memcpy(&b->seq[k],           buf + HDR_OFF_SEQ,     sizeof(b->seq[k]));
+        memcpy(&b->send_ts[k],       buf + HDR_OFF_SEND_TS, sizeof(b->send_ts[k]));
+        memcpy(&b->offset[k],        buf + HDR_OFF_OFFSET,  sizeof(b->offset[k]));
+        memcpy(&b->reported_size[k], buf + HDR_OFF_SIZE,    sizeof(b->reported_size[k]));
+        b->offset[k] += trail_offset;
+        b->flags[k]   = flags;
+        b->recv_ts[k] = ts;
+    }
+}
+
+// Column stage: latency, sequence gaps and histogram bucket of every packet in the batch
+ALWAYS_INLINE void rx_batch_compute(struct rx_batch* b, const struct latency_hist* h, int last_seq,
+                                    const unsigned feat) {
+    int n = b->count;
+    if (n == 0) return;
+
+    for (int i = 0; i < n; i++) {
+        b->latency[i] = b->recv_ts[i] - (b->send_ts[i] + b->offset[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        double ns = b->latency[i] * 1e9;
+        b->latency_ns[i] = ns > 0 ? (int64_t)ns : 0;
+    }
+
+    // gap[i] = seq[i] - seq[i-1] - 1, reordered or duplicate packets count as 0
+    b->gap[0] = last_seq != -1 ? b->seq[0] - last_seq - 1 : 0;
+    for (int i = 1; i < n; i++) {
+        b->gap[i] = b->seq[i] - b->seq[i - 1] - 1;
+    }
+    for (int i = 0; i < n; i++) {
+        b->gap[i] = b->gap[i] > 0 ? b->gap[i] : 0;
+    }
+
+    if (feat & RX_FEAT_HIST) {
+        for (int i = 0; i < n; i++) {
+            b->bucket[i] = hist_index(h, b->latency_ns[i]);
+        }
+    }
+}
+
+// Outage detection over a computed batch. Runs packet by packet since the expected
+// interval is a running average, so it is kept out of the column loops.
+static void rx_batch_outages(struct data_stats* st, const struct rx_batch* b, double outage_factor) {
+    int32_t prev_seq  = st->last_seq;
+    double  prev_send = st->last_send_ts;
+    double  prev_recv = st->last_recv_ts;
+    for (int i = 0; i < b->count; i++) {
+        double pause = b->recv_ts[i] - prev_recv;
+        if (prev_recv > 0 && st->send_interval > 0 &&
+            pause > outage_factor * st->send_interval && pause > OUTAGE_MIN_PAUSE) {
+            st->outages++;
+            st->outage_time += pause;
+            st->outage_lost += (uint64_t)b->gap[i];
+            if (st->n_outage_log < OUTAGE_LOG_MAX) {
+                struct outage_event* ev = &st->outage_log[st->n_outage_log++];
+                ev->start      = prev_recv;
+                ev->end        = b->recv_ts[i];
+                ev->seq_before = prev_seq;
+                ev->seq_after  = b->seq[i];
+                ev->lost       = b->gap[i];
+            }
+        }
+        prev_recv = b->recv_ts[i];
+
+        // Update the expected interval from in-order packets only
+        int32_t steps = b->seq[i] - prev_seq;
+        if (prev_seq == -1 || steps > 0) {
+            double spacing = prev_seq != -1 ? (b->send_ts[i] - prev_send) / steps : 0.0;
+            if (spacing > 0) {
+                st->send_interval = st->send_interval > 0
+                                  ? st->send_interval + (spacing - st->send_interval) / 16.0
+                                  : spacing;
+            }
+            prev_seq  = b->seq[i];
+            prev_send = b->send_ts[i];
+        }
+    }
+    st->last_send_ts = prev_send;
+    st->last_recv_ts = prev_recv;
+}
+
+// Fold a computed batch into the stream statistics
+ALWAYS_INLINE void rx_batch_accumulate(struct data_stats* st, const struct rx_batch* b,
+                                       double outage_factor, const unsigned feat) {
+    int n = b->count;
+    if (n == 0) return;
 
-    // 发送t2和t3回客户端
-    sendto(sock, &msg, sizeof(msg), 0,
-           (struct sockaddr*)client_addr, addr_len);
+    rx_batch_outages(st, b, outage_factor);
+    for (int i = 0; i < n; i++) {
+        size_fit_add(&st->size_fit, &b->addrs[b->slot[i]], b->size[i], b->latency[i]);
+    }
+
+    uint64_t bytes = 0;
+    int gaps = 0, negative = 0;
+    for (int i = 0; i < n; i++) {
+        bytes    += (uint64_t)b->size[i];
+        gaps     += b->gap[i];
+        negative += b->latency[i] < 0;
+    }
+    if (feat & RX_FEAT_HIST) {
+        for (int i = 0; i < n; i++) {
+            hist_record_index(&st->lat_interval, b->bucket[i], b->latency_ns[i]);
+        }
+    }
+
+    st->total_packets    += (uint64_t)n;
+    st->bytes_interval   += bytes;
+    st->total_bytes      += bytes;
+    st->total_gaps       += gaps;
+    st->negative_latency += (uint64_t)negative;
+    st->last_seq          = b->seq[n - 1];
+}
+
+// Per-packet debug output of a batch, kept out of the column loops
+static void rx_batch_debug(const struct rx_batch* b, int gaps_before) {
+    int gaps = gaps_before;
+    for (int i = 0; i < b->count; i++) {
+        int seq = b->seq[i];
+
+        // Check for sequence number gaps
+        if (b->gap[i] > 0) {
+            gaps += b->gap[i];
+            debug_print("Sequence gap detected: %d packets missing between %d and %d\n", 
+                       b->gap[i], seq - b->gap[i] - 1, seq);
+        }
+
+        // Calculate and print one-way latency (milliseconds)
+        debug_print("Seq=%d, Send_ts=%.9f, Recv_ts=%.9f, Size=%d bytes, Latency=%.6f ms\n",
+               seq, b->send_ts[i], b->recv_ts[i], b->size[i], b->latency[i] * 1e3);
+        
+        // Verify reported packet size matches actual received size
+        if (b->reported_size[i] != b->size[i]) {
+            debug_print("Warning: Reported packet size (%d) differs from received size (%d)\n",
+                       b->reported_size[i], b->size[i]);
+        }
+        
+        if (seq % 1000 == 0) {
+            const struct sockaddr_in* cli = &b->addrs[b->slot[i]];
+            char client_ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &(cli->sin_addr), client_ip, INET_ADDRSTRLEN);
+            debug_print("Packet details (seq=%d):\n", seq);
+            debug_print("  → Source: %s:%d\n", client_ip, ntohs(cli->sin_port));
+            debug_print("  → Send time: %.9f\n", b->send_ts[i]);
+            debug_print("  → Offset: %.9f\n", b->offset[i]);
+            debug_print("  → Reported size: %d bytes\n", b->reported_size[i]);
+            debug_print("  → Actual received size: %d bytes\n", b->size[i]);
+            debug_print("  → Receive time: %.9f\n", b->recv_ts[i]);
+            debug_print("  → Total sequence gaps: %d\n", gaps);
+        }
+    }
 }
 
-int main() {
+// Analysis of a decoded batch: column stage, statistics (under lock when the stats are shared
+// with the reporting loop) and the per-packet records
+ALWAYS_INLINE void rx_batch_analyze_impl(struct data_stats* st, struct rx_batch* b, double outage_factor,
+                                         pthread_mutex_t* lock, const unsigned feat) {
+    if (b->count == 0) return;
+    rx_batch_compute(b, &st->lat_interval, st->last_seq, feat);
+    if (lock) pthread_mutex_lock(lock);
+    int gaps_before = st->total_gaps;
+    rx_batch_accumulate(st, b, outage_factor, feat);
+    int gaps = st->total_gaps - gaps_before;
+    if (lock) pthread_mutex_unlock(lock);
+
+    if (feat & RX_FEAT_CAPTURE) rx_batch_debug(b, st->capture_gaps);
+    st->capture_gaps += gaps;
+}
+
+typedef void (*rx_decode_fn)(struct rx_batch* b, int n);
+typedef void (*rx_analyze_fn)(struct data_stats* st, struct rx_batch* b, double outage_factor,
+                              pthread_mutex_t* lock);
+
+struct rx_variant {
+    rx_decode_fn  decode;
+    rx_analyze_fn analyze;
+};
+
+#define RX_VARIANT(feat)                                                                        \
+    static void rx_batch_decode_##feat(struct rx_batch* b, int n) {                             \
+        rx_batch_decode_impl(b, n, feat);                                                       \
+    }                                                                                           \
+    static void rx_batch_analyze_##feat(struct data_stats* st, struct rx_batch* b,              \
+                                        double outage_factor, pthread_mutex_t* lock) {          \
+        rx_batch_analyze_impl(st, b, outage_factor, lock, feat);                                \
+    }
+RX_VARIANT(0)
+RX_VARIANT(1)
+RX_VARIANT(2)
+RX_VARIANT(3)
+RX_VARIANT(4)
+RX_VARIANT(5)
+RX_VARIANT(6)
+RX_VARIANT(7)
+
+// Indexed by the RX_FEAT_* bits
+static const struct rx_variant rx_variants[RX_FEAT_VARIANTS] = {
+    { rx_batch_decode_0, rx_batch_analyze_0 }, { rx_batch_decode_1, rx_batch_analyze_1 },
+    { rx_batch_decode_2, rx_batch_analyze_2 }, { rx_batch_decode_3, rx_batch_analyze_3 },
+    { rx_batch_decode_4, rx_batch_analyze_4 }, { rx_batch_decode_5, rx_batch_analyze_5 },
+    { rx_batch_decode_6, rx_batch_analyze_6 }, { rx_batch_decode_7, rx_batch_analyze_7 },
+};
+
+// Receive up to RECV_BATCH data packets and decode their headers into columns.
+// Returns the number of datagrams received, 0 when the socket is drained.
+static int rx_batch_receive(struct io_engine* eng, struct rx_batch* b, const struct rx_variant* v) {
+    for (int i = 0; i < RECV_BATCH; i++) {
+        b->pkts[i].buf  = b->bufs + (size_t)i * MAX_PACKET_SIZE;
+        b->pkts[i].cap  = MAX_PACKET_SIZE;
+        b->pkts[i].addr = &b->addrs[i];
+    }
+
+    b->count = 0;
+    b->nctrl = 0;
+    int n = io_recv_batch(eng, b->pkts, RECV_BATCH);
+    if (n <= 0) {
+        if (n < 0) perror("data receive");
+        return 0;
+    }
+    v->decode(b, n);
+    return n;
+}
+
+// Move the decoded columns of packet src to dst (dst <= src) when packets are removed from a batch
+static void rx_batch_move(struct rx_batch* b, int dst, int src) {
+    b->slot[dst]          = b->slot[src];
+    b->seq[dst]           = b->seq[src];
+    b->send_ts[dst]       = b->send_ts[src];
+    b->offset[dst]        = b->offset[src];
+    b->size[dst]          = b->size[src];
+    b->reported_size[dst] = b->reported_size[src];
+    b->flags[dst]         = b->flags[src];
+    b->recv_ts[dst]       = b->recv_ts[src];
+}
+
+// Make the data columns [start, end) of a decoded batch the columns [0, end - start), so the
+// stages between two control markers see only the packets that arrived between them
+static void rx_batch_segment(struct rx_batch* b, int start, int end) {
+    if (start > 0) {
+        for (int j = start; j < end; j++) rx_batch_move(b, j - start, j);
+    }
+    b->count = end - start;
+}
+
+// Statistics of one path of a dual-path stream
+struct dual_path_stats {
+    uint64_t packets;                   // Copies received over the path
+    uint64_t first;                     // Copies that arrived before the other path's copy (or alone)
+    uint64_t leads;                     // Races won with both copies received
+    double   lead_sum;                  // Margin of those wins in seconds
+    double   lead_max;
+    struct latency_hist lat;            // One-way latency of every copy of the path (ns)
+};
+
+struct dual_race_slot {
+    int32_t seq;
+    uint8_t paths;                      // Bit per path whose copy arrived, 0 = unused
+    uint8_t first;                      // Path of the first copy
+    double  first_ts;                   // Receive time of the first copy
+};
+
+// First-arrival race of a dual-path stream. The client sends every sequence number over two
+// paths (PKT_FLAG_PATH_A/B). The I/O thread keeps the first copy in the batch, so the regular
+// statistics describe the "first copy wins" stream, and drops the second copy after crediting
+// its path. The first copies are attributed to a single source address so the analysis sees
+// one flow. Races are tracked over a window of DUAL_RACE_WINDOW sequence numbers.
+struct dual_race {
+    struct dual_race_slot* slots;       // Indexed by seq % DUAL_RACE_WINDOW
+    int      have_stream;
+    struct sockaddr_in stream_addr;     // Source of the first dual-path packet of the session
+    int32_t  max_seq;
+    uint64_t repeats;                   // Copies that arrived twice over the same path
+    struct dual_path_stats path[2];
+};
+
+static void dual_race_free(struct dual_race* r) {
+    if (!r) return;
+    hist_free(&r->path[0].lat);
+    hist_free(&r->path[1].lat);
+    free(r->slots);
+    free(r);
+}
+
+static struct dual_race* dual_race_create(void) {
+    struct dual_race* r = (struct dual_race*)calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->slots   = (struct dual_race_slot*)calloc(DUAL_RACE_WINDOW, sizeof(struct dual_race_slot));
+    r->max_seq = -1;
+    if (!r->slots ||
+        hist_init(&r->path[0].lat, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0 ||
+        hist_init(&r->path[1].lat, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+        dual_race_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static void dual_race_reset(struct dual_race* r) {
+    memset(r->slots, 0, DUAL_RACE_WINDOW * sizeof(struct dual_race_slot));
+    r->have_stream = 0;
+    r->max_seq     = -1;
+    r->repeats     = 0;
+    for (int p = 0; p < 2; p++) {
+        struct latency_hist lat = r->path[p].lat;
+        hist_reset(&lat);
+        memset(&r->path[p], 0, sizeof(r->path[p]));
+        r->path[p].lat = lat;
+    }
+}
+
+// Race the dual-path copies of a decoded batch and remove the second copies from its columns
+static void dual_race_batch(struct dual_race* r, struct rx_batch* b) {
+    int kept = 0;
+    for (int i = 0; i < b->count; i++) {
+        uint32_t path_flags = b->flags[i] & PKT_FLAGS_PATH;
+        if (path_flags) {
+            int p = (path_flags & PKT_FLAG_PATH_B) ? 1 : 0;
+            struct dual_path_stats* ps = &r->path[p];
+            ps->packets++;
+            hist_record(&ps->lat, (int64_t)((b->recv_ts[i] - (b->send_ts[i] + b->offset[i])) * 1e9));
+            if (b->seq[i] > r->max_seq) r->max_seq = b->seq[i];
+
+            struct dual_race_slot* s = &r->slots[(uint32_t)b->seq[i] & (DUAL_RACE_WINDOW - 1)];
+            if (s->paths && s->seq == b->seq[i]) {
+                if (s->paths & (1u << p)) {
+                    r->repeats++;
+                } else {
+                    struct dual_path_stats* winner = &r->path[s->first];
+                    double lead = b->recv_ts[i] - s->first_ts;
+                    winner->leads++;
+                    winner->lead_sum += lead;
+                    if (lead > winner->lead_max) winner->lead_max = lead;
+                    s->paths |= (uint8_t)(1u << p);
+                }
+                continue;
+            }
+            s->seq      = b->seq[i];
+            s->paths    = (uint8_t)(1u << p);
+            s->first    = (uint8_t)p;
+            s->first_ts = b->recv_ts[i];
+            ps->first++;
+
+            if (!r->have_stream) {
+                r->stream_addr = b->addrs[b->slot[i]];
+                r->have_stream = 1;
+            }
+            b->addrs[b->slot[i]] = r->stream_addr;
+        }
+
+        if (kept != i) rx_batch_move(b, kept, i);
+        kept++;
+    }
+    b->count = kept;
+}
+
+// Per-path part of the session summary. sent is the number of sequence numbers sent (-1 if
+// unknown), loss and stream describe the first-copy stream of the regular summary.
+static void dual_race_report(const struct dual_race* r, int64_t sent, double loss,
+                             const struct latency_hist* stream) {
+    int64_t expected = sent >= 0 ? sent : (int64_t)r->max_seq + 1;
+    double best_loss = 100.0, best_p99 = 0.0;
+    printf("Dual path: first copy of each sequence number kept (the statistics above), second copy dropped\n");
+    for (int p = 0; p < 2; p++) {
+        const struct dual_path_stats* ps = &r->path[p];
+        int64_t lost = expected - (int64_t)ps->packets;
+        if (lost < 0) lost = 0;
+        double path_loss = expected > 0 ? 100.0 * lost / expected : 0.0;
+        printf("    Path %c: received %llu, lost %lld (%.3f%%), first to arrive %llu (%.1f%%)\n",
+               'A' + p, (unsigned long long)ps->packets, (long long)lost, path_loss,
+               (unsigned long long)ps->first, expected > 0 ? 100.0 * ps->first / expected : 0.0);
+        if (ps->lat.total_count > 0) {
+            double p99 = hist_value_at_percentile(&ps->lat, 99.0) / 1e6;
+            printf("        Latency: min %.3f ms, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+                   ps->lat.min_value / 1e6, hist_mean(&ps->lat) / 1e6,
+                   hist_value_at_percentile(&ps->lat, 50.0) / 1e6, p99,
+                   hist_value_at_percentile(&ps->lat, 99.9) / 1e6, ps->lat.max_value / 1e6);
+            if (path_loss < best_loss || (path_loss == best_loss && p99 < best_p99)) {
+                best_loss = path_loss;
+                best_p99  = p99;
+            }
+        }
+        if (ps->leads > 0) {
+            printf("        Ahead of path %c in %llu races with both copies, by mean %.3f ms, max %.3f ms\n",
+                   'B' - p, (unsigned long long)ps->leads, ps->lead_sum / ps->leads * 1e3, ps->lead_max * 1e3);
+        }
+    }
+    if (stream->total_count > 0) {
+        printf("    First copy wins: loss %.3f%%, p99 %.3f ms; best single path: loss %.3f%%, p99 %.3f ms\n",
+               loss, hist_value_at_percentile(stream, 99.0) / 1e6, best_loss, best_p99);
+    }
+    if (r->repeats > 0) {
+        printf("    Copies received twice over the same path: %llu\n", (unsigned long long)r->repeats);
+    }
+}
+
+// One block of an FEC stream. acc holds the XOR of every data packet and the parity payload
+// that arrived, so once the parity is in and exactly one data packet is missing, acc is that
+// packet. Packets are folded in as they arrive and never stored.
+struct fec_block {
+    int32_t  first_seq;                 // -1 = unused
+    int32_t  k;                         // Data packets in the block
+    uint64_t received;                  // Bit per data packet that arrived
+    int      have_parity;
+    int      recovered;                 // Index of the rebuilt packet, -1 if none
+    int32_t  len_xor;                   // XOR of the lengths of everything folded in
+    int      acc_len;                   // Bytes of acc that may be non-zero
+    char*    acc;                       // MAX_PACKET_SIZE bytes
+};
+
+// FEC decoder of a stream with XOR parity (client -F). Runs in the I/O thread before the
+// analysis and takes the parity packets out of the batch, so the regular statistics describe
+// the raw stream; recovered packets are only counted here.
+struct fec_decoder {
+    int32_t  k;                         // Block size K of the stream
+    char*    acc;                       // Accumulators of all blocks
+    uint64_t parity_packets;
+    uint64_t recovered;                 // Lost data packets rebuilt from their block
+    uint64_t late;                      // Rebuilt packets whose original arrived afterwards
+    uint64_t invalid;                   // Rebuilt packets that did not decode as their sequence number
+    uint64_t expired;                   // Packets of blocks already out of the window
+    struct latency_hist lat;            // One-way latency of rebuilt packets at their recovery (ns)
+    struct fec_block blocks[FEC_WINDOW_BLOCKS];
+};
+
+static void fec_decoder_free(struct fec_decoder* d) {
+    if (!d) return;
+    hist_free(&d->lat);
+    free(d->acc);
+    free(d);
+}
+
+static void fec_decoder_reset(struct fec_decoder* d) {
+    struct latency_hist lat = d->lat;
+    char* acc = d->acc;
+    hist_reset(&lat);
+    memset(acc, 0, (size_t)FEC_WINDOW_BLOCKS * MAX_PACKET_SIZE);
+    memset(d, 0, sizeof(*d));
+    d->lat = lat;
+    d->acc = acc;
+    for (int i = 0; i < FEC_WINDOW_BLOCKS; i++) {
+        d->blocks[i].first_seq = -1;
+        d->blocks[i].recovered = -1;
+        d->blocks[i].acc       = acc + (size_t)i * MAX_PACKET_SIZE;
+    }
+}
+
+static struct fec_decoder* fec_decoder_create(void) {
+    struct fec_decoder* d = (struct fec_decoder*)calloc(1, sizeof(*d));
+    if (!d) return NULL;
+    d->acc = (char*)malloc((size_t)FEC_WINDOW_BLOCKS * MAX_PACKET_SIZE);
+    if (!d->acc || hist_init(&d->lat, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+        fec_decoder_free(d);
+        return NULL;
+    }
+    fec_decoder_reset(d);
+    return d;
+}
+
+// Block starting at first_seq, opened (replacing an older block) if needed. NULL for blocks
+// that already left the window.
+static struct fec_block* fec_block_get(struct fec_decoder* d, int32_t first_seq) {
+    struct fec_block* blk = &d->blocks[(uint32_t)(first_seq / d->k) & (FEC_WINDOW_BLOCKS - 1)];
+    if (blk->first_seq == first_seq) return blk;
+    if (blk->first_seq > first_seq) {
+        d->expired++;
+        return NULL;
+    }
+    memset(blk->acc, 0, (size_t)blk->acc_len);
+    blk->first_seq   = first_seq;
+    blk->k           = d->k;
+    blk->received    = 0;
+    blk->have_parity = 0;
+    blk->recovered   = -1;
+    blk->len_xor     = 0;
+    blk->acc_len     = 0;
+    return blk;
+}
+
+static void fec_block_fold(struct fec_block* blk, const char* data, int len, int32_t len_xor) {
+    fec_xor(blk->acc, data, (size_t)len);
+    if (len > blk->acc_len) blk->acc_len = len;
+    blk->len_xor ^= len_xor;
+}
+
+// Rebuild the missing data packet once the parity is in and exactly one is missing.
+// now is the receive time of the packet that completed the block, on the clock of the
+// client's offset (without the hop trail offsets of relays).
+static void fec_block_try_recover(struct fec_decoder* d, struct fec_block* blk, double now) {
+    if (!blk->have_parity || blk->recovered >= 0) return;
+    uint64_t mask    = blk->k == 64 ? ~0ULL : (1ULL << blk->k) - 1;
+    uint64_t missing = mask & ~blk->received;
+    if (missing == 0 || (missing & (missing - 1)) != 0) return;
+
+    blk->recovered = __builtin_ctzll(missing);
+    struct pkt_header hdr;
+    if (blk->len_xor < HEADER_SIZE || blk->len_xor > MAX_PACKET_SIZE) {
+        d->invalid++;
+        return;
+    }
+    pkt_header_decode(blk->acc, &hdr);
+    if (hdr.seq != blk->first_seq + blk->recovered || hdr.packet_size != blk->len_xor) {
+        d->invalid++;
+        return;
+    }
+    d->recovered++;
+    hist_record(&d->lat, (int64_t)((now - (hdr.send_ts + hdr.offset)) * 1e9));
+}
+
+// Clock offsets of relays added to a packet's offset at decode (0 without a hop trail)
+static double fec_trail_offset(const char* buf, double offset) {
+    double hdr_offset;
+    memcpy(&hdr_offset, buf + HDR_OFF_OFFSET, sizeof(hdr_offset));
+    return offset - hdr_offset;
+}
+
+// Fold the FEC packets of a decoded batch into their blocks and remove the parity packets
+static void fec_decoder_batch(struct fec_decoder* d, struct rx_batch* b) {
+    int kept = 0;
+    for (int i = 0; i < b->count; i++) {
+        const char* buf = b->bufs + (size_t)b->slot[i] * MAX_PACKET_SIZE;
+        if (b->flags[i] & PKT_FLAG_FEC_PARITY) {
+            int32_t k, len_xor;
+            memcpy(&k, buf + FEC_OFF_K, sizeof(k));
+            memcpy(&len_xor, buf + FEC_OFF_LEN_XOR, sizeof(len_xor));
+            d->parity_packets++;
+            if (b->size[i] < FEC_OFF_DATA || k < 1 || k > FEC_MAX_K || b->seq[i] < 0) continue;
+            if (d->k == 0) d->k = k;
+            struct fec_block* blk = fec_block_get(d, b->seq[i]);
+            if (blk && !blk->have_parity) {
+                blk->k           = k;
+                blk->have_parity = 1;
+                fec_block_fold(blk, buf + FEC_OFF_DATA, b->size[i] - FEC_OFF_DATA, len_xor);
+                fec_block_try_recover(d, blk, b->recv_ts[i] - fec_trail_offset(buf, b->offset[i]));
+            }
+            continue;
+        }
+
+        if ((b->flags[i] & PKT_FLAG_FEC_DATA) && b->seq[i] >= 0) {
+            int32_t k = (int32_t)(b->flags[i] >> PKT_FEC_K_SHIFT);
+            if (k >= 1 && k <= FEC_MAX_K) {
+                d->k = k;
+                int32_t idx = b->seq[i] % k;
+                struct fec_block* blk = fec_block_get(d, b->seq[i] - idx);
+                if (blk && blk->recovered == idx) {
+                    d->late++;
+                } else if (blk && blk->recovered < 0 && idx < blk->k && !(blk->received & (1ULL << idx))) {
+                    blk->received |= 1ULL << idx;
+                    fec_block_fold(blk, buf, b->size[i], b->size[i]);
+                    fec_block_try_recover(d, blk, b->recv_ts[i] - fec_trail_offset(buf, b->offset[i]));
+                }
+            }
+        }
+
+        if (kept != i) rx_batch_move(b, kept, i);
+        kept++;
+    }
+    b->count = kept;
+}
+
+// FEC part of the session summary. lost is the raw loss of the stream (-1 if unknown),
+// expected the data packets sent and received the latency of the packets that arrived.
+static void fec_decoder_report(const struct fec_decoder* d, int64_t lost, int64_t expected,
+                               const struct latency_hist* received) {
+    uint64_t rebuilt = d->recovered - d->late;
+    printf("FEC: K=%d, parity packets received: %llu, rebuilt packets: %llu",
+           d->k, (unsigned long long)d->parity_packets, (unsigned long long)rebuilt);
+    if (d->late > 0) printf(" (+%llu whose original arrived later)", (unsigned long long)d->late);
+    printf("\n");
+    if (lost >= 0 && expected > 0) {
+        int64_t residual = lost - (int64_t)rebuilt;
+        if (residual < 0) residual = 0;
+        printf("    Raw loss: %lld (%.3f%%), residual loss after recovery: %lld (%.3f%%)\n",
+               (long long)lost, 100.0 * lost / expected, (long long)residual, 100.0 * residual / expected);
+    }
+    if (d->lat.total_count > 0) {
+        const struct latency_hist* h = &d->lat;
+        printf("    Rebuilt latency: min %.3f ms, mean %.3f ms, p99 %.3f ms, max %.3f ms",
+               h->min_value / 1e6, hist_mean(h) / 1e6, hist_value_at_percentile(h, 99.0) / 1e6,
+               h->max_value / 1e6);
+        if (received->total_count > 0) {
+            printf(", %.3f ms above the mean of received packets",
+                   (hist_mean(h) - hist_mean(received)) / 1e6);
+        }
+        printf("\n");
+    }
+    if (d->invalid > 0 || d->expired > 0) {
+        printf("    Rebuilds that failed to decode: %llu, packets of blocks out of the window: %llu\n",
+               (unsigned long long)d->invalid, (unsigned long long)d->expired);
+    }
+}
+
+// Delay of one segment of a relayed path
+struct hop_segment {
+    double   sum;                       // Delay sum in seconds, negative delays included
+    uint64_t negative;                  // Negative delays (clock offset error), recorded as 0
+    struct latency_hist lat;            // ns
+};
+
+// Per-segment breakdown of streams that passed relays (PKT_FLAG_HOP_TRAIL). Runs in the I/O
+// thread on every relayed packet, FEC parity and both dual-path copies included, like the
+// relays' counters. Segment 2i is the link into relay i+1 (or into this receiver after the last relay),
+// segment 2i+1 the time spent in relay i+1. The relays' packet counters, taken from the packet
+// with the highest sequence number, split the loss of the stream by link.
+struct hop_trail {
+    int      hops;                      // Relays of the stream, from its first relayed packet
+    uint64_t packets;                   // Relayed packets received
+    uint64_t other_route;               // Packets with a different number of relays, not analyzed
+    int32_t  max_seq;                   // Highest sequence number, -1 before the first packet
+    uint32_t relay_packets[HOP_TRAIL_MAX];  // Relay counters of the max_seq packet
+    uint64_t received;                  // Relayed packets received here up to the max_seq packet
+    struct hop_segment seg[HOP_SEGMENTS];
+};
+
+static void hop_trail_free(struct hop_trail* t) {
+    if (!t) return;
+    for (int i = 0; i < HOP_SEGMENTS; i++) hist_free(&t->seg[i].lat);
+    free(t);
+}
+
+static void hop_trail_reset(struct hop_trail* t) {
+    for (int i = 0; i < HOP_SEGMENTS; i++) {
+        hist_reset(&t->seg[i].lat);
+        t->seg[i].sum      = 0.0;
+        t->seg[i].negative = 0;
+    }
+    t->hops        = 0;
+    t->packets     = 0;
+    t->other_route = 0;
+    t->max_seq     = -1;
+    t->received    = 0;
+    memset(t->relay_packets, 0, sizeof(t->relay_packets));
+}
+
+static struct hop_trail* hop_trail_create(void) {
+    struct hop_trail* t = (struct hop_trail*)calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    for (int i = 0; i < HOP_SEGMENTS; i++) {
+        if (hist_init(&t->seg[i].lat, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+            hop_trail_free(t);
+            return NULL;
+        }
+    }
+    hop_trail_reset(t);
+    return t;
+}
+
+static void hop_segment_add(struct hop_segment* s, double delay) {
+    s->sum      += delay;
+    s->negative += delay < 0;
+    hist_record(&s->lat, (int64_t)(delay * 1e9));
+}
+
+// Split the delay of every relayed packet of a decoded batch into its segments
+static void hop_trail_batch(struct hop_trail* t, const struct rx_batch* b) {
+    for (int i = 0; i < b->count; i++) {
+        if (!(b->flags[i] & PKT_FLAG_HOP_TRAIL)) continue;
+        const struct io_pkt* p = &b->pkts[b->slot[i]];
+        int hops = hop_trail_hops(p->buf, p->len);
+        if (t->hops == 0) t->hops = hops;
+        if (hops != t->hops) {
+            t->other_route++;
+            continue;
+        }
+        t->packets++;
+
+        // Move the relay times onto this clock: each relay's offset applies to it and all
+        // earlier hops. send_ts + offset already includes every offset.
+        struct hop_entry e[HOP_TRAIL_MAX];
+        double shift = 0.0;
+        for (int h = hops - 1; h >= 0; h--) {
+            hop_entry_decode(p->buf + b->size[i], h, &e[h]);
+            shift += e[h].offset;
+            e[h].recv_ts += shift;
+            e[h].send_ts += shift;
+        }
+        double prev = b->send_ts[i] + b->offset[i];
+        for (int h = 0; h < hops; h++) {
+            hop_segment_add(&t->seg[2 * h], e[h].recv_ts - prev);
+            hop_segment_add(&t->seg[2 * h + 1], e[h].send_ts - e[h].recv_ts);
+            prev = e[h].send_ts;
+        }
+        hop_segment_add(&t->seg[2 * hops], b->recv_ts[i] - prev);
+
+        if (b->seq[i] > t->max_seq) {
+            t->max_seq  = b->seq[i];
+            t->received = t->packets;
+            for (int h = 0; h < hops; h++) t->relay_packets[h] = e[h].packets;
+        }
+    }
+}
+
+// Hop trail part of the session summary
+static void hop_trail_report(const struct hop_trail* t) {
+    printf("Hop trail: %d relays, %llu packets", t->hops, (unsigned long long)t->packets);
+    if (t->other_route > 0) {
+        printf(", %llu packets over a different number of relays not analyzed",
+               (unsigned long long)t->other_route);
+    }
+    printf("\n");
+
+    // Packets that entered each link up to the max_seq packet: sent by the client, then
+    // counted by each relay and finally here
+    int64_t entered = (int64_t)t->max_seq + 1;
+    for (int s = 0; s <= 2 * t->hops; s++) {
+        const struct hop_segment* g = &t->seg[s];
+        const struct latency_hist* h = &g->lat;
+        int r = s / 2 + 1;                  // Relay after the link, or of the residence
+        char name[48];
+        if (s % 2 == 1) {
+            snprintf(name, sizeof(name), "relay %d", r);
+        } else if (s == 0) {
+            snprintf(name, sizeof(name), "client -> %s", t->hops > 0 ? "relay 1" : "receiver");
+        } else if (r <= t->hops) {
+            snprintf(name, sizeof(name), "relay %d -> relay %d", r - 1, r);
+        } else {
+            snprintf(name, sizeof(name), "relay %d -> receiver", r - 1);
+        }
+        printf("    %-22s mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms", name,
+               h->total_count ? g->sum / h->total_count * 1e3 : 0.0,
+               hist_value_at_percentile(h, 50.0) / 1e6, hist_value_at_percentile(h, 99.0) / 1e6,
+               h->max_value / 1e6);
+        if (s % 2 == 0) {
+            int64_t arrived = r <= t->hops ? (int64_t)t->relay_packets[r - 1] : (int64_t)t->received;
+            int64_t lost = entered - arrived;
+            if (lost < 0) lost = 0;
+            printf(", lost %lld (%.3f%%)", (long long)lost, entered > 0 ? 100.0 * lost / entered : 0.0);
+            entered = arrived;
+        }
+        if (g->negative > 0) {
+            printf(", %llu negative (clock offset error)", (unsigned long long)g->negative);
+        }
+        printf("\n");
+    }
+}
+
+// Relay mode (--relay): every datagram received on the data port is forwarded to the next hop
+// through the I/O engine. Data packets get this relay's hop trail entry on the way; requests
+// are left to the final receiver, whose responses go back to the upstream sender. Echo requests
+// are answered by the first relay itself: the client's clock offset is to its first hop.
+struct relay {
+    struct sockaddr_in next;
+    struct sockaddr_in prev;            // Upstream sender of the last data packet (one client per relay)
+    double   offset;                    // This clock -> next hop clock
+    uint32_t packets;                   // Data packets of the current session
+    uint64_t forwarded;                 // Datagrams forwarded in the session
+    uint64_t unstamped;                 // Data packets forwarded without an entry (trail full or too long)
+    uint64_t failed;                    // Datagrams the engine did not send
+    uint64_t returned;                  // Responses sent back upstream, included in forwarded
+    struct io_pkt pkts[RECV_BATCH];
+};
+
+// Clock offset to the next hop from the fastest of RELAY_SYNC_PROBES probes to its sync port.
+// -1 if no probe was answered.
+static int relay_sync(struct relay* r) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("relay sync socket");
+        return -1;
+    }
+    struct timeval tv = { .tv_sec = 0, .tv_usec = RELAY_SYNC_TIMEOUT_US };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr = r->next;
+    addr.sin_port = htons(SYNC_PORT);
+
+    double best_rtt = -1.0;
+    for (int i = 0; i < RELAY_SYNC_PROBES; i++) {
+        struct sync_msg msg = { .t1 = monotonic_sec() };
+        double t1 = msg.t1;
+        if (sendto(sock, &msg, sizeof(msg.t1), 0, (struct sockaddr*)&addr, sizeof(addr)) < 0) break;
+        ssize_t n = recv(sock, &msg, sizeof(msg), 0);
+        double t4 = monotonic_sec();
+        if (n < (ssize_t)sizeof(msg) || msg.t1 != t1) continue;    // Timeout or a late answer
+        double rtt = (t4 - t1) - (msg.t3 - msg.t2);
+        if (best_rtt < 0 || rtt < best_rtt) {
+            best_rtt  = rtt;
+            r->offset = ((msg.t2 - t1) + (msg.t3 - t4)) / 2.0;
+        }
+    }
+    close(sock);
+    if (best_rtt < 0) return -1;
+    printf("Relay clock offset to the next hop: %.6f ms (round trip %.3f ms)\n", r->offset * 1e3, best_rtt * 1e3);
+    return 0;
+}
+
+static struct relay* relay_create(const char* spec) {
+    struct relay* r = (struct relay*)calloc(1, sizeof(*r));
+    if (!r) {
+        perror("Failed to allocate the relay");
+        return NULL;
+    }
+    char ip[INET_ADDRSTRLEN];
+    const char* colon = strchr(spec, ':');
+    size_t ip_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    int port = colon ? atoi(colon + 1) : DATA_PORT;
+    r->next.sin_family = AF_INET;
+    r->next.sin_port   = htons((uint16_t)port);
+    snprintf(ip, sizeof(ip), "%.*s", (int)ip_len, spec);
+    if (ip_len >= sizeof(ip) || port <= 0 || port > 65535 || inet_pton(AF_INET, ip, &r->next.sin_addr) != 1) {
+        fprintf(stderr, "Error: Invalid relay next hop '%s' (expected ip[:port])\n", spec);
+        free(r);
+        return NULL;
+    }
+    if (relay_sync(r) < 0) {
+        fprintf(stderr, "Warning: No clock sync answer from %s:%d, assuming synchronized clocks\n", ip, SYNC_PORT);
+        r->offset = 0.0;
+    }
+    return r;
+}
+
+// Append this relay's entry to the hop trail of a data packet; returns the new length
+static int relay_stamp(struct relay* r, char* buf, int len, uint32_t flags, double recv_ts, double send_ts) {
+    int hops = 0;
+    if (flags & PKT_FLAG_HOP_TRAIL) {
+        hops = hop_trail_hops(buf, len);
+        if (hops < 0 || hops >= HOP_TRAIL_MAX) {
+            r->unstamped++;
+            return len;
+        }
+        len -= hop_trail_size(hops);
+    }
+    if (len + hop_trail_size(hops + 1) > MAX_PACKET_SIZE) {
+        r->unstamped++;
+        return hops > 0 ? len + hop_trail_size(hops) : len;
+    }
+
+    struct hop_entry e = { .recv_ts = recv_ts, .send_ts = send_ts, .offset = r->offset, .packets = r->packets };
+    int32_t count = hops + 1;
+    hop_entry_encode(buf + len, hops, &e);
+    memcpy(buf + len + hop_trail_size(count) - HOP_COUNT_SIZE, &count, sizeof(count));
+    flags |= PKT_FLAG_HOP_TRAIL;
+    memcpy(buf + HDR_OFF_FLAGS, &flags, sizeof(flags));
+    return len + hop_trail_size(count);
+}
+
+static void relay_send(struct relay* r, struct io_engine* eng, int m) {
+    int sent = 0;
+    while (sent < m) {
+        int rc = io_send_batch(eng, r->pkts + sent, m - sent);
+        if (rc <= 0) break;
+        sent += rc;
+    }
+    r->forwarded += (uint64_t)sent;
+    r->failed    += (uint64_t)(m - sent);
+}
+
+// Forward the data packets of the current batch segment, appending the entries in place, and
+// send responses from downstream back to the upstream sender unchanged (they leave the columns,
+// they are not data of this hop). Echo requests are cleared in the forwarded copy, this relay
+// answers them. Runs after the hop trail breakdown (it overwrites the trail's hop count).
+static void relay_forward(struct relay* r, struct io_engine* eng, struct rx_batch* b) {
+    double now = monotonic_sec();
+    int m = 0, kept = 0;
+    for (int k = 0; k < b->count; k++) {
+        const struct io_pkt* p = &b->pkts[b->slot[k]];
+        uint32_t flags = b->flags[k];
+        if (flags & (PKT_FLAG_RESPONSE | PKT_FLAG_ECHO_REPLY)) {
+            if (r->prev.sin_family == AF_INET) {
+                r->pkts[m++] = (struct io_pkt){ .buf = p->buf, .len = p->len, .addr = &r->prev };
+                r->returned++;
+            }
+            continue;
+        }
+        r->prev = b->addrs[b->slot[k]];
+        r->packets++;
+        if (flags & PKT_FLAG_ECHO_REQ) {
+            uint32_t fwd = flags & ~PKT_FLAG_ECHO_REQ;
+            memcpy(p->buf + HDR_OFF_FLAGS, &fwd, sizeof(fwd));
+        }
+        int len = relay_stamp(r, p->buf, p->len, flags & ~PKT_FLAG_ECHO_REQ, b->recv_ts[k], now);
+        r->pkts[m++] = (struct io_pkt){ .buf = p->buf, .len = len, .addr = &r->next };
+        if (kept != k) rx_batch_move(b, kept, k);
+        kept++;
+    }
+    b->count = kept;
+    relay_send(r, eng, m);
+}
+
+// Forward control marker c of a batch unchanged; a session start resets the packet counter
+static void relay_forward_marker(struct relay* r, struct io_engine* eng, const struct rx_batch* b, int c) {
+    const struct io_pkt* p = &b->pkts[b->ctrl_slot[c]];
+    if (b->ctrl_flags[c] & PKT_FLAG_SESSION_START) r->packets = 0;
+    r->pkts[0] = (struct io_pkt){ .buf = p->buf, .len = p->len, .addr = &r->next };
+    relay_send(r, eng, 1);
+}
+
+// Packet descriptor handed from the I/O thread to an analysis thread
+struct pkt_desc {
+    int32_t  seq;
+    int32_t  size;
+    int32_t  reported_size;
+    uint32_t flags;
+    double   send_ts;
+    double   offset;
+    double   recv_ts;
+    struct sockaddr_in addr;
+};
+
+// Lock-free single-producer single-consumer ring of packet descriptors.
+// head is only written by the I/O thread, tail only by the analysis thread.
+struct desc_ring {
+    _Alignas(64) atomic_size_t head;        // Next slot to write
+    _Alignas(64) atomic_size_t tail;        // Next slot to read
+    _Alignas(64) size_t        mask;        // Capacity - 1
+    struct pkt_desc*           slots;
+    atomic_ullong              producer_stalls;  // Times the I/O thread waited on a full ring
+    atomic_ullong              consumer_waits;   // Times the analysis thread slept on an empty ring
+    atomic_size_t              high_water;       // Max occupancy since the last report
+};
+
+// Analysis thread state. Its stats only hold what was accumulated since the last harvest
+// by the reporting loop, which takes the lock to move them into the global totals.
+struct analysis_worker {
+    pthread_t         thread;
+    int               id;
+    struct desc_ring  ring;
+    struct rx_batch*  batch;        // Column buffers (no receive buffers)
+    pthread_mutex_t   lock;
+    struct data_stats stats;
+    atomic_size_t     processed;    // Descriptors accumulated so far (compared with ring head)
+    double            outage_factor;
+    const struct rx_variant* rx;    // Receive path variant selected at startup
+    atomic_int*       stop;
+};
+
+static int ring_init(struct desc_ring* r, size_t size) {
+    size_t cap = 1;
+    while (cap < size) cap <<= 1;
+    memset(r, 0, sizeof(*r));
+    r->mask  = cap - 1;
+    r->slots = (struct pkt_desc*)calloc(cap, sizeof(struct pkt_desc));
+    return r->slots ? 0 : -1;
+}
+
+// Push the decoded packets of a batch; waits (and counts a stall) while the ring is full
+static void ring_push_batch(struct desc_ring* r, const struct rx_batch* b, const int* idx, int n) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    int done = 0;
+    while (done < n) {
+        size_t tail  = atomic_load_explicit(&r->tail, memory_order_acquire);
+        size_t space = r->mask + 1 - (head - tail);
+        if (space == 0) {
+            atomic_fetch_add_explicit(&r->producer_stalls, 1, memory_order_relaxed);
+            sched_yield();
+            continue;
+        }
+        for (; done < n && space > 0; done++, space--, head++) {
+            int k = idx[done];
+            struct pkt_desc* d = &r->slots[head & r->mask];
+            d->seq           = b->seq[k];
+            d->size          = b->size[k];
+            d->reported_size = b->reported_size[k];
+            d->flags         = b->flags[k];
+            d->send_ts       = b->send_ts[k];
+            d->offset        = b->offset[k];
+            d->recv_ts       = b->recv_ts[k];
+            d->addr          = b->addrs[b->slot[k]];
+        }
+        atomic_store_explicit(&r->head, head, memory_order_release);
+
+        size_t used = head - tail;
+        if (used > atomic_load_explicit(&r->high_water, memory_order_relaxed)) {
+            atomic_store_explicit(&r->high_water, used, memory_order_relaxed);
+        }
+    }
+}
+
+// Pop up to RECV_BATCH descriptors into the columns of b, returns the number popped
+static int ring_pop_batch(struct desc_ring* r, struct rx_batch* b) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t n = head - tail;
+    if (n > RECV_BATCH) n = RECV_BATCH;
+    for (size_t i = 0; i < n; i++) {
+        const struct pkt_desc* d = &r->slots[(tail + i) & r->mask];
+        b->slot[i]          = (int32_t)i;
+        b->seq[i]           = d->seq;
+        b->size[i]          = d->size;
+        b->reported_size[i] = d->reported_size;
+        b->flags[i]         = d->flags;
+        b->send_ts[i]       = d->send_ts;
+        b->offset[i]        = d->offset;
+        b->recv_ts[i]       = d->recv_ts;
+        b->addrs[i]         = d->addr;
+    }
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    b->count = (int)n;
+    return (int)n;
+}
+
+// Move what a worker accumulated since the last harvest into the global stats
+static void data_stats_harvest(struct data_stats* dst, struct data_stats* src) {
+    dst->bytes_interval   += src->bytes_interval;
+    dst->total_bytes      += src->bytes_interval;
+    dst->total_packets    += src->total_packets;
+    dst->total_gaps       += src->total_gaps;
+    dst->negative_latency += src->negative_latency;
+    dst->outages          += src->outages;
+    dst->outage_time      += src->outage_time;
+    dst->outage_lost      += src->outage_lost;
+    for (int i = 0; i < src->n_outage_log && dst->n_outage_log < OUTAGE_LOG_MAX; i++) {
+        dst->outage_log[dst->n_outage_log++] = src->outage_log[i];
+    }
+    hist_add(&dst->lat_interval, &src->lat_interval);
+    size_fit_merge(&dst->size_fit, &src->size_fit);
+
+    src->bytes_interval   = 0;
+    src->total_bytes      = 0;
+    src->total_packets    = 0;
+    src->total_gaps       = 0;
+    src->negative_latency = 0;
+    src->outages          = 0;
+    src->outage_time      = 0.0;
+    src->outage_lost      = 0;
+    src->n_outage_log     = 0;
+    hist_reset(&src->lat_interval);
+}
+
+// Analysis thread: consumes descriptors and runs the column stage and debug output
+static void* analysis_thread(void* arg) {
+    struct analysis_worker* w = (struct analysis_worker*)arg;
+    struct rx_batch* b = w->batch;
+    int idle = 0;
+
+    while (!atomic_load_explicit(w->stop, memory_order_relaxed)) {
+        if (ring_pop_batch(&w->ring, b) == 0) {
+            // Spin briefly, then sleep so an idle analysis thread does not burn a core
+            if (++idle < 64) {
+                sched_yield();
+            } else {
+                atomic_fetch_add_explicit(&w->ring.consumer_waits, 1, memory_order_relaxed);
+                struct timespec ts = { .tv_sec = 0, .tv_nsec = 50000 };
+                nanosleep(&ts, NULL);
+            }
+            continue;
+        }
+        idle = 0;
+
+        w->rx->analyze(&w->stats, b, w->outage_factor, &w->lock);
+        atomic_fetch_add_explicit(&w->processed, (size_t)b->count, memory_order_release);
+    }
+    return NULL;
+}
+
+// Pick the analysis thread of a flow so each flow is analyzed in order by one thread
+static int flow_worker(const struct sockaddr_in* addr, int nworkers) {
+    uint32_t h = addr->sin_addr.s_addr ^ ((uint32_t)addr->sin_port * 2654435761u);
+    h ^= h >> 16;
+    return (int)(h % (uint32_t)nworkers);
+}
+
+// Packets answered by the I/O thread
+struct reply_stats {
+    uint64_t rr_requests;       // Request/response requests received
+    uint64_t rr_responses;      // Responses sent
+    uint64_t rr_dropped;        // Responses dropped (queue full or send error)
+    uint64_t echo_replies;      // In-band timestamp echoes sent
+};
+
+// A test session starts with a start marker or the first data packet and ends with an end
+// marker, an idle timeout, the next start marker or server shutdown. Statistics are reset
+// between sessions so back-to-back tests against one server do not blend together.
+struct session {
+    int     active;
+    int     id;                 // Sessions since server start
+    double  start;              // Start marker or first data packet time
+    double  last_packet;        // Last data packet time, for the idle timeout
+    int64_t sender_packets;     // Packets the client reported in its end marker, -1 if unknown
+    uint32_t end_paths;         // Dual-path streams: paths whose end marker has arrived
+};
+
+// Move the analysis threads' statistics into stats. With wait set, first let them finish
+// every descriptor already handed over, so nothing of the session is left in the rings.
+static void collect_worker_stats(struct data_stats* stats, struct analysis_worker* workers,
+                                 int nworkers, int wait) {
+    for (int wi = 0; wi < nworkers; wi++) {
+        struct analysis_worker* w = &workers[wi];
+        if (wait) {
+            size_t pushed = atomic_load_explicit(&w->ring.head, memory_order_acquire);
+            while (atomic_load_explicit(&w->processed, memory_order_acquire) < pushed) sched_yield();
+        }
+        pthread_mutex_lock(&w->lock);
+        data_stats_harvest(stats, &w->stats);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+// Print the outage events collected since the last report, times relative to the session start
+static void report_outages(struct data_stats* stats, const struct session* sess) {
+    for (int i = 0; i < stats->n_outage_log; i++) {
+        const struct outage_event* ev = &stats->outage_log[i];
+        printf("    Outage: %.3f-%.3f s, duration %.3f ms, %d packets lost (seq %d-%d)\n",
+               ev->start - sess->start, ev->end - sess->start, (ev->end - ev->start) * 1e3,
+               ev->lost, ev->seq_before, ev->seq_after);
+    }
+    stats->n_outage_log = 0;
+}
+
+static void session_begin(struct session* sess, double now) {
+    sess->active         = 1;
+    sess->id++;
+    sess->start          = now;
+    sess->last_packet    = now;
+    sess->sender_packets = -1;
+    sess->end_paths      = 0;
+    printf("=== Session %d started ===\n", sess->id);
+}
+
+#ifdef HAVE_ZLIB
+// Sends a snapshot of every session interval to the aggregator (-R). The data stats hold
+// session totals for everything but bytes and latency, so the reporter keeps the totals it
+// has already sent and reports the difference.
+struct stats_reporter {
+    int      sock;
+    struct sockaddr_in dst;
+    char     host[SNAPSHOT_HOST_LEN + 1];
+    int      session;               // Session of the reported totals below
+    uint64_t packets, gaps, outages, negative;
+    unsigned char buf[SNAPSHOT_MAX_SIZE];
+};
+
+static struct stats_reporter* stats_reporter_open(const char* spec, const char* name) {
+    struct stats_reporter* r = (struct stats_reporter*)calloc(1, sizeof(*r));
+    if (!r) {
+        perror("Failed to allocate the stats reporter");
+        return NULL;
+    }
+    char ip[INET_ADDRSTRLEN];
+    const char* colon = strchr(spec, ':');
+    size_t ip_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    int port = colon ? atoi(colon + 1) : STATS_PORT;
+    r->dst.sin_family = AF_INET;
+    r->dst.sin_port   = htons((uint16_t)port);
+    snprintf(ip, sizeof(ip), "%.*s", (int)ip_len, spec);
+    if (ip_len >= sizeof(ip) || port <= 0 || port > 65535 || inet_pton(AF_INET, ip, &r->dst.sin_addr) != 1) {
+        fprintf(stderr, "Error: Invalid aggregator address '%s' (expected ip[:port])\n", spec);
+        free(r);
+        return NULL;
+    }
+    if (name) {
+        snprintf(r->host, sizeof(r->host), "%s", name);
+    } else if (gethostname(r->host, sizeof(r->host)) < 0) {
+        snprintf(r->host, sizeof(r->host), "unknown");
+    }
+    r->host[SNAPSHOT_HOST_LEN] = '\0';
+    r->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (r->sock < 0) {
+        perror("stats reporter socket");
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static void stats_reporter_close(struct stats_reporter* r) {
+    if (!r) return;
+    close(r->sock);
+    free(r);
+}
+
+static void stats_reporter_send(struct stats_reporter* r, const struct data_stats* stats, int session,
+                                double start, double end) {
+    if (session != r->session) {
+        r->session  = session;
+        r->packets  = 0;
+        r->gaps     = 0;
+        r->outages  = 0;
+        r->negative = 0;
+    }
+    long hist_len = hist_encode_compressed(&stats->lat_interval, r->buf + SNAPSHOT_HEADER_SIZE,
+                                           sizeof(r->buf) - SNAPSHOT_HEADER_SIZE);
+    if (hist_len < 0) {
+        fprintf(stderr, "Warning: Latency histogram does not fit into a snapshot, sent without it\n");
+        hist_len = 0;
+    }
+    double rt_delta = realtime_to_monotonic_delta();
+    struct stats_snapshot snap = {
+        .session  = (uint32_t)session,
+        .hist_len = (uint32_t)hist_len,
+        .start    = start - rt_delta,
+        .end      = end - rt_delta,
+        .packets  = stats->total_packets - r->packets,
+        .bytes    = stats->bytes_interval,
+        .lost     = (uint64_t)stats->total_gaps - r->gaps,
+        .outages  = stats->outages - r->outages,
+        .negative = stats->negative_latency - r->negative,
+    };
+    memcpy(snap.host, r->host, sizeof(snap.host));
+    snapshot_encode(r->buf, &snap);
+    if (sendto(r->sock, r->buf, SNAPSHOT_HEADER_SIZE + (size_t)hist_len, 0,
+               (struct sockaddr*)&r->dst, sizeof(r->dst)) < 0) {
+        debug_print("Failed to send stats snapshot: %s\n", strerror(errno));
+    }
+    r->packets  = stats->total_packets;
+    r->gaps     = (uint64_t)stats->total_gaps;
+    r->outages  = stats->outages;
+    r->negative = stats->negative_latency;
+}
+#else
+struct stats_reporter;
+#endif
+
+// End a reporting interval: write its latency histogram to the histogram log and send its
+// snapshot to the aggregator (if any), then fold it into the session histogram
+static void close_interval(struct data_stats* stats, struct hist_log* hlog, struct stats_reporter* rep,
+                           int session, double start, double end) {
+#ifdef HAVE_ZLIB
+    if (hlog) hist_log_write(hlog, start, end, &stats->lat_interval);
+    if (rep) stats_reporter_send(rep, stats, session, start, end);
+#else
+    (void)hlog;
+    (void)rep;
+    (void)session;
+    (void)start;
+    (void)end;
+#endif
+    hist_add(&stats->lat_total, &stats->lat_interval);
+    hist_reset(&stats->lat_interval);
+}
+
+// Latency percentile in seconds for the SLO evaluation
+static double hist_percentile_sec(const void* ctx, double percentile) {
+    return hist_value_at_percentile((const struct latency_hist*)ctx, percentile) / 1e9;
+}
+
+// Print the final report of a session and reset all statistics for the next one.
+// The last, partial reporting interval started at interval_start. Returns the SLO_EXIT_*
+// code of the session's SLO evaluation (SLO_EXIT_PASS without SLOs).
+static int session_end(struct session* sess, struct data_stats* stats, struct reply_stats* replies,
+                       struct analysis_worker* workers, int nworkers, struct hist_log* hlog,
+                       struct stats_reporter* rep, double interval_start, const struct slo_set* slos,
+                       const char* reason) {
+    collect_worker_stats(stats, workers, nworkers, 1);
+    close_interval(stats, hlog, rep, sess->id, interval_start, monotonic_sec());
+    report_outages(stats, sess);
+
+    double duration = sess->last_packet - sess->start;
+    const struct latency_hist* h = &stats->lat_total;
+    printf("=== Session %d summary (ended by %s) ===\n", sess->id, reason);
+    printf("Duration: %.3f s, Packets received: %llu, Bytes: %llu, Average Throughput: %.3f Mbps\n",
+           duration, (unsigned long long)stats->total_packets, (unsigned long long)stats->total_bytes,
+           duration > 0 ? stats->total_bytes * 8.0 / duration / 1e6 : 0.0);
+    double loss;
+    int64_t lost, expected;
+    if (sess->sender_packets >= 0) {
+        expected = sess->sender_packets;
+        lost     = expected - (int64_t)stats->total_packets;
+        if (lost < 0) lost = 0;
+        loss = expected > 0 ? 100.0 * lost / expected : 0.0;
+        printf("Packets sent: %lld, Lost: %lld (%.3f%%), Sequence gaps: %d\n",
+               (long long)expected, (long long)lost, loss, stats->total_gaps);
+    } else {
+        expected = (int64_t)stats->total_packets + stats->total_gaps;
+        lost     = stats->total_gaps;
+        loss = expected > 0 ? 100.0 * lost / expected : 0.0;
+        printf("Sequence gaps: %d (%.3f%% loss, no end marker received)\n", stats->total_gaps, loss);
+    }
+    printf("Outages: %llu, total %.3f ms (%.3f%% of the session), packets lost during outages: %llu\n",
+           (unsigned long long)stats->outages, stats->outage_time * 1e3,
+           duration > 0 ? 100.0 * stats->outage_time / duration : 0.0,
+           (unsigned long long)stats->outage_lost);
+    if (h->total_count > 0) {
+        printf("Latency: min %.3f ms, mean %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+               h->min_value / 1e6, hist_mean(h) / 1e6,
+               hist_value_at_percentile(h, 50.0) / 1e6, hist_value_at_percentile(h, 90.0) / 1e6,
+               hist_value_at_percentile(h, 99.0) / 1e6, hist_value_at_percentile(h, 99.9) / 1e6,
+               h->max_value / 1e6);
+    }
+    if (stats->dual) {
+        dual_race_report(stats->dual, sess->sender_packets, loss, h);
+    }
+    if (stats->fec) {
+        fec_decoder_report(stats->fec, lost, expected, h);
+    }
+    if (stats->hops) {
+        hop_trail_report(stats->hops);
+    }
+    if (stats->relay) {
+        const struct relay* r = stats->relay;
+        printf("Relay: forwarded %llu datagrams to %s:%d and %llu responses back upstream, %llu data packets without a hop entry, %llu not sent\n",
+               (unsigned long long)(r->forwarded - r->returned), inet_ntoa(r->next.sin_addr), ntohs(r->next.sin_port),
+               (unsigned long long)r->returned, (unsigned long long)r->unstamped, (unsigned long long)r->failed);
+    }
+    size_fit_report(&stats->size_fit);     // The workers' fits were merged by collect_worker_stats
+    if (replies->rr_requests > 0) {
+        printf("Requests: %llu, Responses: %llu, Dropped responses: %llu\n",
+               (unsigned long long)replies->rr_requests, (unsigned long long)replies->rr_responses,
+               (unsigned long long)replies->rr_dropped);
+    }
+    if (replies->echo_replies > 0) {
+        printf("Timestamp echoes: %llu\n", (unsigned long long)replies->echo_replies);
+    }
+
+    int slo_rc = SLO_EXIT_PASS;
+    if (slos->count > 0) {
+        struct slo_measure m;
+        slo_measure_init(&m);
+        m.loss    = loss;
+        m.outages = (double)stats->outages;
+        if (duration > 0) {
+            m.throughput = stats->total_bytes * 8.0 / duration;
+            m.pps        = stats->total_packets / duration;
+            if (replies->rr_requests > 0) m.tps = replies->rr_responses / duration;
+        }
+        if (h->total_count > 0) {
+            m.lat_min        = h->min_value / 1e9;
+            m.lat_mean       = hist_mean(h) / 1e9;
+            m.lat_max        = h->max_value / 1e9;
+            m.lat_percentile = hist_percentile_sec;
+            m.lat_ctx        = h;
+        }
+        slo_rc = slo_evaluate(slos, &m, stdout);
+    }
+    fflush(stdout);
+
+    // Reset for the next session
+    hist_reset(&stats->lat_interval);
+    hist_reset(&stats->lat_total);
+    stats->bytes_interval   = 0;
+    stats->total_bytes      = 0;
+    stats->total_packets    = 0;
+    stats->last_seq         = -1;
+    stats->total_gaps       = 0;
+    stats->negative_latency = 0;
+    stats->capture_gaps     = 0;
+    stats->last_send_ts     = 0.0;
+    stats->last_recv_ts     = 0.0;
+    stats->send_interval    = 0.0;
+    stats->outages          = 0;
+    stats->outage_time      = 0.0;
+    stats->outage_lost      = 0;
+    memset(&stats->size_fit, 0, sizeof(stats->size_fit));
+    if (stats->dual) dual_race_reset(stats->dual);
+    if (stats->fec) fec_decoder_reset(stats->fec);
+    if (stats->hops) hop_trail_reset(stats->hops);
+    if (stats->relay) {
+        stats->relay->packets   = 0;
+        stats->relay->forwarded = 0;
+        stats->relay->unstamped = 0;
+        stats->relay->failed    = 0;
+        stats->relay->returned  = 0;
+    }
+    memset(replies, 0, sizeof(*replies));
+    for (int wi = 0; wi < nworkers; wi++) {
+        pthread_mutex_lock(&workers[wi].lock);
+        workers[wi].stats.last_seq      = -1;
+        workers[wi].stats.last_send_ts  = 0.0;
+        workers[wi].stats.last_recv_ts  = 0.0;
+        workers[wi].stats.send_interval = 0.0;
+        memset(&workers[wi].stats.size_fit, 0, sizeof(workers[wi].stats.size_fit));
+        workers[wi].stats.capture_gaps  = 0;
+        pthread_mutex_unlock(&workers[wi].lock);
+    }
+    sess->active = 0;
+    return slo_rc;
+}
+
+// Runtime-dispatched reference for --bench: the same stages with the features tested in the loops
+static __attribute__((noinline)) void rx_batch_process_generic(struct data_stats* st, struct rx_batch* b,
+                                                               int n, unsigned feat) {
+    rx_batch_decode_impl(b, n, feat);
+    rx_batch_analyze_impl(st, b, DEFAULT_OUTAGE_FACTOR, NULL, feat);
+}
+
+// Run a synthetic stream through every receive path variant and print the cost per packet,
+// for the specialized variant and for the same code with runtime feature checks
+static int run_rx_bench(void) {
+    struct rx_batch* b = (struct rx_batch*)calloc(1, sizeof(struct rx_batch));
+    struct data_stats st = {0};
+    if (b) b->bufs = (char*)calloc(RECV_BATCH, MAX_PACKET_SIZE);
+    if (!b || !b->bufs || hist_init(&st.lat_interval, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+        perror("Failed to allocate benchmark buffers");
+        return 1;
+    }
+    struct latency_hist hist = st.lat_interval;
+
+    // One flow of 1000-byte packets 10 us apart with about 1 ms of latency
+    for (int i = 0; i < RECV_BATCH; i++) {
+        b->pkts[i].buf  = b->bufs + (size_t)i * MAX_PACKET_SIZE;
+        b->pkts[i].len  = 1000;
+        b->pkts[i].cap  = MAX_PACKET_SIZE;
+        b->pkts[i].addr = &b->addrs[i];
+        b->addrs[i].sin_family      = AF_INET;
+        b->addrs[i].sin_port        = htons(40000);
+        b->addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+
+    // Per-packet records go to /dev/null so the capture variants measure formatting, not the terminal
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (saved_stderr < 0 || devnull < 0 || dup2(devnull, STDERR_FILENO) < 0) {
+        perror("Failed to redirect stderr");
+        return 1;
+    }
+
+    double ns[RX_FEAT_VARIANTS][2];
+    for (unsigned feat = 0; feat < RX_FEAT_VARIANTS; feat++) {
+        for (int generic = 0; generic < 2; generic++) {
+            hist_reset(&hist);
+            memset(&st, 0, sizeof(st));
+            st.lat_interval = hist;
+            st.last_seq     = -1;
+
+            double elapsed = 0.0;
+            int32_t seq = 0;
+            for (int k = 0; k < BENCH_WARMUP + BENCH_BATCHES; k++) {
+                for (int i = 0; i < RECV_BATCH; i++, seq++) {
+                    struct pkt_header hdr = {
+                        .seq = seq, .send_ts = 100.0 + seq * 1e-5, .offset = 0.0,
+                        .packet_size = 1000, .flags = 0
+                    };
+                    pkt_header_encode(b->pkts[i].buf, &hdr);
+                    b->pkts[i].rx_ts = hdr.send_ts + 1e-3 + (seq % 7) * 1e-6;
+                }
+                b->count = 0;
+                b->nctrl = 0;
+
+                double t0 = monotonic_sec();
+                if (generic) {
+                    rx_batch_process_generic(&st, b, RECV_BATCH, feat);
+                } else {
+                    rx_variants[feat].decode(b, RECV_BATCH);
+                    rx_variants[feat].analyze(&st, b, DEFAULT_OUTAGE_FACTOR, NULL);
+                }
+                if (k >= BENCH_WARMUP) elapsed += monotonic_sec() - t0;
+            }
+            ns[feat][generic] = elapsed / ((double)BENCH_BATCHES * RECV_BATCH) * 1e9;
+        }
+    }
+
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(devnull);
+
+    printf("Receive path benchmark: %d batches of %d packets per variant, records to /dev/null\n",
+           BENCH_BATCHES, RECV_BATCH);
+    printf("Timestamps  Capture  Histogram  Specialized ns/pkt  Runtime checks ns/pkt\n");
+    for (unsigned feat = 0; feat < RX_FEAT_VARIANTS; feat++) {
+        printf("%-10s  %-7s  %-9s  %18.1f  %21.1f\n",
+               (feat & RX_FEAT_KERNEL_TS) ? "kernel" : "user",
+               (feat & RX_FEAT_CAPTURE) ? "on" : "off",
+               (feat & RX_FEAT_HIST) ? "on" : "off",
+               ns[feat][0], ns[feat][1]);
+    }
+
+    hist_free(&hist);
+    free(b->bufs);
+    free(b);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    struct server_config cfg = {
+        .response_size    = 0,
+        .service_time     = 0.0,
+        .analysis_threads = 0,
+        .ring_size        = DEFAULT_RING_SIZE,
+        .xdp_ifname       = NULL,
+        .xdp_obj          = NULL,
+        .idle_timeout     = DEFAULT_IDLE_TIMEOUT,
+        .outage_factor    = DEFAULT_OUTAGE_FACTOR,
+        .engine           = DEFAULT_ENGINE,
+        .hist_log         = NULL,
+        .report_to        = NULL,
+        .report_name      = NULL,
+        .bind_addr        = { .s_addr = INADDR_ANY },
+        .slos             = { .count = 0 },
+        .once             = 0,
+        .rx_features      = RX_FEAT_KERNEL_TS | RX_FEAT_HIST | (DEBUG ? RX_FEAT_CAPTURE : 0),
+        .bench            = 0,
+    };
+
+    int opt;
+    static const struct option long_options[] = {
+        { "engine",       required_argument, NULL, 'e' },
+        { "timestamps",   required_argument, NULL, 'T' },
+        { "no-capture",   no_argument,       NULL, 'N' },
+        { "no-histogram", no_argument,       NULL, 'H' },
+        { "hist-log",     required_argument, NULL, 'L' },
+        { "report-to",    required_argument, NULL, 'R' },
+        { "report-name",  required_argument, NULL, 'n' },
+        { "address",      required_argument, NULL, 'a' },
+        { "relay",        required_argument, NULL, 'F' },
+        { "slo",          required_argument, NULL, 'S' },
+        { "once",         no_argument,       NULL, '1' },
+        { "bench",        no_argument,       NULL, 'B' },
+        { "help",         no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    while ((opt = getopt_long(argc, argv, "r:d:A:q:I:O:X:P:e:T:NHL:R:a:F:S:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'r':
+                cfg.response_size = atoi(optarg);
+                if (cfg.response_size < HEADER_SIZE || cfg.response_size > MAX_PACKET_SIZE) {
+                    fprintf(stderr, "Error: Response size must be between %d and %d bytes\n",
+                            HEADER_SIZE, MAX_PACKET_SIZE);
+                    return 1;
+                }
+                break;
+            case 'd':
+                cfg.service_time = atof(optarg) * 1e-6;
+                if (cfg.service_time < 0) {
+                    fprintf(stderr, "Error: Service time must not be negative\n");
+                    return 1;
+                }
+                break;
+            case 'A':
+                cfg.analysis_threads = atoi(optarg);
+                if (cfg.analysis_threads < 0 || cfg.analysis_threads > MAX_ANALYSIS_THREADS) {
+                    fprintf(stderr, "Error: Analysis threads must be between 0 and %d\n", MAX_ANALYSIS_THREADS);
+                    return 1;
+                }
+                break;
+            case 'q':
+                cfg.ring_size = (size_t)atol(optarg);
+                if (cfg.ring_size < RECV_BATCH) {
+                    fprintf(stderr, "Error: Ring size must be at least %d\n", RECV_BATCH);
+                    return 1;
+                }
+                break;
+            case 'I':
+                cfg.idle_timeout = atof(optarg);
+                if (cfg.idle_timeout <= 0) {
+                    fprintf(stderr, "Error: Idle timeout must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'O':
+                cfg.outage_factor = atof(optarg);
+                if (cfg.outage_factor <= 1.0) {
+                    fprintf(stderr, "Error: Outage factor must be greater than 1\n");
+                    return 1;
+                }
+                break;
+            case 'X':
+                cfg.xdp_ifname = optarg;
+                break;
+            case 'P':
+                cfg.xdp_obj = optarg;
+                break;
+            case 'e':
+                cfg.engine = optarg;
+                if (!io_engine_find(cfg.engine)) {
+                    fprintf(stderr, "Error: Unknown I/O engine '%s'\n", cfg.engine);
+                    return 1;
+                }
+                break;
+            case 'T':
+                if (strcmp(optarg, "kernel") == 0) {
+                    cfg.rx_features |= RX_FEAT_KERNEL_TS;
+                } else if (strcmp(optarg, "user") == 0) {
+                    cfg.rx_features &= ~RX_FEAT_KERNEL_TS;
+                } else {
+                    fprintf(stderr, "Error: Timestamp source must be kernel or user\n");
+                    return 1;
+                }
+                break;
+            case 'N':
+                cfg.rx_features &= ~RX_FEAT_CAPTURE;
+                break;
+            case 'H':
+                cfg.rx_features &= ~RX_FEAT_HIST;
+                break;
+            case 'L':
+                cfg.hist_log = optarg;
+                break;
+            case 'R':
+                cfg.report_to = optarg;
+                break;
+            case 'n':
+                if (strlen(optarg) > SNAPSHOT_HOST_LEN) {
+                    fprintf(stderr, "Error: Report name must be at most %d characters\n", SNAPSHOT_HOST_LEN);
+                    return 1;
+                }
+                cfg.report_name = optarg;
+                break;
+            case 'a':
+                if (inet_pton(AF_INET, optarg, &cfg.bind_addr) != 1) {
+                    fprintf(stderr, "Error: Invalid bind address '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'F':
+                cfg.relay_to = optarg;
+                break;
+            case 'S':
+                if (slo_parse(&cfg.slos, optarg) < 0) return 1;
+                break;
+            case '1':
+                cfg.once = 1;
+                break;
+            case 'B':
+                cfg.bench = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (cfg.bench) {
+        return run_rx_bench();
+    }
+    if (cfg.relay_to && cfg.xdp_ifname) {
+        fprintf(stderr, "Error: Relay mode needs the packets in user space, it cannot be used with -X\n");
+        return 1;
+    }
+
+    // Receive path variant for the selected features
+    const struct rx_variant* rx = &rx_variants[cfg.rx_features];
+
     // --- 1. Initialize Statistics Variables ---
-    double start_sec    = monotonic_sec();  // Test start time
+    double start_sec    = monotonic_sec();  // Server start time (XDP mode reports)
     double last_sec     = start_sec;        // Last throughput output time
-    uint64_t bytes_interval = 0;            // Current interval bytes
-    uint64_t total_bytes    = 0;            // Total received bytes
-    uint64_t sync_requests  = 0;            // Clock sync request counter
-    uint64_t total_packets  = 0;            // Total received packets counter
-    int last_seq = -1;                      // Last sequence number (for gap detection)
-    int total_gaps = 0;                     // Count of sequence gaps
+    struct session session = { .active = 0, .id = 0 };  // Current test session
+    struct data_stats stats = { .last_seq = -1 };   // Data stream statistics of the session
+    struct sync_stats sync_stats = {0};     // Clock sync request counters
+    struct reply_stats replies = {0};       // Requests and echoes answered in the session
+    int slo_status = SLO_EXIT_PASS;         // Worst SLO result of all sessions, the exit code
 
     printf("UDP Toolkit Server started - Clock Sync Port: %d, Data Port: %d\n", SYNC_PORT, DATA_PORT);
     debug_print("Debug mode enabled\n");
@@ -80,10 +2131,15 @@ int main() {
     struct sockaddr_in sync_addr = {0};
     sync_addr.sin_family      = AF_INET;
     sync_addr.sin_port        = htons(SYNC_PORT);
-    sync_addr.sin_addr.s_addr = INADDR_ANY;
+    sync_addr.sin_addr        = cfg.bind_addr;
     if (bind(sync_sock, (struct sockaddr*)&sync_addr, sizeof(sync_addr)) < 0) {
         perror("sync bind"); close(sync_sock); return 1;
     }
+    // Kernel receive timestamps give each sync request its own t2
+    int enable = 1;
+    if (setsockopt(sync_sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        perror("setsockopt SO_TIMESTAMPNS");
+    }
     debug_print("Clock sync socket bound to port %d\n", SYNC_PORT);
 
     // --- 3. Create and bind DATA socket ---
@@ -92,108 +2148,322 @@ int main() {
     struct sockaddr_in data_addr = {0};
     data_addr.sin_family      = AF_INET;
     data_addr.sin_port        = htons(DATA_PORT);
-    data_addr.sin_addr.s_addr = INADDR_ANY;
+    data_addr.sin_addr        = cfg.bind_addr;
     if (bind(data_sock, (struct sockaddr*)&data_addr, sizeof(data_addr)) < 0) {
         perror("data bind"); close(data_sock); return 1;
     }
     debug_print("Data socket bound to port %d\n", DATA_PORT);
 
-    // 分配接收缓冲区（最大大小）
-    char* recv_buffer = (char*)malloc(MAX_PACKET_SIZE);
-    if (!recv_buffer) {
+    // The I/O engine enables kernel receive timestamps on the data socket
+    struct io_engine engine;
+    if (io_engine_open(&engine, cfg.engine, data_sock) < 0) {
+        close(sync_sock);
+        close(data_sock);
+        return 1;
+    }
+    printf("Data path I/O engine: %s\n", engine.ops->name);
+    printf("Receive path: %s timestamps, packet capture %s, histograms %s\n",
+           (cfg.rx_features & RX_FEAT_KERNEL_TS) ? "kernel" : "user",
+           (cfg.rx_features & RX_FEAT_CAPTURE) ? "on" : "off",
+           (cfg.rx_features & RX_FEAT_HIST) ? "on" : "off");
+
+    // 分配接收缓冲区（每批RECV_BATCH个最大大小的包）
+    struct rx_batch* rxb = (struct rx_batch*)calloc(1, sizeof(struct rx_batch));
+    char* resp_buffer = (char*)calloc(1, MAX_PACKET_SIZE);
+    struct response_queue resp_queue = {
+        .items = calloc(MAX_PENDING_RESPONSES, sizeof(struct pending_response))
+    };
+    if (rxb) rxb->bufs = (char*)malloc((size_t)RECV_BATCH * MAX_PACKET_SIZE);
+    if (!rxb || !rxb->bufs || !resp_buffer || !resp_queue.items ||
+        hist_init(&stats.lat_interval, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0 ||
+        hist_init(&stats.lat_total, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
         perror("Failed to allocate receive buffer");
+        if (rxb) free(rxb->bufs);
+        free(rxb);
+        free(resp_buffer);
+        free(resp_queue.items);
+        hist_free(&stats.lat_interval);
+        hist_free(&stats.lat_total);
+        io_engine_close(&engine);
         close(sync_sock);
         close(data_sock);
         return 1;
     }
 
+    // --- 3.1 Shut down cleanly on Ctrl+C / SIGTERM ---
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // --- 3.2 Attach the XDP counting sink ---
+#ifdef HAVE_LIBBPF
+    struct xdp_sink* xdp = NULL;
+    if (cfg.xdp_ifname) {
+        xdp = xdp_sink_open(cfg.xdp_ifname, cfg.xdp_obj);
+        if (!xdp) return 1;
+    }
+#else
+    if (cfg.xdp_ifname) {
+        fprintf(stderr, "Error: XDP sink mode is not available (built without libbpf)\n");
+        return 1;
+    }
+#endif
+
+    // --- 3.3 Open the HdrHistogram interval log ---
+    struct hist_log* hlog = NULL;
+#ifdef HAVE_ZLIB
+    if (cfg.hist_log) {
+        hlog = hist_log_open(cfg.hist_log, start_sec);
+        if (!hlog) return 1;
+        printf("Histogram log: %s\n", cfg.hist_log);
+    }
+#else
+    if (cfg.hist_log) {
+        fprintf(stderr, "Error: Histogram logs are not available (built without zlib)\n");
+        return 1;
+    }
+#endif
+
+    // --- 3.3.1 Relay mode: next hop and its clock offset ---
+    if (cfg.relay_to) {
+        stats.relay = relay_create(cfg.relay_to);
+        if (!stats.relay) return 1;
+        printf("Relay mode: forwarding data packets to %s\n", cfg.relay_to);
+    }
+
+    // --- 3.3.2 Interval snapshots for the aggregator ---
+    struct stats_reporter* reporter = NULL;
+#ifdef HAVE_ZLIB
+    if (cfg.report_to) {
+        reporter = stats_reporter_open(cfg.report_to, cfg.report_name);
+        if (!reporter) return 1;
+        printf("Reporting interval snapshots as '%s' to %s\n", reporter->host, cfg.report_to);
+    }
+#else
+    if (cfg.report_to) {
+        fprintf(stderr, "Error: Snapshot reporting is not available (built without zlib)\n");
+        return 1;
+    }
+#endif
+
+    // --- 3.4 Start analysis threads (signals stay with the main thread) ---
+    sigset_t block, old_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old_mask);
+
+    struct analysis_worker workers[MAX_ANALYSIS_THREADS];
+    atomic_int stop_workers = 0;
+    int nworkers = 0;
+    for (; nworkers < cfg.analysis_threads; nworkers++) {
+        struct analysis_worker* w = &workers[nworkers];
+        memset(w, 0, sizeof(*w));
+        w->id             = nworkers;
+        w->stop           = &stop_workers;
+        w->stats.last_seq = -1;
+        w->outage_factor  = cfg.outage_factor;
+        w->rx             = rx;
+        w->batch          = (struct rx_batch*)calloc(1, sizeof(struct rx_batch));
+        if (!w->batch || ring_init(&w->ring, cfg.ring_size) < 0 ||
+            hist_init(&w->stats.lat_interval, HIST_HIGHEST_VALUE, HIST_SIGNIFICANT_DIGITS) < 0) {
+            perror("Failed to allocate analysis ring");
+            return 1;
+        }
+        pthread_mutex_init(&w->lock, NULL);
+        if (pthread_create(&w->thread, NULL, analysis_thread, w) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    if (nworkers > 0) {
+        printf("Analysis threads: %d, ring size: %zu descriptors\n", nworkers, workers[0].ring.mask + 1);
+    }
+
     // --- 4. Main loop: select to monitor SYNC and DATA ---
     fd_set readfds;
     int maxfd = (sync_sock > data_sock ? sync_sock : data_sock) + 1;
     debug_print("Server main loop started...\n");
     
-    while (1) {
+    while (running && !(cfg.once && session.id > 0 && !session.active)) {
         FD_ZERO(&readfds);
         FD_SET(sync_sock, &readfds);
         FD_SET(data_sock, &readfds);
 
-        if (select(maxfd, &readfds, NULL, NULL, NULL) < 0) {
+        // Wake up for the next due response when service time is simulated, and for the
+        // next report in XDP mode where data packets never reach the socket, and for the
+        // idle timeout of the current session
+        struct timeval tv, *timeout = NULL;
+        double wake = -1.0;
+        if (resp_queue.count > 0) wake = resp_queue.items[resp_queue.head].due;
+        if (cfg.xdp_ifname && (wake < 0 || last_sec + 1.0 < wake)) wake = last_sec + 1.0;
+        if (session.active) {
+            double idle_end = session.last_packet + cfg.idle_timeout;
+            if (wake < 0 || idle_end < wake) wake = idle_end;
+        }
+        if (wake >= 0) {
+            double wait = wake - monotonic_sec();
+            if (wait < 0) wait = 0;
+            tv.tv_sec  = (time_t)wait;
+            tv.tv_usec = (suseconds_t)((wait - (time_t)wait) * 1e6);
+            timeout = &tv;
+        }
+
+        if (select(maxfd, &readfds, NULL, NULL, timeout) < 0) {
+            if (errno == EINTR) continue;
             perror("select");
             break;
         }
 
         // --- 4.1 Handle clock synchronization requests ---
         if (FD_ISSET(sync_sock, &readfds)) {
-            struct sockaddr_in cli;
-            socklen_t len = sizeof(cli);
-            
-            handle_time_sync(sync_sock, &cli, len);
+            handle_time_sync(sync_sock, &sync_stats);
         }
 
         // --- 4.2 Handle data packet reception and latency calculation ---
         if (FD_ISSET(data_sock, &readfds)) {
-            struct sockaddr_in cli;
-            socklen_t len = sizeof(cli);
-            ssize_t n = recvfrom(data_sock, recv_buffer, MAX_PACKET_SIZE, 0,
-                                 (struct sockaddr*)&cli, &len);
-            
-            // Verify packet contains at least the header
-            if (n >= HEADER_SIZE) {
-                // --- 4.2.1 Get reception timestamp ---
-                double recv_sec = monotonic_sec();
-                total_packets++;
-
-                // --- 4.2.2 Parse seq, send_ts, offset, and packet_size ---
-                int    seq, reported_size;
-                double send_ts, offset;
-                size_t pos = 0;
-                
-                memcpy(&seq,          recv_buffer + pos, sizeof(seq));      pos += sizeof(seq);
-                memcpy(&send_ts,      recv_buffer + pos, sizeof(send_ts));  pos += sizeof(send_ts);
-                memcpy(&offset,       recv_buffer + pos, sizeof(offset));   pos += sizeof(offset);
-                memcpy(&reported_size, recv_buffer + pos, sizeof(reported_size));
-
-                // Check for sequence number gaps
-                if (last_seq != -1 && seq != last_seq + 1) {
-                    int gap_size = seq - last_seq - 1;
-                    if (gap_size > 0) {
-                        total_gaps += gap_size;
-                        debug_print("Sequence gap detected: %d packets missing between %d and %d\n", 
-                                   gap_size, last_seq, seq);
+            int received;
+            while ((received = rx_batch_receive(&engine, rxb, rx)) > 0) {
+                // Control markers split the batch into segments, handled in arrival order so a
+                // batch holding the end of one session and the start of the next keeps them apart
+                int ncols = rxb->count;
+                for (int c = 0, seg_start = 0; c <= rxb->nctrl; c++) {
+                    int seg_end = c < rxb->nctrl ? rxb->ctrl_pos[c] : ncols;
+                    rx_batch_segment(rxb, seg_start, seg_end);
+                    seg_start = seg_end;
+
+                    // --- 4.2.1 Session start by the first data packet without a marker ---
+                    if (rxb->count > 0) {
+                        if (!session.active) {
+                            session_begin(&session, rxb->recv_ts[0]);
+                            last_sec = rxb->recv_ts[0];
+                        }
+                        session.last_packet = rxb->recv_ts[rxb->count - 1];
+                    }
+
+                    // --- 4.2.2 Relayed streams: split the delay and loss by segment ---
+                    uint32_t batch_flags = 0;
+                    for (int i = 0; i < rxb->count; i++) batch_flags |= rxb->flags[i];
+                    if (batch_flags & PKT_FLAG_HOP_TRAIL) {
+                        if (!stats.hops && !(stats.hops = hop_trail_create())) {
+                            perror("Failed to allocate the hop trail breakdown");
+                            running = 0;
+                        }
+                        if (stats.hops) hop_trail_batch(stats.hops, rxb);
+                    }
+
+                    // --- 4.2.3 Relay mode: forward the segment to the next hop (rewrites the trails) ---
+                    if (stats.relay) relay_forward(stats.relay, &engine, rxb);
+
+                    // --- 4.2.4 Packets that need an answer (relays leave requests to the final receiver) ---
+                    for (int i = 0; i < rxb->count; i++) {
+                        // The columns keep the flags as received, the relay may have rewritten the header
+                        uint32_t ask = rxb->flags[i] & (stats.relay ? PKT_FLAG_ECHO_REQ : PKT_FLAG_ECHO_REQ | PKT_FLAG_REQUEST);
+                        if (!ask) continue;
+
+                        struct pkt_header hdr;
+                        pkt_header_decode(rxb->bufs + (size_t)rxb->slot[i] * MAX_PACKET_SIZE, &hdr);
+                        struct sockaddr_in* cli = &rxb->addrs[rxb->slot[i]];
+
+                        // Echo timestamps for in-band clock sync
+                        if (ask & PKT_FLAG_ECHO_REQ) {
+                            send_echo_reply(&engine, resp_buffer, &hdr, rxb->recv_ts[i], cli);
+                            replies.echo_replies++;
+                        }
+
+                        // Answer closed-loop requests on the same socket
+                        if (ask & PKT_FLAG_REQUEST) {
+                            struct pending_response resp = { .addr = *cli, .hdr = hdr, .due = rxb->recv_ts[i] + cfg.service_time };
+                            resp.hdr.flags       = PKT_FLAG_RESPONSE;
+                            resp.hdr.packet_size = cfg.response_size > 0 ? cfg.response_size : rxb->size[i];
+                            replies.rr_requests++;
+
+                            if (cfg.service_time <= 0 && resp_queue.count == 0) {
+                                if (send_response(&engine, resp_buffer, &resp) < 0) replies.rr_dropped++;
+                                else replies.rr_responses++;
+                            } else if (resp_queue.count < MAX_PENDING_RESPONSES) {
+                                size_t tail = (resp_queue.head + resp_queue.count) % MAX_PENDING_RESPONSES;
+                                resp_queue.items[tail] = resp;
+                                resp_queue.count++;
+                            } else {
+                                replies.rr_dropped++;
+                                debug_print("Response queue full, dropping response for seq=%d\n", hdr.seq);
+                            }
+                        }
+                    }
+
+                    // --- 4.2.5 Dual-path streams: keep the first copy of each sequence number ---
+                    if (batch_flags & PKT_FLAGS_PATH) {
+                        if (!stats.dual && !(stats.dual = dual_race_create())) {
+                            perror("Failed to allocate the dual-path race");
+                            running = 0;
+                        }
+                        if (stats.dual) dual_race_batch(stats.dual, rxb);
+                    }
+
+                    // --- 4.2.6 FEC streams: rebuild lost packets, take the parity packets out ---
+                    if (batch_flags & (PKT_FLAG_FEC_DATA | PKT_FLAG_FEC_PARITY)) {
+                        if (!stats.fec && !(stats.fec = fec_decoder_create())) {
+                            perror("Failed to allocate the FEC decoder");
+                            running = 0;
+                        }
+                        if (stats.fec) fec_decoder_batch(stats.fec, rxb);
+                    }
+
+                    // --- 4.2.7 Statistics: hand off to the analysis threads or run inline ---
+                    if (nworkers > 0) {
+                        int idx[MAX_ANALYSIS_THREADS][RECV_BATCH];
+                        int cnt[MAX_ANALYSIS_THREADS] = {0};
+                        for (int i = 0; i < rxb->count; i++) {
+                            int wi = flow_worker(&rxb->addrs[rxb->slot[i]], nworkers);
+                            idx[wi][cnt[wi]++] = i;
+                        }
+                        for (int wi = 0; wi < nworkers; wi++) {
+                            if (cnt[wi] > 0) ring_push_batch(&workers[wi].ring, rxb, idx[wi], cnt[wi]);
+                        }
+                    } else {
+                        // Column stage: latency, gaps and histogram buckets
+                        rx->analyze(&stats, rxb, cfg.outage_factor, NULL);
+                    }
+
+                    // --- 4.2.8 Control marker after the segment: session start or end ---
+                    if (c == rxb->nctrl) continue;
+                    if (stats.relay) relay_forward_marker(stats.relay, &engine, rxb, c);
+                    if (rxb->ctrl_flags[c] & PKT_FLAG_SESSION_START) {
+                        if (session.active) {
+                            slo_status = slo_combine(slo_status, session_end(&session, &stats, &replies, workers, nworkers,
+                                                                             hlog, reporter, last_sec, &cfg.slos, "new session"));
+                        }
+                        session_begin(&session, rxb->ctrl_ts[c]);
+                        last_sec = rxb->ctrl_ts[c];
+                    } else if ((rxb->ctrl_flags[c] & PKT_FLAG_SESSION_END) && session.active) {
+                        // The end marker carries the number of packets sent. A dual-path client
+                        // sends it over both paths: wait for the slower path's last copies (or
+                        // the idle timeout) instead of letting them start a new session.
+                        session.sender_packets = rxb->ctrl_seq[c];
+                        session.end_paths |= rxb->ctrl_flags[c] & PKT_FLAGS_PATH;
+                        if (session.end_paths && session.end_paths != PKT_FLAGS_PATH) continue;
+                        slo_status = slo_combine(slo_status, session_end(&session, &stats, &replies, workers, nworkers,
+                                                                         hlog, reporter, last_sec, &cfg.slos, "end marker"));
                     }
                 }
-                last_seq = seq;
-
-                // --- 4.2.3 Calculate and print one-way latency (milliseconds) ---
-                double latency = recv_sec - (send_ts + offset);
-                debug_print("Seq=%d, Size=%d bytes, Latency=%.6f ms\n",
-                       seq, (int)n, fabs(latency) * 1e3);
-                
-                // Verify reported packet size matches actual received size
-                if (reported_size != n) {
-                    debug_print("Warning: Reported packet size (%d) differs from received size (%zd)\n",
-                               reported_size, n);
-                }
-                
-                if (DEBUG && seq % 1000 == 0) {
-                    char client_ip[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &(cli.sin_addr), client_ip, INET_ADDRSTRLEN);
-                    debug_print("Packet details (seq=%d):\n", seq);
-                    debug_print("  → Source: %s:%d\n", client_ip, ntohs(cli.sin_port));
-                    debug_print("  → Send time: %.9f\n", send_ts);
-                    debug_print("  → Offset: %.9f\n", offset);
-                    debug_print("  → Reported size: %d bytes\n", reported_size);
-                    debug_print("  → Actual received size: %zd bytes\n", n);
-                    debug_print("  → Receive time: %.9f\n", recv_sec);
-                    debug_print("  → Total sequence gaps: %d\n", total_gaps);
-                }
-
-                // --- 4.2.4 Accumulate byte statistics ---
-                bytes_interval += (uint64_t)n;
-                total_bytes    += (uint64_t)n;
-            } else {
-                debug_print("Received invalid data packet (size: %zd, min expected: %d)\n", 
-                           n, HEADER_SIZE);
+
+                if (received < RECV_BATCH) break;
+            }
+        }
+
+        // --- 4.3 Send responses whose simulated service time has elapsed ---
+        if (resp_queue.count > 0) {
+            double now_sec = monotonic_sec();
+            while (resp_queue.count > 0 && resp_queue.items[resp_queue.head].due <= now_sec) {
+                if (send_response(&engine, resp_buffer, &resp_queue.items[resp_queue.head]) < 0) replies.rr_dropped++;
+                else replies.rr_responses++;
+                resp_queue.head = (resp_queue.head + 1) % MAX_PENDING_RESPONSES;
+                resp_queue.count--;
             }
         }
 
@@ -202,30 +2472,114 @@ int main() {
             double now_sec = monotonic_sec();
             if (now_sec - last_sec >= 1.0) {
                 double interval = now_sec - last_sec;           // Real elapsed time
-                // bps = bits / sec
-                double sample_tps = (bytes_interval * 8.0) / interval;
-                double avg_tps    = (total_bytes   * 8.0) / (now_sec - start_sec);
-
-                printf("[%.0f-%.0f s] Sample Throughput: %.3f Mbps, "
-                       "Average Throughput: %.3f Mbps\n",
-                       last_sec - start_sec,
-                       now_sec  - start_sec,
-                       sample_tps / 1e6,
-                       avg_tps / 1e6);
+                collect_worker_stats(&stats, workers, nworkers, 0);
+                if (session.active) {
+                    // bps = bits / sec
+                    double sample_tps = (stats.bytes_interval * 8.0) / interval;
+                    double avg_tps    = (stats.total_bytes   * 8.0) / (now_sec - session.start);
+
+                    printf("[%.0f-%.0f s] Sample Throughput: %.3f Mbps, "
+                           "Average Throughput: %.3f Mbps\n",
+                           last_sec - session.start,
+                           now_sec  - session.start,
+                           sample_tps / 1e6,
+                           avg_tps / 1e6);
+                    if (stats.lat_interval.total_count > 0) {
+                        const struct latency_hist* h = &stats.lat_interval;
+                        printf("    Latency: min %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms (%lld packets)\n",
+                               h->min_value / 1e6, hist_value_at_percentile(h, 50.0) / 1e6,
+                               hist_value_at_percentile(h, 99.0) / 1e6, h->max_value / 1e6,
+                               (long long)h->total_count);
+                    }
+                    report_outages(&stats, &session);
+                }
+#ifdef HAVE_LIBBPF
+                if (xdp) {
+                    printf("[%.0f-%.0f s] XDP sink\n", last_sec - start_sec, now_sec - start_sec);
+                    xdp_sink_report(xdp, interval);
+                }
+#endif
+                for (int wi = 0; wi < nworkers && session.active; wi++) {
+                    struct desc_ring* r = &workers[wi].ring;
+                    size_t used = atomic_load(&r->head) - atomic_load(&r->tail);
+                    printf("    Ring %d: occupancy %zu/%zu (max %zu), producer stalls %llu, consumer waits %llu\n",
+                           wi, used, r->mask + 1, atomic_exchange(&r->high_water, used),
+                           (unsigned long long)atomic_load(&r->producer_stalls),
+                           (unsigned long long)atomic_load(&r->consumer_waits));
+                }
+                if (sync_stats.interval > 0) {
+                    printf("    Sync: %.0f req/s, Response latency avg %.3f us, max %.3f us, Total: %llu\n",
+                           sync_stats.interval / interval,
+                           sync_stats.latency_sum / sync_stats.interval * 1e6,
+                           sync_stats.latency_max * 1e6,
+                           (unsigned long long)sync_stats.total);
+                }
+                if (replies.rr_requests > 0) {
+                    printf("    Requests: %llu, Responses: %llu, Dropped responses: %llu, Pending: %zu\n",
+                           (unsigned long long)replies.rr_requests, (unsigned long long)replies.rr_responses,
+                           (unsigned long long)replies.rr_dropped, resp_queue.count);
+                }
                        
-                debug_print("Stats update: packets=%llu, bytes=%llu, gaps=%d, interval_bytes=%llu, total_bytes=%llu\n",
-                           total_packets, total_bytes, total_gaps, bytes_interval, total_bytes);
+                if (session.active) {
+                    debug_print("Stats update: packets=%llu, bytes=%llu, gaps=%d, interval_bytes=%llu, total_bytes=%llu, echo_replies=%llu, negative_latency=%llu\n",
+                               stats.total_packets, stats.total_bytes, stats.total_gaps, stats.bytes_interval,
+                               stats.total_bytes, replies.echo_replies, stats.negative_latency);
+                }
 
-                // Reset sampling interval
-                bytes_interval = 0;
+                // Reset sampling interval (only session intervals go to the histogram log)
+                close_interval(&stats, session.active ? hlog : NULL, session.active ? reporter : NULL,
+                               session.id, last_sec, now_sec);
+                stats.bytes_interval = 0;
+                sync_stats.interval    = 0;
+                sync_stats.latency_sum = 0.0;
+                sync_stats.latency_max = 0.0;
                 last_sec       = now_sec;
             }
         }
+
+        // --- 6. End the session after the idle timeout ---
+        if (session.active && monotonic_sec() - session.last_packet >= cfg.idle_timeout) {
+            slo_status = slo_combine(slo_status, session_end(&session, &stats, &replies, workers, nworkers,
+                                                             hlog, reporter, last_sec, &cfg.slos, "idle timeout"));
+        }
     }
 
+    if (session.active) {
+        slo_status = slo_combine(slo_status, session_end(&session, &stats, &replies, workers, nworkers,
+                                                         hlog, reporter, last_sec, &cfg.slos, "shutdown"));
+    }
     debug_print("Server shutting down...\n");
-    free(recv_buffer);
+#ifdef HAVE_LIBBPF
+    xdp_sink_close(xdp);
+#endif
+#ifdef HAVE_ZLIB
+    hist_log_close(hlog);
+    stats_reporter_close(reporter);
+#endif
+    atomic_store(&stop_workers, 1);
+    for (int wi = 0; wi < nworkers; wi++) {
+        pthread_join(workers[wi].thread, NULL);
+        pthread_mutex_destroy(&workers[wi].lock);
+        hist_free(&workers[wi].stats.lat_interval);
+        free(workers[wi].ring.slots);
+        free(workers[wi].batch);
+    }
+    free(rxb->bufs);
+    free(rxb);
+    free(resp_buffer);
+    hist_free(&stats.lat_interval);
+    hist_free(&stats.lat_total);
+    dual_race_free(stats.dual);
+    fec_decoder_free(stats.fec);
+    hop_trail_free(stats.hops);
+    free(stats.relay);
+    free(resp_queue.items);
+    io_engine_close(&engine);
     close(sync_sock);
     close(data_sock);
-    return 0;
+    if (cfg.slos.count > 0 && session.id == 0) {
+        printf("SLO result: NO DATA (no test session; exit code %d)\n", SLO_EXIT_NO_DATA);
+        return SLO_EXIT_NO_DATA;
+    }
+    return slo_status;
 }
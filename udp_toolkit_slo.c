@@ -0,0 +1,212 @@
+// SLO parsing and evaluation, see udp_toolkit_slo.h
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>        // strcasecmp
+
+#include "udp_toolkit_slo.h"
+
+enum slo_kind { SLO_KIND_PERCENT, SLO_KIND_TIME, SLO_KIND_BITRATE, SLO_KIND_RATE, SLO_KIND_COUNT };
+
+struct slo_unit {
+    enum slo_kind kind;
+    const char*   name;         // Matched case-insensitively, except for time units
+    double        scale;
+};
+
+// The first unit of each kind is the default
+static const struct slo_unit slo_units[] = {
+    { SLO_KIND_PERCENT, "%",    1.0  },
+    { SLO_KIND_TIME,    "ms",   1e-3 },
+    { SLO_KIND_TIME,    "us",   1e-6 },
+    { SLO_KIND_TIME,    "\xc2\xb5s", 1e-6 },    // µs
+    { SLO_KIND_TIME,    "ns",   1e-9 },
+    { SLO_KIND_TIME,    "s",    1.0  },
+    { SLO_KIND_BITRATE, "bps",  1.0  },
+    { SLO_KIND_BITRATE, "Kbps", 1e3  },
+    { SLO_KIND_BITRATE, "Mbps", 1e6  },
+    { SLO_KIND_BITRATE, "Gbps", 1e9  },
+    { SLO_KIND_RATE,    "",     1.0  },
+    { SLO_KIND_RATE,    "k",    1e3  },
+    { SLO_KIND_RATE,    "M",    1e6  },
+    { SLO_KIND_COUNT,   "",     1.0  },
+};
+
+static enum slo_kind metric_kind(enum slo_metric metric) {
+    switch (metric) {
+        case SLO_METRIC_LOSS:       return SLO_KIND_PERCENT;
+        case SLO_METRIC_THROUGHPUT: return SLO_KIND_BITRATE;
+        case SLO_METRIC_PPS:
+        case SLO_METRIC_TPS:        return SLO_KIND_RATE;
+        case SLO_METRIC_OUTAGES:    return SLO_KIND_COUNT;
+        default:                    return SLO_KIND_TIME;
+    }
+}
+
+static int parse_metric(const char* name, struct slo* s) {
+    static const struct { const char* name; enum slo_metric metric; } names[] = {
+        { "loss", SLO_METRIC_LOSS }, { "min", SLO_METRIC_LAT_MIN }, { "mean", SLO_METRIC_LAT_MEAN },
+        { "max", SLO_METRIC_LAT_MAX }, { "throughput", SLO_METRIC_THROUGHPUT },
+        { "pps", SLO_METRIC_PPS }, { "tps", SLO_METRIC_TPS }, { "outages", SLO_METRIC_OUTAGES },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i].name) == 0) {
+            s->metric = names[i].metric;
+            return 0;
+        }
+    }
+    // pNN: latency percentile, e.g. p99 or p99.9
+    if (name[0] == 'p' && name[1] != '\0') {
+        char* end;
+        double pct = strtod(name + 1, &end);
+        if (*end == '\0' && pct > 0 && pct <= 100) {
+            s->metric     = SLO_METRIC_LAT_PERCENTILE;
+            s->percentile = pct;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int parse_unit(const char* unit, enum slo_kind kind, struct slo* s) {
+    const struct slo_unit* def = NULL;
+    for (size_t i = 0; i < sizeof(slo_units) / sizeof(slo_units[0]); i++) {
+        const struct slo_unit* u = &slo_units[i];
+        if (u->kind != kind) continue;
+        if (!def) def = u;
+        int match = kind == SLO_KIND_TIME ? strcmp(unit, u->name) == 0 : strcasecmp(unit, u->name) == 0;
+        if (match) {
+            s->scale = u->scale;
+            snprintf(s->unit, sizeof(s->unit), "%s", u->name);
+            return 0;
+        }
+    }
+    if (unit[0] != '\0' || !def) return -1;
+    s->scale = def->scale;
+    snprintf(s->unit, sizeof(s->unit), "%s", def->name);
+    return 0;
+}
+
+// Parse one expression of len bytes
+static int parse_one(const char* expr, size_t len, struct slo* s) {
+    char buf[64];
+    size_t n = 0;
+    for (size_t i = 0; i < len && n < sizeof(buf) - 1; i++) {
+        if (!isspace((unsigned char)expr[i])) buf[n++] = expr[i];
+    }
+    buf[n] = '\0';
+    memset(s, 0, sizeof(*s));
+    snprintf(s->text, sizeof(s->text), "%s", buf);
+
+    char* op = strpbrk(buf, "<>");
+    if (!op || op == buf) return -1;
+    char name[32];
+    snprintf(name, sizeof(name), "%.*s", (int)(op - buf), buf);
+    if (parse_metric(name, s) < 0) return -1;
+
+    const char* p = op + 1;
+    if (*p == '=') {
+        s->op = *op == '<' ? SLO_OP_LE : SLO_OP_GE;
+        p++;
+    } else {
+        s->op = *op == '<' ? SLO_OP_LT : SLO_OP_GT;
+    }
+
+    char* unit;
+    double value = strtod(p, &unit);
+    if (unit == p || parse_unit(unit, metric_kind(s->metric), s) < 0) return -1;
+    s->threshold = value * s->scale;
+    return 0;
+}
+
+int slo_parse(struct slo_set* set, const char* arg) {
+    const char* p = arg;
+    for (;;) {
+        const char* comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+        if (set->count >= SLO_MAX) {
+            fprintf(stderr, "Error: At most %d SLOs are supported\n", SLO_MAX);
+            return -1;
+        }
+        if (parse_one(p, len, &set->items[set->count]) < 0) {
+            fprintf(stderr, "Error: Invalid SLO '%.*s' (expected e.g. loss<0.01%%, p99<500us, throughput>9.5Gbps)\n",
+                    (int)len, p);
+            return -1;
+        }
+        set->count++;
+        if (!comma) return 0;
+        p = comma + 1;
+    }
+}
+
+void slo_measure_init(struct slo_measure* m) {
+    memset(m, 0, sizeof(*m));
+    m->loss       = NAN;
+    m->throughput = NAN;
+    m->pps        = NAN;
+    m->tps        = NAN;
+    m->outages    = NAN;
+    m->lat_min    = NAN;
+    m->lat_mean   = NAN;
+    m->lat_max    = NAN;
+}
+
+static double measured_value(const struct slo* s, const struct slo_measure* m) {
+    switch (s->metric) {
+        case SLO_METRIC_LOSS:       return m->loss;
+        case SLO_METRIC_LAT_MIN:    return m->lat_min;
+        case SLO_METRIC_LAT_MEAN:   return m->lat_mean;
+        case SLO_METRIC_LAT_MAX:    return m->lat_max;
+        case SLO_METRIC_THROUGHPUT: return m->throughput;
+        case SLO_METRIC_PPS:        return m->pps;
+        case SLO_METRIC_TPS:        return m->tps;
+        case SLO_METRIC_OUTAGES:    return m->outages;
+        case SLO_METRIC_LAT_PERCENTILE:
+            return m->lat_percentile ? m->lat_percentile(m->lat_ctx, s->percentile) : NAN;
+    }
+    return NAN;
+}
+
+int slo_evaluate(const struct slo_set* set, const struct slo_measure* m, FILE* out) {
+    int failed = 0, missing = 0;
+    fprintf(out, "SLO evaluation:\n");
+    fprintf(out, "  %-28s %-20s %s\n", "SLO", "Measured", "Result");
+    for (int i = 0; i < set->count; i++) {
+        const struct slo* s = &set->items[i];
+        double v = measured_value(s, m);
+        char measured[32];
+        const char* result;
+        if (isnan(v)) {
+            snprintf(measured, sizeof(measured), "n/a");
+            result = "NO DATA";
+            missing++;
+        } else {
+            int ok;
+            switch (s->op) {
+                case SLO_OP_LT: ok = v <  s->threshold; break;
+                case SLO_OP_LE: ok = v <= s->threshold; break;
+                case SLO_OP_GT: ok = v >  s->threshold; break;
+                default:        ok = v >= s->threshold; break;
+            }
+            snprintf(measured, sizeof(measured), "%.3f %s", v / s->scale, s->unit);
+            result = ok ? "PASS" : "FAIL";
+            failed += !ok;
+        }
+        fprintf(out, "  %-28s %-20s %s\n", s->text, measured, result);
+    }
+
+    int rc = failed ? SLO_EXIT_FAIL : missing ? SLO_EXIT_NO_DATA : SLO_EXIT_PASS;
+    fprintf(out, "SLO result: %s (%d passed, %d failed, %d not measured; exit code %d)\n",
+            rc == SLO_EXIT_PASS ? "PASS" : rc == SLO_EXIT_FAIL ? "FAIL" : "NO DATA",
+            set->count - failed - missing, failed, missing, rc);
+    return rc;
+}
+
+int slo_combine(int a, int b) {
+    if (a == SLO_EXIT_FAIL || b == SLO_EXIT_FAIL) return SLO_EXIT_FAIL;
+    if (a == SLO_EXIT_NO_DATA || b == SLO_EXIT_NO_DATA) return SLO_EXIT_NO_DATA;
+    return SLO_EXIT_PASS;
+}
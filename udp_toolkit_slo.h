@@ -0,0 +1,73 @@
+// Service level objectives evaluated at the end of a run by udp_toolkit_client.c and
+// udp_toolkit_server.c, for gating automated rollouts on the exit code.
+//
+// An SLO is "metric op value[unit]", e.g. "loss<0.01%", "p99<500us", "throughput>9.5Gbps".
+// Metrics: loss (%), min, mean, max and pNN latency (ns, us, ms, s; default ms), throughput
+// (bps, Kbps, Mbps, Gbps; default bps), pps and tps (optional k or M suffix), outages (count).
+// Operators: <, <=, >, >=.
+#ifndef UDP_TOOLKIT_SLO_H
+#define UDP_TOOLKIT_SLO_H
+
+#include <stdio.h>
+
+#define SLO_MAX             16
+
+// Exit codes; 1 stays the code for runtime errors
+#define SLO_EXIT_PASS       0   // Every SLO was met
+#define SLO_EXIT_FAIL       2   // At least one SLO was violated
+#define SLO_EXIT_NO_DATA    3   // No violation, but at least one metric was not measured
+
+enum slo_metric {
+    SLO_METRIC_LOSS,
+    SLO_METRIC_LAT_MIN,
+    SLO_METRIC_LAT_MEAN,
+    SLO_METRIC_LAT_MAX,
+    SLO_METRIC_LAT_PERCENTILE,
+    SLO_METRIC_THROUGHPUT,
+    SLO_METRIC_PPS,
+    SLO_METRIC_TPS,
+    SLO_METRIC_OUTAGES,
+};
+
+enum slo_op { SLO_OP_LT, SLO_OP_LE, SLO_OP_GT, SLO_OP_GE };
+
+struct slo {
+    char             text[64];      // Expression as given
+    enum slo_metric  metric;
+    double           percentile;    // SLO_METRIC_LAT_PERCENTILE only
+    enum slo_op      op;
+    double           threshold;     // Base unit: percent, seconds, bits/s, 1/s or count
+    double           scale;         // Base units per display unit (1e-6 for us)
+    char             unit[8];       // Display unit
+};
+
+struct slo_set {
+    int        count;
+    struct slo items[SLO_MAX];
+};
+
+// Results of a run. Metrics that were not measured stay NAN; latencies are in seconds.
+struct slo_measure {
+    double loss;                    // Percent
+    double throughput;              // bits/s
+    double pps;
+    double tps;                     // Transactions per second
+    double outages;
+    double lat_min, lat_mean, lat_max;
+    double (*lat_percentile)(const void* ctx, double percentile);  // NULL: not measured
+    const void* lat_ctx;
+};
+
+// Add the comma-separated SLO expressions of arg. Returns -1 (with a message) on syntax errors.
+int slo_parse(struct slo_set* set, const char* arg);
+
+// Mark every metric as not measured
+void slo_measure_init(struct slo_measure* m);
+
+// Print the pass/fail table of set against m and return an SLO_EXIT_* code
+int slo_evaluate(const struct slo_set* set, const struct slo_measure* m, FILE* out);
+
+// Combine two SLO_EXIT_* codes into the worse one (FAIL over NO_DATA over PASS)
+int slo_combine(int a, int b);
+
+#endif // UDP_TOOLKIT_SLO_H
@@ -0,0 +1,85 @@
+// Per-interval statistics snapshots sent by udp_toolkit_server (-R) to udp_toolkit_aggregator.
+//
+// One UDP datagram per reporting interval of a test session: the interval's counters and its
+// latency histogram in HdrHistogram's compressed V2 encoding (udp_toolkit_histlog.h), so the
+// aggregator can merge histograms of many servers into exact fleet-level percentiles.
+// Fields are in host byte order like the data packets; all hosts of a fleet are little-endian.
+#ifndef UDP_TOOLKIT_SNAPSHOT_H
+#define UDP_TOOLKIT_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define STATS_PORT          6000        // Default aggregator port
+#define SNAPSHOT_MAGIC      0x53535455  // "UTSS"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_HOST_LEN   32          // Host name, NUL-padded
+#define SNAPSHOT_MAX_SIZE   65507       // Largest UDP payload over IPv4
+
+// Layout: | magic(4) | version(4) | host(32) | session(4) | hist_len(4) | start(8) | end(8) |
+//         | packets(8) | bytes(8) | lost(8) | outages(8) | negative(8) | histogram ... |
+#define SNAP_OFF_MAGIC      0
+#define SNAP_OFF_VERSION    4
+#define SNAP_OFF_HOST       8
+#define SNAP_OFF_SESSION    (SNAP_OFF_HOST + SNAPSHOT_HOST_LEN)
+#define SNAP_OFF_HIST_LEN   (SNAP_OFF_SESSION + 4)
+#define SNAP_OFF_START      (SNAP_OFF_HIST_LEN + 4)
+#define SNAP_OFF_END        (SNAP_OFF_START + 8)
+#define SNAP_OFF_PACKETS    (SNAP_OFF_END + 8)
+#define SNAP_OFF_BYTES      (SNAP_OFF_PACKETS + 8)
+#define SNAP_OFF_LOST       (SNAP_OFF_BYTES + 8)
+#define SNAP_OFF_OUTAGES    (SNAP_OFF_LOST + 8)
+#define SNAP_OFF_NEGATIVE   (SNAP_OFF_OUTAGES + 8)
+#define SNAPSHOT_HEADER_SIZE (SNAP_OFF_NEGATIVE + 8)
+
+struct stats_snapshot {
+    char     host[SNAPSHOT_HOST_LEN + 1];   // NUL-terminated after decoding
+    uint32_t session;                       // Session id on the sending server
+    uint32_t hist_len;                      // Bytes of compressed histogram after the header
+    double   start, end;                    // Interval, seconds since the epoch
+    uint64_t packets;                       // Data packets received in the interval
+    uint64_t bytes;
+    uint64_t lost;                          // Sequence gaps in the interval
+    uint64_t outages;                       // Outages detected in the interval
+    uint64_t negative;                      // Packets with a negative latency
+};
+
+static inline void snapshot_encode(unsigned char* buf, const struct stats_snapshot* s) {
+    uint32_t magic = SNAPSHOT_MAGIC, version = SNAPSHOT_VERSION;
+    memcpy(buf + SNAP_OFF_MAGIC,    &magic,       sizeof(magic));
+    memcpy(buf + SNAP_OFF_VERSION,  &version,     sizeof(version));
+    memset(buf + SNAP_OFF_HOST, 0, SNAPSHOT_HOST_LEN);
+    memcpy(buf + SNAP_OFF_HOST,     s->host,      strnlen(s->host, SNAPSHOT_HOST_LEN));
+    memcpy(buf + SNAP_OFF_SESSION,  &s->session,  sizeof(s->session));
+    memcpy(buf + SNAP_OFF_HIST_LEN, &s->hist_len, sizeof(s->hist_len));
+    memcpy(buf + SNAP_OFF_START,    &s->start,    sizeof(s->start));
+    memcpy(buf + SNAP_OFF_END,      &s->end,      sizeof(s->end));
+    memcpy(buf + SNAP_OFF_PACKETS,  &s->packets,  sizeof(s->packets));
+    memcpy(buf + SNAP_OFF_BYTES,    &s->bytes,    sizeof(s->bytes));
+    memcpy(buf + SNAP_OFF_LOST,     &s->lost,     sizeof(s->lost));
+    memcpy(buf + SNAP_OFF_OUTAGES,  &s->outages,  sizeof(s->outages));
+    memcpy(buf + SNAP_OFF_NEGATIVE, &s->negative, sizeof(s->negative));
+}
+
+// Decode the header of a len-byte datagram; -1 if it is not a complete snapshot
+static inline int snapshot_decode(const unsigned char* buf, size_t len, struct stats_snapshot* s) {
+    uint32_t magic, version;
+    if (len < SNAPSHOT_HEADER_SIZE) return -1;
+    memcpy(&magic,   buf + SNAP_OFF_MAGIC,   sizeof(magic));
+    memcpy(&version, buf + SNAP_OFF_VERSION, sizeof(version));
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) return -1;
+    memcpy(s->host, buf + SNAP_OFF_HOST, SNAPSHOT_HOST_LEN);
+    s->host[SNAPSHOT_HOST_LEN] = '\0';
+    memcpy(&s->session,  buf + SNAP_OFF_SESSION,  sizeof(s->session));
+    memcpy(&s->hist_len, buf + SNAP_OFF_HIST_LEN, sizeof(s->hist_len));
+    memcpy(&s->start,    buf + SNAP_OFF_START,    sizeof(s->start));
+    memcpy(&s->end,      buf + SNAP_OFF_END,      sizeof(s->end));
+    memcpy(&s->packets,  buf + SNAP_OFF_PACKETS,  sizeof(s->packets));
+    memcpy(&s->bytes,    buf + SNAP_OFF_BYTES,    sizeof(s->bytes));
+    memcpy(&s->lost,     buf + SNAP_OFF_LOST,     sizeof(s->lost));
+    memcpy(&s->outages,  buf + SNAP_OFF_OUTAGES,  sizeof(s->outages));
+    memcpy(&s->negative, buf + SNAP_OFF_NEGATIVE, sizeof(s->negative));
+    return s->hist_len <= len - SNAPSHOT_HEADER_SIZE ? 0 : -1;
+}
+
+#endif // UDP_TOOLKIT_SNAPSHOT_H
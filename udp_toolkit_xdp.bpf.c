@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0
+// XDP counting sink: parses the toolkit's data packets in the kernel, counts them per
+// flow in a per-CPU hash map and drops them. Everything that is not a data packet to the
+// data port (ARP, clock sync, fragments, session markers, FEC parity, requests) is passed
+// to the stack unchanged.
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/in.h>
+#include <linux/udp.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_endian.h>
+
+#include "udp_toolkit_proto.h"
+#include "udp_toolkit_xdp.h"
+
+// Packets on the data port that are not counted: their seq is not a data sequence number
+// (END carries the packets sent, parity the first seq of its block) or they need a reply
+#define XDP_PASS_FLAGS (PKT_FLAGS_CONTROL | PKT_FLAG_FEC_PARITY | PKT_FLAG_REQUEST | \
+                        PKT_FLAG_RESPONSE | PKT_FLAG_ECHO_REPLY)
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(max_entries, XDP_MAX_FLOWS);
+    __type(key, struct xdp_flow_key);
+    __type(value, struct xdp_flow_stats);
+} flow_stats SEC(".maps");
+
+SEC("xdp")
+int udp_toolkit_xdp_sink(struct xdp_md* ctx) {
+    void* data     = (void*)(long)ctx->data;
+    void* data_end = (void*)(long)ctx->data_end;
+
+    struct ethhdr* eth = data;
+    if ((void*)(eth + 1) > data_end || eth->h_proto != bpf_htons(ETH_P_IP)) return XDP_PASS;
+
+    struct iphdr* ip = (void*)(eth + 1);
+    if ((void*)(ip + 1) > data_end || ip->protocol != IPPROTO_UDP || ip->ihl < 5) return XDP_PASS;
+    if (ip->frag_off & bpf_htons(0x3FFF)) return XDP_PASS;     // Fragments go to the stack
+
+    struct udphdr* udp = (void*)ip + ip->ihl * 4;
+    if ((void*)(udp + 1) > data_end || udp->dest != bpf_htons(DATA_PORT)) return XDP_PASS;
+
+    // Only the sequence number and the flags of the toolkit header are needed
+    __u8* payload = (void*)(udp + 1);
+    if ((void*)(payload + HEADER_SIZE) > data_end) return XDP_PASS;
+    __s32 seq;
+    __u32 flags;
+    __builtin_memcpy(&seq, payload + HDR_OFF_SEQ, sizeof(seq));
+    __builtin_memcpy(&flags, payload + HDR_OFF_FLAGS, sizeof(flags));
+    if (flags & XDP_PASS_FLAGS) return XDP_PASS;
+
+    struct xdp_flow_key key = { .saddr = ip->saddr, .sport = udp->source, .pad = 0 };
+    struct xdp_flow_stats* st = bpf_map_lookup_elem(&flow_stats, &key);
+    if (!st) {
+        struct xdp_flow_stats init = {0};
+        bpf_map_update_elem(&flow_stats, &key, &init, BPF_NOEXIST);
+        st = bpf_map_lookup_elem(&flow_stats, &key);
+        if (!st) return XDP_PASS;
+    }
+
+    // Per-CPU values are only touched by this CPU, no atomics needed
+    if (st->packets == 0) {
+        st->lowest_seq  = seq;
+        st->highest_seq = seq;
+    } else if (seq > st->highest_seq) {
+        st->highest_seq = seq;
+    } else if (seq < st->lowest_seq) {
+        st->lowest_seq = seq;
+    }
+    st->packets++;
+    st->bytes += bpf_ntohs(udp->len) - sizeof(*udp);
+    // Echo requests are counted and still passed so the server answers them (-E)
+    return (flags & PKT_FLAG_ECHO_REQ) ? XDP_PASS : XDP_DROP;
+}
+
+char LICENSE[] SEC("license") = "GPL";
@@ -0,0 +1,180 @@
+// Loader for the XDP counting sink (udp_toolkit_xdp.bpf.c), used by udp_toolkit_server -X
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>         // dirname
+#include <limits.h>         // PATH_MAX
+#include <net/if.h>         // if_nametoindex
+#include <arpa/inet.h>      // inet_ntop
+#include <linux/if_link.h>  // XDP_FLAGS_*
+#include <bpf/libbpf.h>
+#include <bpf/bpf.h>
+
+#include "udp_toolkit_xdp.h"
+
+struct xdp_sink {
+    struct bpf_object*     obj;
+    int                    ifindex;
+    __u32                  attach_flags;
+    int                    map_fd;
+    int                    ncpus;
+    struct xdp_flow_stats* percpu;                  // ncpus values of one lookup
+    struct xdp_flow_key    keys[XDP_MAX_FLOWS];     // Flows seen at the previous report
+    struct xdp_flow_stats  prev[XDP_MAX_FLOWS];     // Their merged counters at that time
+    int                    nprev;
+};
+
+// Default object path: next to the running executable
+static void default_obj_path(char* path, size_t len) {
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) {
+        snprintf(path, len, "%s", XDP_OBJ_NAME);
+        return;
+    }
+    exe[n] = '\0';
+    snprintf(path, len, "%s/%s", dirname(exe), XDP_OBJ_NAME);
+}
+
+struct xdp_sink* xdp_sink_open(const char* ifname, const char* obj_path) {
+    char path[PATH_MAX];
+    if (!obj_path) {
+        default_obj_path(path, sizeof(path));
+        obj_path = path;
+    }
+
+    struct xdp_sink* sink = (struct xdp_sink*)calloc(1, sizeof(*sink));
+    if (!sink) return NULL;
+
+    sink->ifindex = (int)if_nametoindex(ifname);
+    if (sink->ifindex == 0) {
+        fprintf(stderr, "Error: Unknown interface '%s'\n", ifname);
+        free(sink);
+        return NULL;
+    }
+
+    sink->obj = bpf_object__open_file(obj_path, NULL);
+    if (!sink->obj || libbpf_get_error(sink->obj)) {
+        fprintf(stderr, "Error: Cannot open XDP object %s\n", obj_path);
+        free(sink);
+        return NULL;
+    }
+    if (bpf_object__load(sink->obj) < 0) {
+        fprintf(stderr, "Error: Cannot load XDP object %s (are you root?)\n", obj_path);
+        bpf_object__close(sink->obj);
+        free(sink);
+        return NULL;
+    }
+
+    struct bpf_program* prog = bpf_object__find_program_by_name(sink->obj, "udp_toolkit_xdp_sink");
+    sink->map_fd = bpf_object__find_map_fd_by_name(sink->obj, "flow_stats");
+    sink->ncpus  = libbpf_num_possible_cpus();
+    sink->percpu = (struct xdp_flow_stats*)calloc(sink->ncpus > 0 ? sink->ncpus : 1,
+                                                  sizeof(struct xdp_flow_stats));
+    if (!prog || sink->map_fd < 0 || sink->ncpus <= 0 || !sink->percpu) {
+        fprintf(stderr, "Error: XDP object %s is incomplete\n", obj_path);
+        xdp_sink_close(sink);
+        return NULL;
+    }
+
+    // Prefer native (driver) mode, fall back to generic mode for drivers without XDP
+    int prog_fd = bpf_program__fd(prog);
+    sink->attach_flags = XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_DRV_MODE;
+    if (bpf_xdp_attach(sink->ifindex, prog_fd, sink->attach_flags, NULL) < 0) {
+        sink->attach_flags = XDP_FLAGS_UPDATE_IF_NOEXIST | XDP_FLAGS_SKB_MODE;
+        if (bpf_xdp_attach(sink->ifindex, prog_fd, sink->attach_flags, NULL) < 0) {
+            fprintf(stderr, "Error: Cannot attach XDP program to %s\n", ifname);
+            sink->ifindex = 0;
+            xdp_sink_close(sink);
+            return NULL;
+        }
+    }
+    printf("XDP counting sink attached to %s (%s mode)\n", ifname,
+           (sink->attach_flags & XDP_FLAGS_DRV_MODE) ? "native" : "generic");
+    return sink;
+}
+
+// Merge the per-CPU values of one flow
+static void merge_percpu(const struct xdp_sink* sink, struct xdp_flow_stats* out) {
+    memset(out, 0, sizeof(*out));
+    out->highest_seq = -1;
+    for (int c = 0; c < sink->ncpus; c++) {
+        const struct xdp_flow_stats* v = &sink->percpu[c];
+        if (v->packets == 0) continue;
+        if (out->packets == 0 || v->lowest_seq < out->lowest_seq) out->lowest_seq = v->lowest_seq;
+        if (v->highest_seq > out->highest_seq) out->highest_seq = v->highest_seq;
+        out->packets += v->packets;
+        out->bytes   += v->bytes;
+    }
+}
+
+// Packets missing from the merged sequence range of a flow (duplicates can make it negative)
+static __u64 flow_lost(const struct xdp_flow_stats* f) {
+    if (f->packets == 0) return 0;
+    __s64 lost = f->highest_seq - f->lowest_seq + 1 - (__s64)f->packets;
+    return lost > 0 ? (__u64)lost : 0;
+}
+
+void xdp_sink_report(struct xdp_sink* sink, double interval) {
+    struct xdp_flow_key   keys[XDP_MAX_FLOWS];
+    struct xdp_flow_stats merged[XDP_MAX_FLOWS];
+    int nflows = 0;
+
+    struct xdp_flow_key key, next;
+    void* prev_key = NULL;
+    while (nflows < XDP_MAX_FLOWS && bpf_map_get_next_key(sink->map_fd, prev_key, &next) == 0) {
+        if (bpf_map_lookup_elem(sink->map_fd, &next, sink->percpu) == 0) {
+            keys[nflows] = next;
+            merge_percpu(sink, &merged[nflows]);
+            nflows++;
+        }
+        key = next;
+        prev_key = &key;
+    }
+
+    __u64 d_packets = 0, d_bytes = 0, total_packets = 0, total_lost = 0;
+    for (int i = 0; i < nflows; i++) {
+        const struct xdp_flow_stats* cur = &merged[i];
+        struct xdp_flow_stats before = {0};
+        for (int j = 0; j < sink->nprev; j++) {
+            if (memcmp(&sink->keys[j], &keys[i], sizeof(keys[i])) == 0) {
+                before = sink->prev[j];
+                break;
+            }
+        }
+        __u64 dp = cur->packets - before.packets;
+        __u64 db = cur->bytes - before.bytes;
+        d_packets     += dp;
+        d_bytes       += db;
+        total_packets += cur->packets;
+        __u64 lost = flow_lost(cur);
+        total_lost    += lost;
+
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &keys[i].saddr, ip, sizeof(ip));
+        printf("    XDP flow %s:%d: %.0f pps, %.3f Mbps, packets %llu, seq %lld-%lld, lost %llu, loss %.3f%%\n",
+               ip, ntohs(keys[i].sport), dp / interval, db * 8.0 / interval / 1e6,
+               (unsigned long long)cur->packets, (long long)cur->lowest_seq, (long long)cur->highest_seq,
+               (unsigned long long)lost, cur->packets + lost ? 100.0 * lost / (cur->packets + lost) : 0.0);
+    }
+    printf("    XDP total: %.0f pps, %.3f Mbps, packets %llu, lost %llu, flows %d\n",
+           d_packets / interval, d_bytes * 8.0 / interval / 1e6,
+           (unsigned long long)total_packets, (unsigned long long)total_lost, nflows);
+
+    memcpy(sink->keys, keys, nflows * sizeof(keys[0]));
+    memcpy(sink->prev, merged, nflows * sizeof(merged[0]));
+    sink->nprev = nflows;
+}
+
+void xdp_sink_close(struct xdp_sink* sink) {
+    if (!sink) return;
+    if (sink->ifindex > 0 && sink->attach_flags) {
+        bpf_xdp_detach(sink->ifindex, sink->attach_flags & ~XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
+    }
+    if (sink->obj) bpf_object__close(sink->obj);
+    free(sink->percpu);
+    free(sink);
+}
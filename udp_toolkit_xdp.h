@@ -0,0 +1,44 @@
+// Types shared by the XDP counting sink program (udp_toolkit_xdp.bpf.c) and its loader
+// (udp_toolkit_xdp.c). This header is also compiled for the BPF target, so it only uses
+// kernel UAPI types.
+#ifndef UDP_TOOLKIT_XDP_H
+#define UDP_TOOLKIT_XDP_H
+
+#include <linux/types.h>
+
+#define XDP_MAX_FLOWS   1024    // Flows tracked by the flow_stats map
+#define XDP_OBJ_NAME    "udp_toolkit_xdp.bpf.o"
+
+// Flow key: source address and port in network byte order
+struct xdp_flow_key {
+    __u32 saddr;
+    __u16 sport;
+    __u16 pad;
+};
+
+// Per-CPU flow counters. RSS usually keeps a 5-tuple on one CPU, but a flow can move
+// (RSS table changes, generic mode on a multi-queue device), so no per-CPU value knows the
+// flow's loss. User space sums packets and bytes, takes the lowest and highest sequence
+// numbers over CPUs and derives the loss from the merged range.
+struct xdp_flow_stats {
+    __u64 packets;
+    __u64 bytes;            // UDP payload bytes, same as the socket path counts
+    __s64 lowest_seq;       // Only valid when packets > 0
+    __s64 highest_seq;      // Only valid when packets > 0
+};
+
+#ifndef __bpf__
+// Loader API, implemented in udp_toolkit_xdp.c (built only when libbpf is available)
+struct xdp_sink;
+
+// Load the program from obj_path (NULL = next to the executable) and attach it to ifname
+struct xdp_sink* xdp_sink_open(const char* ifname, const char* obj_path);
+
+// Read and merge the per-CPU maps, print per-flow and total rates for the interval
+void xdp_sink_report(struct xdp_sink* sink, double interval);
+
+// Detach the program and free the sink
+void xdp_sink_close(struct xdp_sink* sink);
+#endif
+
+#endif // UDP_TOOLKIT_XDP_H
@@ -0,0 +1,84 @@
+#!/bin/bash
+#
+# Test the XDP counting sink (server -X) on a veth pair.
+# The server side of the pair stays in the root namespace, the client runs in a
+# separate network namespace. Requires root, python3 and a build with libbpf and clang.
+#
+
+NS="udpt_xdp"
+SERVER_IF="udpt0"
+CLIENT_IF="udpt1"
+SERVER_ADDR="10.77.0.1"
+CLIENT_ADDR="10.77.0.2"
+BANDWIDTH=100000000 # 100 Mbps
+DURATION=10         # seconds
+PACKET_SIZE=1000    # bytes
+MARKER_PORT=40000   # source port of the marker case
+SERVER_LOG=$(mktemp)
+
+if [ ! -f "./build/udp_toolkit_server" ] || [ ! -f "./build/udp_toolkit_xdp.bpf.o" ]; then
+    echo "Error: XDP-enabled build not found in ./build/"
+    echo "Please build the project with libbpf and clang installed (cmake . && make)"
+    exit 1
+fi
+
+function cleanup {
+    [ -n "$SERVER_PID" ] && kill -INT "$SERVER_PID" 2>/dev/null && wait "$SERVER_PID"
+    ip link del "$SERVER_IF" 2>/dev/null
+    ip netns del "$NS" 2>/dev/null
+    rm -f "$SERVER_LOG"
+}
+trap cleanup EXIT
+
+# Create the veth pair and move the client end into its own namespace
+ip netns add "$NS" || exit 1
+ip link add "$SERVER_IF" type veth peer name "$CLIENT_IF" || exit 1
+ip link set "$CLIENT_IF" netns "$NS"
+ip addr add "$SERVER_ADDR/24" dev "$SERVER_IF"
+ip link set "$SERVER_IF" up
+ip netns exec "$NS" ip addr add "$CLIENT_ADDR/24" dev "$CLIENT_IF"
+ip netns exec "$NS" ip link set "$CLIENT_IF" up
+ip netns exec "$NS" ip link set lo up
+
+# Start the server with the XDP sink on the server end of the pair
+stdbuf -oL ./build/udp_toolkit_server -X "$SERVER_IF" > "$SERVER_LOG" 2>/dev/null &
+SERVER_PID=$!
+sleep 1
+
+# Clock sync (port 4000) is passed to the stack, data packets are counted and dropped
+ip netns exec "$NS" ./build/udp_toolkit_client -i "$SERVER_ADDR" -b "$BANDWIDTH" -t "$DURATION" -s "$PACKET_SIZE"
+sleep 2
+
+# Marker case: START, 100 data packets, a parity packet and END three times (seq = packets
+# sent). Only the data packets may be counted: seq 0-99, no loss. The markers reach the stack.
+ip netns exec "$NS" python3 - "$SERVER_ADDR" "$MARKER_PORT" <<'PY'
+import socket, struct, sys, time
+START, END, FEC_PARITY = 0x0010, 0x0020, 0x0200
+s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+s.bind(("0.0.0.0", int(sys.argv[2])))
+def send(seq, flags, size=64):
+    hdr = struct.pack("<iddiI", seq, time.time(), 0.0, size, flags)
+    s.sendto(hdr + b"\0" * (size - len(hdr)), (sys.argv[1], 5000))
+send(0, START, 28)
+for seq in range(100):
+    send(seq, 0)
+send(0, FEC_PARITY)
+for _ in range(3):
+    send(100, END, 28)
+PY
+sleep 2
+
+cat "$SERVER_LOG"
+FLOW=$(grep "XDP flow $CLIENT_ADDR:$MARKER_PORT:" "$SERVER_LOG" | tail -n 1)
+if echo "$FLOW" | grep -q "packets 100, seq 0-99, lost 0,"; then
+    echo "Marker case passed."
+else
+    echo "Marker case failed: ${FLOW:-no XDP report for the marker flow}"
+    exit 1
+fi
+if [ "$(grep -c '^=== Session .* started ===' "$SERVER_LOG")" -lt 2 ]; then
+    echo "Marker case failed: START did not reach the server"
+    exit 1
+fi
+
+echo "Test completed."